@@ -71,9 +71,11 @@ uniform sampler2D s_Albedo; //#slot 0
 uniform sampler2D s_Normal; //#slot 1
 uniform sampler2D s_Metalness; //#slot 2
 uniform sampler2D s_Roughness; //#slot 3
+#ifndef NO_IBL
 uniform samplerCube s_IrradianceMap; //#slot 4
 uniform samplerCube s_PrefilteredMap; //#slot 5
 uniform sampler2D s_BRDF; //#slot 6
+#endif
 uniform sampler2DArray s_ShadowMap; //#slot 7
 
 // ------------------------------------------------------------------
@@ -215,6 +217,7 @@ void main()
 		// --------------------------------------------------------------------------
 	}
 
+#ifndef NO_POINT_LIGHTS
 	// For each point light...
 	for (int i = 0; i < pointLightCount; i++)
 	{
@@ -254,7 +257,9 @@ void main()
 		Lo += (kD * kAlbedo / kPI + specular) * Li * NdotL;
 		// --------------------------------------------------------------------------
 	}
+#endif
 
+#ifndef NO_IBL
 	vec3 kS = F;
 	vec3 kD = 1.0 - kS;
 	kD *= 1.0 - kMetalness;
@@ -268,7 +273,9 @@ void main()
 	vec3 specular = prefilteredColor * (F * brdf.x + brdf.y);
 
 	vec3 ambient = (kD * diffuse + specular) * kAmbient;
-	// vec3 ambient = vec3(0.03) * diffuse * kAmbient;
+#else
+	vec3 ambient = vec3(0.03) * kAlbedo * kAmbient;
+#endif
 
 	vec3 color = Lo + ambient;
 
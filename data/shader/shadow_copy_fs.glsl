@@ -0,0 +1,21 @@
+// ------------------------------------------------------------------
+// INPUT VARIABLES --------------------------------------------------
+// ------------------------------------------------------------------
+
+flat in int PS_IN_Slice;
+
+// ------------------------------------------------------------------
+// SAMPLERS ---------------------------------------------------------
+// ------------------------------------------------------------------
+
+uniform sampler2DArray s_StaticMaps; //#slot 0
+
+// ------------------------------------------------------------------
+// MAIN -------------------------------------------------------------
+// ------------------------------------------------------------------
+
+void main()
+{
+	// Same size as the target slice, so every fragment reads its own texel.
+	gl_FragDepth = texelFetch(s_StaticMaps, ivec3(gl_FragCoord.xy, PS_IN_Slice), 0).r;
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+layout (location = 0) in vec3 VS_IN_Position; // xy: clip space position, z: array slice
+
+flat out int PS_IN_Slice;
+
+void main()
+{
+	PS_IN_Slice = int(VS_IN_Position.z);
+	gl_Position = vec4(VS_IN_Position.xy, 0.0, 1.0);
+}
\ No newline at end of file
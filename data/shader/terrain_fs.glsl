@@ -0,0 +1,20 @@
+// ------------------------------------------------------------------
+// INPUT VARIABLES  -------------------------------------------------
+// ------------------------------------------------------------------
+
+in vec4 PS_IN_Color;
+
+// ------------------------------------------------------------------
+// OUTPUT VARIABLES  ------------------------------------------------
+// ------------------------------------------------------------------
+
+out vec4 PS_OUT_Color;
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+void main()
+{
+	PS_OUT_Color = PS_IN_Color;
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+// ------------------------------------------------------------------
+// INPUT VARIABLES  -------------------------------------------------
+// ------------------------------------------------------------------
+
+layout(location = 0) in vec2 VS_IN_Position; // Lattice coordinates, 0 to the grid dimension.
+layout(location = 1) in vec4 VS_IN_Patch;	 // Instanced only. x: x position, y: z position, z: size, w: morph range.
+layout(location = 2) in vec4 VS_IN_Color;	 // Instanced only.
+
+// ------------------------------------------------------------------
+// OUTPUT VARIABLES  ------------------------------------------------
+// ------------------------------------------------------------------
+
+out vec4 PS_IN_Color;
+
+// ------------------------------------------------------------------
+// UNIFORM BUFFERS --------------------------------------------------
+// ------------------------------------------------------------------
+
+layout (std140) uniform u_PerFrame //#binding 0
+{
+	mat4 view;
+	mat4 proj;
+	vec4 cameraPos; // w: morph start
+	vec4 heightMap; // xy: size in texels, z: texels per world unit, w: height scale
+	vec4 tiling;	// x: 1 if the heightmap is tiled, y: tile size, z: tile border
+};
+
+layout (std140) uniform u_PerPatch //#binding 1
+{
+	vec4 translationRange; // x, z: patch position, w: morph range
+	vec4 gridDimScale;	   // xy: grid dimension, z: patch size, w: 1 if the patch comes from VS_IN_Patch
+	vec4 color;
+};
+
+// ------------------------------------------------------------------
+// SAMPLERS ---------------------------------------------------------
+// ------------------------------------------------------------------
+
+uniform sampler2D s_HeightMap; //#slot 0
+uniform sampler2DArray s_Tiles; //#slot 1
+uniform sampler2D s_PageTable; //#slot 2
+
+// ------------------------------------------------------------------
+// FUNCTIONS --------------------------------------------------------
+// ------------------------------------------------------------------
+
+float TiledHeight(vec2 texel)
+{
+	texel = clamp(texel, vec2(0.0), heightMap.xy - 1.0);
+
+	vec2 tile = floor(texel / tiling.y);
+	float slice = texelFetch(s_PageTable, ivec2(tile), 0).r;
+
+	// Tiles that are not resident yet read as flat ground.
+	if (slice < 0.0)
+		return 0.0;
+
+	// Stored tiles repeat the neighbouring texels in their border, so filtering never crosses into another slice.
+	vec2 uv = (texel - tile * tiling.y + tiling.z + 0.5) / (tiling.y + 2.0 * tiling.z);
+	return textureLod(s_Tiles, vec3(uv, slice), 0.0).r;
+}
+
+// ------------------------------------------------------------------
+
+// Same as sample_height() in terrain_mesher.cpp: bilinear between texel centers, in world units.
+float SampleHeight(vec2 pos)
+{
+	vec2 texel = pos * heightMap.z;
+
+	if (tiling.x > 0.5)
+		return TiledHeight(texel) * heightMap.w;
+
+	return textureLod(s_HeightMap, (texel + 0.5) / heightMap.xy, 0.0).r * heightMap.w;
+}
+
+// ------------------------------------------------------------------
+
+// Odd lattice points are one cell away from the even point below them, even points stay where they are.
+vec2 MorphGridPosition(vec2 gridPos, float gridDim, float k)
+{
+	vec2 fracPart = fract(gridPos * gridDim * 0.5) * 2.0 / gridDim;
+	return gridPos - fracPart * k;
+}
+
+// ------------------------------------------------------------------
+// MAIN  ------------------------------------------------------------
+// ------------------------------------------------------------------
+
+void main()
+{
+	vec4 node = vec4(translationRange.x, translationRange.z, gridDimScale.z, translationRange.w);
+	vec4 patchColor = color;
+
+	if (gridDimScale.w > 0.5)
+	{
+		node = VS_IN_Patch;
+		patchColor = VS_IN_Color;
+	}
+
+	vec2 gridPos = VS_IN_Position / gridDimScale.x;
+	vec2 pos = node.xy + gridPos * node.z;
+
+	// The morph factor is based on the distance to the unmorphed vertex, see terrain_mesher.cpp.
+	float dist = length(vec3(pos.x, SampleHeight(pos), pos.y) - cameraPos.xyz);
+	float start = node.w * cameraPos.w;
+	float k = clamp((dist - start) / (node.w - start), 0.0, 1.0);
+
+	pos = node.xy + MorphGridPosition(gridPos, gridDimScale.x, k) * node.z;
+
+	PS_IN_Color = patchColor;
+	gl_Position = proj * view * vec4(pos.x, SampleHeight(pos), pos.y, 1.0);
+}
\ No newline at end of file
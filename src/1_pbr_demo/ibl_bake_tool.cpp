@@ -0,0 +1,249 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <string.h>
+#include <math.h>
+
+#include <stb_image.h>
+
+#include "ibl_baker.h"
+#include <common/thread_pool.h>
+
+#define VERIFY_DIRECTIONS 64
+#define VERIFY_IRRADIANCE_MEAN 0.05f // SH9 against the exact integral, relative.
+#define VERIFY_PACKED_SH_MAX 0.001f // Packed uniform against SH9, relative.
+#define VERIFY_PREFILTER_MEAN 0.001f // Bake against the prefilter_fs.glsl port, relative.
+
+#define SYNTHETIC_WIDTH 128
+#define SYNTHETIC_HEIGHT 64
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static float relative_error(const glm::vec3& value, const glm::vec3& reference)
+{
+	return glm::length(value - reference) / glm::max(glm::length(reference), 1e-4f);
+}
+
+// Fibonacci sphere, so the checks cover every face without favoring any.
+static glm::vec3 verify_direction(int i)
+{
+	float y = 1.0f - 2.0f * (i + 0.5f) / VERIFY_DIRECTIONS;
+	float r = sqrtf(1.0f - y * y);
+	float phi = i * 2.39996323f;
+
+	return glm::vec3(cosf(phi) * r, y, sinf(phi) * r);
+}
+
+// Sky gradient with a sun, bright and small enough that SH9 and the narrow lobes have something to get wrong.
+static std::vector<float> synthetic_environment()
+{
+	std::vector<float> rgb(3 * SYNTHETIC_WIDTH * SYNTHETIC_HEIGHT);
+	glm::vec3 sun = glm::normalize(glm::vec3(0.3f, 0.6f, 0.5f));
+
+	for (int y = 0; y < SYNTHETIC_HEIGHT; y++)
+	{
+		float theta = 3.14159265359f * (y + 0.5f) / SYNTHETIC_HEIGHT;
+
+		for (int x = 0; x < SYNTHETIC_WIDTH; x++)
+		{
+			float phi = 2.0f * 3.14159265359f * (x + 0.5f) / SYNTHETIC_WIDTH;
+			glm::vec3 dir = glm::vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+
+			glm::vec3 color = glm::mix(glm::vec3(0.2f, 0.15f, 0.1f), glm::vec3(0.3f, 0.5f, 1.0f), 0.5f * dir.y + 0.5f);
+			color += glm::vec3(20.0f, 18.0f, 15.0f) * powf(glm::max(glm::dot(dir, sun), 0.0f), 64.0f);
+
+			float* texel = &rgb[3 * (y * SYNTHETIC_WIDTH + x)];
+			texel[0] = color.x;
+			texel[1] = color.y;
+			texel[2] = color.z;
+		}
+	}
+
+	return rgb;
+}
+
+static void bake(const float* rgb, int width, int height, const dw::IblBakeDesc& desc, dw::IblData& data, dw::ThreadPool& pool)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	auto stage = start;
+
+	dw::equirect_to_cubemap(rgb, width, height, desc.environment_size, data.environment, &pool);
+	double environment_ms = elapsed_ms(stage);
+
+	stage = std::chrono::high_resolution_clock::now();
+	dw::project_sh9(data.environment, data.radiance_sh, &pool);
+	double sh_ms = elapsed_ms(stage);
+
+	stage = std::chrono::high_resolution_clock::now();
+	dw::bake_irradiance(data.radiance_sh, desc.irradiance_size, data.irradiance, &pool);
+	double irradiance_ms = elapsed_ms(stage);
+
+	stage = std::chrono::high_resolution_clock::now();
+	dw::prefilter_environment(data.environment, desc.prefilter_size, desc.prefilter_mips, data.prefiltered, &pool);
+	double prefilter_ms = elapsed_ms(stage);
+
+	double total_ms = elapsed_ms(start);
+
+	std::cout << "Source        : " << width << " x " << height << std::endl;
+	std::cout << "Threads       : " << pool.worker_count() + 1 << std::endl;
+	std::cout << "Environment   : " << environment_ms << " ms" << std::endl;
+	std::cout << "SH projection : " << sh_ms << " ms" << std::endl;
+	std::cout << "Irradiance    : " << irradiance_ms << " ms" << std::endl;
+	std::cout << "Prefilter     : " << prefilter_ms << " ms" << std::endl;
+	std::cout << "Total         : " << total_ms << " ms" << std::endl;
+}
+
+// Compares the baked products against brute force versions of the shader loops. Returns false if any of them is
+// past its threshold.
+static bool verify(const dw::IblData& data)
+{
+	bool success = true;
+	float max_error = 0.0f;
+	float mean_error = 0.0f;
+
+	for (int i = 0; i < VERIFY_DIRECTIONS; i++)
+	{
+		glm::vec3 n = verify_direction(i);
+		float error = relative_error(data.irradiance.sample(n, 0.0f), dw::reference_irradiance(data.environment, n));
+
+		max_error = glm::max(max_error, error);
+		mean_error += error / VERIFY_DIRECTIONS;
+	}
+
+	std::cout << "Irradiance    : mean " << mean_error * 100.0f << " %, max " << max_error * 100.0f << " % (SH9 vs exact integral)" << std::endl;
+
+	if (mean_error > VERIFY_IRRADIANCE_MEAN)
+	{
+		std::cout << "Irradiance mean error over " << VERIFY_IRRADIANCE_MEAN * 100.0f << " %" << std::endl;
+		success = false;
+	}
+
+	// The uniform pbr_fs.glsl evaluates has to reproduce the baked irradiance.
+	dw::IrradianceSH packed;
+	dw::pack_irradiance_sh9(data.radiance_sh, packed);
+
+	max_error = 0.0f;
+
+	for (int i = 0; i < VERIFY_DIRECTIONS; i++)
+	{
+		glm::vec3 n = verify_direction(i);
+		max_error = glm::max(max_error, relative_error(dw::evaluate_packed_irradiance(packed, n), dw::evaluate_sh9_irradiance(data.radiance_sh, n)));
+	}
+
+	std::cout << "Irradiance SH : max " << max_error * 100.0f << " % (packed uniform vs SH9)" << std::endl;
+
+	if (max_error > VERIFY_PACKED_SH_MAX)
+	{
+		std::cout << "Packed SH error over " << VERIFY_PACKED_SH_MAX * 100.0f << " %" << std::endl;
+		success = false;
+	}
+
+	// Prefiltered texels are compared at their centers, so only the sampling math is measured and not resampling.
+	// The shader port checks the bake itself, the brute force integral how far the sampled estimate is from the lobe.
+	std::cout << "Prefilter     : mean / max % bake vs shader, bake vs brute force" << std::endl;
+
+	for (int mip = 0; mip < data.prefiltered.mip_count; mip++)
+	{
+		float roughness = data.prefiltered.mip_count > 1 ? float(mip) / float(data.prefiltered.mip_count - 1) : 0.0f;
+		int size = data.prefiltered.mip_size(mip);
+		int sample_count = dw::prefilter_sample_count(roughness);
+
+		float max_shader = 0.0f, mean_shader = 0.0f;
+		float max_brute_force = 0.0f, mean_brute_force = 0.0f;
+
+		for (int i = 0; i < VERIFY_DIRECTIONS; i++)
+		{
+			int face = i % 6;
+			int x = (i * 7919) % size;
+			int y = (i * 104729) % size;
+
+			glm::vec3 n = dw::cubemap_direction(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f);
+			const float* texel = data.prefiltered.face(mip, face) + 3 * (y * size + x);
+			glm::vec3 baked = glm::vec3(texel[0], texel[1], texel[2]);
+
+			float error = relative_error(baked, dw::reference_prefilter(data.environment, n, roughness, sample_count));
+			max_shader = glm::max(max_shader, error);
+			mean_shader += error / VERIFY_DIRECTIONS;
+
+			error = relative_error(baked, dw::brute_force_prefilter(data.environment, n, roughness));
+			max_brute_force = glm::max(max_brute_force, error);
+			mean_brute_force += error / VERIFY_DIRECTIONS;
+		}
+
+		std::cout << "Prefilter " << mip << "   : " << sample_count << " samples, " << mean_shader * 100.0f << " / " << max_shader * 100.0f << ", "
+			<< mean_brute_force * 100.0f << " / " << max_brute_force * 100.0f << std::endl;
+
+		if (mean_shader > VERIFY_PREFILTER_MEAN)
+		{
+			std::cout << "Prefilter " << mip << " error over " << VERIFY_PREFILTER_MEAN * 100.0f << " %" << std::endl;
+			success = false;
+		}
+	}
+
+	return success;
+}
+
+// Bakes the IBL maps of an equirectangular HDR into the cache the renderer loads.
+// Usage: 1_pbr_ibl_baker <environment.hdr> [--verify]
+//        1_pbr_ibl_baker --synthetic
+// Writes <environment.hdr>.ibl. --verify compares the results against the shader math and fails past the thresholds.
+// --synthetic bakes and verifies a small generated environment at reduced sizes without writing anything.
+int main(int argc, const char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: 1_pbr_ibl_baker <environment.hdr> [--verify]" << std::endl;
+		std::cout << "       1_pbr_ibl_baker --synthetic" << std::endl;
+		return 1;
+	}
+
+	dw::IblBakeDesc desc;
+	dw::IblData data;
+	dw::ThreadPool pool;
+
+	if (strcmp(argv[1], "--synthetic") == 0)
+	{
+		desc.environment_size = 64;
+		desc.irradiance_size = 8;
+		desc.prefilter_size = 32;
+
+		std::vector<float> rgb = synthetic_environment();
+		bake(&rgb[0], SYNTHETIC_WIDTH, SYNTHETIC_HEIGHT, desc, data, pool);
+
+		return verify(data) ? 0 : 1;
+	}
+
+	std::string hdr_file = argv[1];
+	bool verify_bake = argc > 2 && strcmp(argv[2], "--verify") == 0;
+
+	int width, height, channels;
+	float* rgb = stbi_loadf(hdr_file.c_str(), &width, &height, &channels, 3);
+
+	if (!rgb)
+	{
+		std::cout << "Failed to load " << hdr_file << std::endl;
+		return 1;
+	}
+
+	bake(rgb, width, height, desc, data, pool);
+	stbi_image_free(rgb);
+
+	uint64_t hash;
+
+	if (!dw::hash_ibl_source(hdr_file, desc, hash) || !dw::write_ibl_cache(dw::ibl_cache_path(hdr_file), hash, data))
+	{
+		std::cout << "Failed to write " << dw::ibl_cache_path(hdr_file) << std::endl;
+		return 1;
+	}
+
+	std::cout << "Wrote         : " << dw::ibl_cache_path(hdr_file) << std::endl;
+
+	if (verify_bake && !verify(data))
+		return 1;
+
+	return 0;
+}
\ No newline at end of file
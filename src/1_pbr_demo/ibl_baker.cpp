@@ -0,0 +1,800 @@
+#include "ibl_baker.h"
+#include <common/thread_pool.h>
+#include <common/hash.h>
+#include <logger.h>
+#include <stb_image.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#if DW_SIMD
+#include <emmintrin.h>
+#endif
+
+#define IBL_PI 3.14159265359f
+
+namespace dw
+{
+	static void parallel_for(ThreadPool* pool, int count, const std::function<void(int)>& func)
+	{
+		if (pool)
+			pool->parallel_for(count, func);
+		else
+		{
+			for (int i = 0; i < count; i++)
+				func(i);
+		}
+	}
+
+	static float radical_inverse(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10f;
+	}
+
+	// Tangent space GGX half vector, same as ImportanceSampleGGX() in the shaders.
+	static glm::vec3 importance_sample_ggx(uint32_t i, uint32_t count, float roughness)
+	{
+		float a = roughness * roughness;
+		float x = float(i) / float(count);
+		float y = radical_inverse(i);
+
+		float phi = 2.0f * IBL_PI * x;
+		float cos_theta = sqrtf((1.0f - y) / (1.0f + (a * a - 1.0f) * y));
+		float sin_theta = sqrtf(1.0f - cos_theta * cos_theta);
+
+		return glm::vec3(cosf(phi) * sin_theta, sinf(phi) * sin_theta, cos_theta);
+	}
+
+	static void tangent_basis(const glm::vec3& n, glm::vec3& tangent, glm::vec3& bitangent)
+	{
+		glm::vec3 up = fabs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+		tangent = glm::normalize(glm::cross(up, n));
+		bitangent = glm::cross(n, tangent);
+	}
+
+	static float distribution_ggx(float NdotH, float roughness)
+	{
+		float a = roughness * roughness;
+		float a2 = a * a;
+		float denom = NdotH * NdotH * (a2 - 1.0f) + 1.0f;
+
+		return a2 / (IBL_PI * denom * denom);
+	}
+
+	// Filtered importance sampling: the source level covers the solid angle of a sample, so fewer samples read coarser
+	// levels. With V = N the pdf only depends on the half vector.
+	static float prefilter_source_lod(const glm::vec3& h, float roughness, int environment_size, int sample_count)
+	{
+		if (roughness == 0.0f)
+			return 0.0f;
+
+		float pdf = distribution_ggx(h.z, roughness) * h.z / (4.0f * h.z) + 0.0001f;
+		float sa_texel = 4.0f * IBL_PI / (6.0f * environment_size * environment_size);
+		float sa_sample = 1.0f / (float(sample_count) * pdf + 0.0001f);
+
+		return glm::max(0.5f * log2f(sa_sample / sa_texel), 0.0f);
+	}
+
+	void Cubemap::allocate(int _size, int _mip_count)
+	{
+		size = _size;
+		mip_count = _mip_count;
+		data.resize(face_offset(mip_count, 0));
+	}
+
+	size_t Cubemap::face_offset(int mip, int face) const
+	{
+		size_t offset = 0;
+
+		for (int i = 0; i < mip; i++)
+			offset += 6 * size_t(mip_size(i)) * mip_size(i) * 3;
+
+		return offset + size_t(face) * mip_size(mip) * mip_size(mip) * 3;
+	}
+
+	glm::vec3 Cubemap::sample_level(const glm::vec3& dir, int mip) const
+	{
+		int face_index;
+		float s, t;
+		cubemap_face_coords(dir, face_index, s, t);
+
+		int level_size = mip_size(mip);
+		const float* texels = face(mip, face_index);
+
+		float x = glm::clamp(s * level_size - 0.5f, 0.0f, float(level_size - 1));
+		float y = glm::clamp(t * level_size - 0.5f, 0.0f, float(level_size - 1));
+		int x0 = int(x);
+		int y0 = int(y);
+		int x1 = std::min(x0 + 1, level_size - 1);
+		int y1 = std::min(y0 + 1, level_size - 1);
+		float fx = x - x0;
+		float fy = y - y0;
+
+		const float* t00 = texels + 3 * (y0 * level_size + x0);
+		const float* t10 = texels + 3 * (y0 * level_size + x1);
+		const float* t01 = texels + 3 * (y1 * level_size + x0);
+		const float* t11 = texels + 3 * (y1 * level_size + x1);
+
+		glm::vec3 top = glm::vec3(t00[0], t00[1], t00[2]) * (1.0f - fx) + glm::vec3(t10[0], t10[1], t10[2]) * fx;
+		glm::vec3 bottom = glm::vec3(t01[0], t01[1], t01[2]) * (1.0f - fx) + glm::vec3(t11[0], t11[1], t11[2]) * fx;
+
+		return top * (1.0f - fy) + bottom * fy;
+	}
+
+	glm::vec3 Cubemap::sample(const glm::vec3& dir, float lod) const
+	{
+		lod = glm::clamp(lod, 0.0f, float(mip_count - 1));
+
+		int mip = int(lod);
+		float f = lod - mip;
+
+		if (f == 0.0f || mip + 1 >= mip_count)
+			return sample_level(dir, mip);
+
+		return sample_level(dir, mip) * (1.0f - f) + sample_level(dir, mip + 1) * f;
+	}
+
+	glm::vec3 cubemap_direction(int face, float s, float t)
+	{
+		switch (face)
+		{
+		case 0: return glm::normalize(glm::vec3(1.0f, -t, -s));
+		case 1: return glm::normalize(glm::vec3(-1.0f, -t, s));
+		case 2: return glm::normalize(glm::vec3(s, 1.0f, t));
+		case 3: return glm::normalize(glm::vec3(s, -1.0f, -t));
+		case 4: return glm::normalize(glm::vec3(s, -t, 1.0f));
+		default: return glm::normalize(glm::vec3(-s, -t, -1.0f));
+		}
+	}
+
+	void cubemap_face_coords(const glm::vec3& dir, int& face, float& s, float& t)
+	{
+		glm::vec3 a = glm::abs(dir);
+		float ma, sc, tc;
+
+		if (a.x >= a.y && a.x >= a.z)
+		{
+			face = dir.x >= 0.0f ? 0 : 1;
+			ma = a.x;
+			sc = dir.x >= 0.0f ? -dir.z : dir.z;
+			tc = -dir.y;
+		}
+		else if (a.y >= a.z)
+		{
+			face = dir.y >= 0.0f ? 2 : 3;
+			ma = a.y;
+			sc = dir.x;
+			tc = dir.y >= 0.0f ? dir.z : -dir.z;
+		}
+		else
+		{
+			face = dir.z >= 0.0f ? 4 : 5;
+			ma = a.z;
+			sc = dir.z >= 0.0f ? dir.x : -dir.x;
+			tc = -dir.y;
+		}
+
+		s = 0.5f * (sc / ma + 1.0f);
+		t = 0.5f * (tc / ma + 1.0f);
+	}
+
+	void equirect_to_cubemap(const float* rgb, int width, int height, int size, Cubemap& cube, ThreadPool* pool)
+	{
+		int mip_count = 1;
+
+		while ((size >> mip_count) > 0)
+			mip_count++;
+
+		cube.allocate(size, mip_count);
+
+		parallel_for(pool, 6 * size, [&](int row)
+		{
+			int face = row / size;
+			int y = row % size;
+			float* dst = cube.face(0, face) + 3 * size * y;
+
+			for (int x = 0; x < size; x++)
+			{
+				glm::vec3 dir = cubemap_direction(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f);
+
+				// Same mapping as latlong_fs.glsl. The first image row is the top of the sphere.
+				float u = atan2f(dir.z, dir.x) / (2.0f * IBL_PI) + 0.5f;
+				float v = asinf(glm::clamp(dir.y, -1.0f, 1.0f)) / IBL_PI + 0.5f;
+
+				float fx = u * width - 0.5f;
+				float fy = glm::clamp((1.0f - v) * height - 0.5f, 0.0f, float(height - 1));
+				int x0 = int(floorf(fx));
+				int y0 = int(fy);
+				float wx = fx - x0;
+				float wy = fy - y0;
+				int x1 = (x0 + 1 + width) % width;
+				int y1 = std::min(y0 + 1, height - 1);
+				x0 = (x0 + width) % width;
+
+				for (int c = 0; c < 3; c++)
+				{
+					float top = rgb[3 * (y0 * width + x0) + c] * (1.0f - wx) + rgb[3 * (y0 * width + x1) + c] * wx;
+					float bottom = rgb[3 * (y1 * width + x0) + c] * (1.0f - wx) + rgb[3 * (y1 * width + x1) + c] * wx;
+					dst[3 * x + c] = top * (1.0f - wy) + bottom * wy;
+				}
+			}
+		});
+
+		generate_cubemap_mips(cube, pool);
+	}
+
+	void generate_cubemap_mips(Cubemap& cube, ThreadPool* pool)
+	{
+		for (int mip = 1; mip < cube.mip_count; mip++)
+		{
+			int src_size = cube.mip_size(mip - 1);
+			int dst_size = cube.mip_size(mip);
+
+			parallel_for(pool, 6 * dst_size, [&](int row)
+			{
+				int face = row / dst_size;
+				int y = row % dst_size;
+				const float* src = cube.face(mip - 1, face);
+				float* dst = cube.face(mip, face) + 3 * dst_size * y;
+
+				int y0 = std::min(2 * y, src_size - 1);
+				int y1 = std::min(2 * y + 1, src_size - 1);
+
+				for (int x = 0; x < dst_size; x++)
+				{
+					int x0 = std::min(2 * x, src_size - 1);
+					int x1 = std::min(2 * x + 1, src_size - 1);
+
+					for (int c = 0; c < 3; c++)
+						dst[3 * x + c] = 0.25f * (src[3 * (y0 * src_size + x0) + c] + src[3 * (y0 * src_size + x1) + c] + src[3 * (y1 * src_size + x0) + c] + src[3 * (y1 * src_size + x1) + c]);
+				}
+			});
+		}
+	}
+
+	void sh9_basis(const glm::vec3& n, float* y)
+	{
+		y[0] = 0.282095f;
+		y[1] = 0.488603f * n.y;
+		y[2] = 0.488603f * n.z;
+		y[3] = 0.488603f * n.x;
+		y[4] = 1.092548f * n.x * n.y;
+		y[5] = 1.092548f * n.y * n.z;
+		y[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+		y[7] = 1.092548f * n.x * n.z;
+		y[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+	}
+
+	// Integral of the solid angle from the face center to (x, y), in [-1, 1] face coordinates.
+	static float area_element(float x, float y)
+	{
+		return atan2f(x * y, sqrtf(x * x + y * y + 1.0f));
+	}
+
+	void project_sh9(const Cubemap& cube, SH9& sh, ThreadPool* pool)
+	{
+		// Box filtered levels keep the integral over each texel, which is all the low order bands see.
+		int mip = 0;
+
+		while (cube.mip_size(mip) > IBL_SH_PROJECTION_SIZE && mip + 1 < cube.mip_count)
+			mip++;
+
+		int size = cube.mip_size(mip);
+		std::vector<SH9> rows(6 * size);
+		std::vector<float> row_weights(6 * size);
+
+		parallel_for(pool, 6 * size, [&](int row)
+		{
+			int face = row / size;
+			int y = row % size;
+			const float* src = cube.face(mip, face) + 3 * size * y;
+			float inv_size = 1.0f / size;
+
+			SH9& partial = rows[row];
+			float weight_sum = 0.0f;
+
+			for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+				partial.coefficients[i] = glm::vec3(0.0f);
+
+			float t0 = 2.0f * y * inv_size - 1.0f;
+			float t1 = 2.0f * (y + 1) * inv_size - 1.0f;
+
+			for (int x = 0; x < size; x++)
+			{
+				float s0 = 2.0f * x * inv_size - 1.0f;
+				float s1 = 2.0f * (x + 1) * inv_size - 1.0f;
+				float solid_angle = area_element(s0, t0) - area_element(s0, t1) - area_element(s1, t0) + area_element(s1, t1);
+
+				glm::vec3 dir = cubemap_direction(face, 0.5f * (s0 + s1), 0.5f * (t0 + t1));
+				glm::vec3 radiance = glm::vec3(src[3 * x], src[3 * x + 1], src[3 * x + 2]) * solid_angle;
+
+				float basis[IBL_SH_COEFFICIENTS];
+				sh9_basis(dir, basis);
+
+				for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+					partial.coefficients[i] += radiance * basis[i];
+
+				weight_sum += solid_angle;
+			}
+
+			row_weights[row] = weight_sum;
+		});
+
+		// Sum in row order so the result does not depend on the thread count.
+		float total_weight = 0.0f;
+
+		for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+			sh.coefficients[i] = glm::vec3(0.0f);
+
+		for (int row = 0; row < 6 * size; row++)
+		{
+			for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+				sh.coefficients[i] += rows[row].coefficients[i];
+
+			total_weight += row_weights[row];
+		}
+
+		// The texel solid angles add up to 4 pi, normalizing removes the small quadrature error.
+		for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+			sh.coefficients[i] *= 4.0f * IBL_PI / total_weight;
+	}
+
+	// Clamped cosine convolution (pi, 2 pi / 3, pi / 4 per band), divided by pi.
+	static const float kSHBand[IBL_SH_COEFFICIENTS] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	// sh9_basis without the direction terms.
+	static const float kSHBasisScale[IBL_SH_COEFFICIENTS] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+
+	glm::vec3 evaluate_sh9_irradiance(const SH9& sh, const glm::vec3& n)
+	{
+		float basis[IBL_SH_COEFFICIENTS];
+		sh9_basis(n, basis);
+
+		glm::vec3 irradiance = glm::vec3(0.0f);
+
+		for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+			irradiance += sh.coefficients[i] * (kSHBand[i] * basis[i]);
+
+		return glm::max(irradiance, glm::vec3(0.0f));
+	}
+
+	void bake_irradiance(const SH9& sh, int size, Cubemap& irradiance, ThreadPool* pool)
+	{
+		irradiance.allocate(size, 1);
+
+		parallel_for(pool, 6 * size, [&](int row)
+		{
+			int face = row / size;
+			int y = row % size;
+			float* dst = irradiance.face(0, face) + 3 * size * y;
+
+			for (int x = 0; x < size; x++)
+			{
+				glm::vec3 n = cubemap_direction(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f);
+				glm::vec3 e = evaluate_sh9_irradiance(sh, n);
+
+				dst[3 * x] = e.x;
+				dst[3 * x + 1] = e.y;
+				dst[3 * x + 2] = e.z;
+			}
+		});
+	}
+
+	void pack_irradiance_sh9(const SH9& sh, IrradianceSH& packed)
+	{
+		float* dst = &packed.vectors[0].x;
+
+		for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+		{
+			glm::vec3 c = sh.coefficients[i] * (kSHBand[i] * kSHBasisScale[i]);
+
+			dst[3 * i] = c.x;
+			dst[3 * i + 1] = c.y;
+			dst[3 * i + 2] = c.z;
+		}
+
+		dst[IBL_SH_UNIFORM_VECTORS * 4 - 1] = 0.0f;
+	}
+
+	glm::vec3 evaluate_packed_irradiance(const IrradianceSH& packed, const glm::vec3& n)
+	{
+		const float* c = &packed.vectors[0].x;
+		float terms[IBL_SH_COEFFICIENTS] = { 1.0f, n.y, n.z, n.x, n.x * n.y, n.y * n.z, 3.0f * n.z * n.z - 1.0f, n.x * n.z, n.x * n.x - n.y * n.y };
+
+		glm::vec3 irradiance = glm::vec3(0.0f);
+
+		for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+			irradiance += glm::vec3(c[3 * i], c[3 * i + 1], c[3 * i + 2]) * terms[i];
+
+		return glm::max(irradiance, glm::vec3(0.0f));
+	}
+
+	void prefilter_environment(const Cubemap& environment, int size, int mip_count, Cubemap& prefiltered, ThreadPool* pool)
+	{
+		prefiltered.allocate(size, mip_count);
+
+		// Samples padded to a multiple of 4 for the SIMD loop. Padding has zero weight.
+		int capacity = (IBL_PREFILTER_SAMPLES + 3) & ~3;
+		std::vector<float> lx(capacity), ly(capacity), lz(capacity), lod(capacity);
+
+		for (int mip = 0; mip < mip_count; mip++)
+		{
+			float roughness = mip_count > 1 ? float(mip) / float(mip_count - 1) : 0.0f;
+			int level_size = prefiltered.mip_size(mip);
+
+			// With V = N every sample has the same tangent space direction, weight and source level for all texels,
+			// so only the basis change is left per texel.
+			int count = 0;
+			int sample_count = prefilter_sample_count(roughness);
+
+			for (int i = 0; i < sample_count; i++)
+			{
+				glm::vec3 h = importance_sample_ggx(i, sample_count, roughness);
+				glm::vec3 l = glm::normalize(2.0f * h.z * h - glm::vec3(0.0f, 0.0f, 1.0f));
+
+				if (l.z <= 0.0f)
+					continue;
+
+				lx[count] = l.x;
+				ly[count] = l.y;
+				lz[count] = l.z;
+				lod[count] = prefilter_source_lod(h, roughness, environment.size, sample_count);
+				count++;
+			}
+
+			int padded = (count + 3) & ~3;
+
+			for (int i = count; i < padded; i++)
+			{
+				lx[i] = 0.0f;
+				ly[i] = 0.0f;
+				lz[i] = 0.0f;
+				lod[i] = 0.0f;
+			}
+
+			parallel_for(pool, 6 * level_size, [&](int row)
+			{
+				int face = row / level_size;
+				int y = row % level_size;
+				float* dst = prefiltered.face(mip, face) + 3 * level_size * y;
+
+				for (int x = 0; x < level_size; x++)
+				{
+					glm::vec3 n = cubemap_direction(face, 2.0f * (x + 0.5f) / level_size - 1.0f, 2.0f * (y + 0.5f) / level_size - 1.0f);
+					glm::vec3 tangent, bitangent;
+					tangent_basis(n, tangent, bitangent);
+
+					glm::vec3 color = glm::vec3(0.0f);
+					float total_weight = 0.0f;
+
+					for (int i = 0; i < padded; i += 4)
+					{
+						float dx[4], dy[4], dz[4];
+
+#if DW_SIMD
+						__m128 sx = _mm_loadu_ps(&lx[i]);
+						__m128 sy = _mm_loadu_ps(&ly[i]);
+						__m128 sz = _mm_loadu_ps(&lz[i]);
+
+						_mm_storeu_ps(dx, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent.x), sx), _mm_mul_ps(_mm_set1_ps(bitangent.x), sy)), _mm_mul_ps(_mm_set1_ps(n.x), sz)));
+						_mm_storeu_ps(dy, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent.y), sx), _mm_mul_ps(_mm_set1_ps(bitangent.y), sy)), _mm_mul_ps(_mm_set1_ps(n.y), sz)));
+						_mm_storeu_ps(dz, _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent.z), sx), _mm_mul_ps(_mm_set1_ps(bitangent.z), sy)), _mm_mul_ps(_mm_set1_ps(n.z), sz)));
+#else
+						for (int j = 0; j < 4; j++)
+						{
+							dx[j] = tangent.x * lx[i + j] + bitangent.x * ly[i + j] + n.x * lz[i + j];
+							dy[j] = tangent.y * lx[i + j] + bitangent.y * ly[i + j] + n.y * lz[i + j];
+							dz[j] = tangent.z * lx[i + j] + bitangent.z * ly[i + j] + n.z * lz[i + j];
+						}
+#endif
+
+						for (int j = 0; j < 4 && i + j < count; j++)
+						{
+							color += environment.sample(glm::vec3(dx[j], dy[j], dz[j]), lod[i + j]) * lz[i + j];
+							total_weight += lz[i + j];
+						}
+					}
+
+					color /= total_weight;
+
+					dst[3 * x] = color.x;
+					dst[3 * x + 1] = color.y;
+					dst[3 * x + 2] = color.z;
+				}
+			});
+		}
+	}
+
+	glm::vec3 reference_irradiance(const Cubemap& environment, const glm::vec3& n)
+	{
+		// irradiance_fs.glsl point samples a fixed angular grid, which aliases small bright sources by several
+		// percent. Integrate every texel of a level of at most 128 texels instead.
+		int mip = 0;
+
+		while (mip + 1 < environment.mip_count && environment.mip_size(mip) > 128)
+			mip++;
+
+		int size = environment.mip_size(mip);
+		glm::vec3 irradiance = glm::vec3(0.0f);
+
+		for (int face = 0; face < 6; face++)
+		{
+			const float* src = environment.face(mip, face);
+
+			for (int y = 0; y < size; y++)
+			{
+				float t0 = 2.0f * y / size - 1.0f;
+				float t1 = 2.0f * (y + 1) / size - 1.0f;
+
+				for (int x = 0; x < size; x++)
+				{
+					float s0 = 2.0f * x / size - 1.0f;
+					float s1 = 2.0f * (x + 1) / size - 1.0f;
+
+					glm::vec3 dir = cubemap_direction(face, 0.5f * (s0 + s1), 0.5f * (t0 + t1));
+					float NdotL = glm::dot(dir, n);
+
+					if (NdotL <= 0.0f)
+						continue;
+
+					float solid_angle = area_element(s0, t0) - area_element(s0, t1) - area_element(s1, t0) + area_element(s1, t1);
+					const float* texel = src + 3 * (y * size + x);
+
+					irradiance += glm::vec3(texel[0], texel[1], texel[2]) * (NdotL * solid_angle);
+				}
+			}
+		}
+
+		return irradiance / IBL_PI;
+	}
+
+	int prefilter_sample_count(float roughness)
+	{
+		// A perfect mirror needs a single sample.
+		return roughness == 0.0f ? 1 : IBL_PREFILTER_SAMPLES;
+	}
+
+	glm::vec3 reference_prefilter(const Cubemap& environment, const glm::vec3& n, float roughness, int sample_count)
+	{
+		glm::vec3 tangent, bitangent;
+		tangent_basis(n, tangent, bitangent);
+
+		glm::vec3 color = glm::vec3(0.0f);
+		float total_weight = 0.0f;
+
+		for (int i = 0; i < sample_count; i++)
+		{
+			glm::vec3 th = importance_sample_ggx(i, sample_count, roughness);
+			glm::vec3 h = glm::normalize(tangent * th.x + bitangent * th.y + n * th.z);
+			glm::vec3 l = glm::normalize(2.0f * glm::dot(n, h) * h - n);
+
+			float NdotL = glm::max(glm::dot(n, l), 0.0f);
+
+			if (NdotL > 0.0f)
+			{
+				color += environment.sample(l, prefilter_source_lod(th, roughness, environment.size, sample_count)) * NdotL;
+				total_weight += NdotL;
+			}
+		}
+
+		return color / total_weight;
+	}
+
+	glm::vec3 brute_force_prefilter(const Cubemap& environment, const glm::vec3& n, float roughness)
+	{
+		if (roughness == 0.0f)
+			return environment.sample_level(n, 0);
+
+		// The sampled estimate converges to the integral of L * D(h) * NdotL over NdotL, with V = N. Sum it over
+		// every texel of a level of at most 256 texels, which is still far finer than the narrowest lobe.
+		int mip = 0;
+
+		while (mip + 1 < environment.mip_count && environment.mip_size(mip) > 256)
+			mip++;
+
+		int size = environment.mip_size(mip);
+		glm::vec3 color = glm::vec3(0.0f);
+		float total_weight = 0.0f;
+
+		for (int face = 0; face < 6; face++)
+		{
+			const float* src = environment.face(mip, face);
+
+			for (int y = 0; y < size; y++)
+			{
+				float t0 = 2.0f * y / size - 1.0f;
+				float t1 = 2.0f * (y + 1) / size - 1.0f;
+
+				for (int x = 0; x < size; x++)
+				{
+					float s0 = 2.0f * x / size - 1.0f;
+					float s1 = 2.0f * (x + 1) / size - 1.0f;
+
+					glm::vec3 l = cubemap_direction(face, 0.5f * (s0 + s1), 0.5f * (t0 + t1));
+					float NdotL = glm::dot(l, n);
+
+					if (NdotL <= 0.0f)
+						continue;
+
+					float NdotH = glm::dot(glm::normalize(l + n), n);
+					float solid_angle = area_element(s0, t0) - area_element(s0, t1) - area_element(s1, t0) + area_element(s1, t1);
+					float weight = distribution_ggx(NdotH, roughness) * NdotL * solid_angle;
+					const float* texel = src + 3 * (y * size + x);
+
+					color += glm::vec3(texel[0], texel[1], texel[2]) * weight;
+					total_weight += weight;
+				}
+			}
+		}
+
+		return color / total_weight;
+	}
+
+	bool bake_ibl(const std::string& hdr_file, const IblBakeDesc& desc, IblData& data, ThreadPool* pool)
+	{
+		int width, height, channels;
+		float* rgb = stbi_loadf(hdr_file.c_str(), &width, &height, &channels, 3);
+
+		if (!rgb)
+		{
+			LOG_ERROR("Failed to load environment map");
+			return false;
+		}
+
+		equirect_to_cubemap(rgb, width, height, desc.environment_size, data.environment, pool);
+		stbi_image_free(rgb);
+
+		project_sh9(data.environment, data.radiance_sh, pool);
+		bake_irradiance(data.radiance_sh, desc.irradiance_size, data.irradiance, pool);
+		prefilter_environment(data.environment, desc.prefilter_size, desc.prefilter_mips, data.prefiltered, pool);
+
+		return true;
+	}
+
+	bool hash_ibl_source(const std::string& hdr_file, const IblBakeDesc& desc, uint64_t& hash)
+	{
+		FILE* f = fopen(hdr_file.c_str(), "rb");
+
+		if (!f)
+		{
+			LOG_ERROR("Failed to open environment map");
+			return false;
+		}
+
+		uint32_t version = IBL_CACHE_VERSION;
+		uint8_t buffer[64 * 1024];
+		size_t read;
+
+		hash = FNV_OFFSET_BASIS;
+
+		while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+			hash = fnv1a(hash, buffer, read);
+
+		fclose(f);
+
+		hash = fnv1a(hash, &version, sizeof(version));
+		hash = fnv1a(hash, &desc.environment_size, sizeof(desc.environment_size));
+		hash = fnv1a(hash, &desc.irradiance_size, sizeof(desc.irradiance_size));
+		hash = fnv1a(hash, &desc.prefilter_size, sizeof(desc.prefilter_size));
+		hash = fnv1a(hash, &desc.prefilter_mips, sizeof(desc.prefilter_mips));
+
+		return true;
+	}
+
+	std::string ibl_cache_path(const std::string& hdr_file)
+	{
+		return hdr_file + ".ibl";
+	}
+
+	bool write_ibl_cache(const std::string& file, uint64_t source_hash, const IblData& data)
+	{
+		// Written to a temporary file first so an interrupted bake never leaves a valid looking cache behind.
+		std::string temp_file = file + ".tmp";
+		FILE* f = fopen(temp_file.c_str(), "wb");
+
+		if (!f)
+		{
+			LOG_ERROR("Failed to create IBL cache");
+			return false;
+		}
+
+		IblCacheHeader header;
+		header.magic = IBL_CACHE_MAGIC;
+		header.version = IBL_CACHE_VERSION;
+		header.source_hash = source_hash;
+		header.environment_size = data.environment.size;
+		header.environment_mips = data.environment.mip_count;
+		header.irradiance_size = data.irradiance.size;
+		header.prefilter_size = data.prefiltered.size;
+		header.prefilter_mips = data.prefiltered.mip_count;
+
+		for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+		{
+			for (int c = 0; c < 3; c++)
+				header.radiance_sh[3 * i + c] = data.radiance_sh.coefficients[i][c];
+		}
+
+		bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+		success = success && fwrite(&data.environment.data[0], sizeof(float), data.environment.data.size(), f) == data.environment.data.size();
+		success = success && fwrite(&data.irradiance.data[0], sizeof(float), data.irradiance.data.size(), f) == data.irradiance.data.size();
+		success = success && fwrite(&data.prefiltered.data[0], sizeof(float), data.prefiltered.data.size(), f) == data.prefiltered.data.size();
+
+		fclose(f);
+
+		if (!success)
+		{
+			remove(temp_file.c_str());
+			LOG_ERROR("Failed to write IBL cache");
+			return false;
+		}
+
+		remove(file.c_str());
+
+		if (rename(temp_file.c_str(), file.c_str()) != 0)
+		{
+			remove(temp_file.c_str());
+			LOG_ERROR("Failed to write IBL cache");
+			return false;
+		}
+
+		return true;
+	}
+
+	bool read_ibl_cache(const std::string& file, uint64_t source_hash, IblData& data)
+	{
+		FILE* f = fopen(file.c_str(), "rb");
+
+		if (!f)
+			return false;
+
+		IblCacheHeader header;
+
+		if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != IBL_CACHE_MAGIC || header.version != IBL_CACHE_VERSION || header.source_hash != source_hash)
+		{
+			fclose(f);
+			return false;
+		}
+
+		data.environment.allocate(header.environment_size, header.environment_mips);
+		data.irradiance.allocate(header.irradiance_size, 1);
+		data.prefiltered.allocate(header.prefilter_size, header.prefilter_mips);
+
+		for (int i = 0; i < IBL_SH_COEFFICIENTS; i++)
+			data.radiance_sh.coefficients[i] = glm::vec3(header.radiance_sh[3 * i], header.radiance_sh[3 * i + 1], header.radiance_sh[3 * i + 2]);
+
+		bool success = fread(&data.environment.data[0], sizeof(float), data.environment.data.size(), f) == data.environment.data.size();
+		success = success && fread(&data.irradiance.data[0], sizeof(float), data.irradiance.data.size(), f) == data.irradiance.data.size();
+		success = success && fread(&data.prefiltered.data[0], sizeof(float), data.prefiltered.data.size(), f) == data.prefiltered.data.size();
+
+		fclose(f);
+
+		return success;
+	}
+
+	bool load_ibl(const std::string& hdr_file, const IblBakeDesc& desc, IblData& data, ThreadPool* pool)
+	{
+		uint64_t hash;
+
+		if (!hash_ibl_source(hdr_file, desc, hash))
+			return false;
+
+		std::string cache_file = ibl_cache_path(hdr_file);
+
+		if (read_ibl_cache(cache_file, hash, data))
+			return true;
+
+		LOG_INFO("Baking IBL cache");
+
+		if (!bake_ibl(hdr_file, desc, data, pool))
+			return false;
+
+		// A failed write only costs the next startup another bake.
+		write_ibl_cache(cache_file, hash, data);
+
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <glm.hpp>
+#include <common/simd.h>
+
+#define IBL_CACHE_MAGIC 0x314C4249 // "IBL1"
+#define IBL_CACHE_VERSION 4
+#define IBL_PREFILTER_SAMPLES 1024 // Same as prefilter_fs.glsl.
+#define IBL_SH_COEFFICIENTS 9
+#define IBL_SH_PROJECTION_SIZE 64
+#define IBL_SH_UNIFORM_VECTORS 7 // 27 floats padded to std140 vec4s.
+
+namespace dw
+{
+	class ThreadPool;
+
+	// Sizes of the baked products. The defaults match what the renderer generates on the GPU. The BRDF LUT does not
+	// depend on the environment and the renderer always generates its own, so it is not baked.
+	struct IblBakeDesc
+	{
+		int environment_size = 512;
+		int irradiance_size = 32;
+		int prefilter_size = 128;
+		int prefilter_mips = 5; // pbr_fs.glsl samples up to kMaxLOD = 4.
+	};
+
+	// RGB float cubemap. Faces are in GL order (+X, -X, +Y, -Y, +Z, -Z) and every mip level stores all six faces.
+	struct Cubemap
+	{
+		int size = 0;
+		int mip_count = 0;
+		std::vector<float> data;
+
+		void allocate(int size, int mip_count);
+		inline int mip_size(int mip) const { return glm::max(size >> mip, 1); }
+		size_t face_offset(int mip, int face) const;
+		inline float* face(int mip, int face) { return &data[face_offset(mip, face)]; }
+		inline const float* face(int mip, int face) const { return &data[face_offset(mip, face)]; }
+		// Bilinear within a level, linear between levels. Faces are clamped at their edges.
+		glm::vec3 sample(const glm::vec3& dir, float lod) const;
+		glm::vec3 sample_level(const glm::vec3& dir, int mip) const;
+	};
+
+	// Order 2 spherical harmonics of RGB radiance.
+	struct SH9
+	{
+		glm::vec3 coefficients[IBL_SH_COEFFICIENTS];
+	};
+
+	// u_Irradiance::irradianceSH in pbr_fs.glsl. Coefficient-major RGB triplets with the cosine convolution, the 1 / pi
+	// and the basis constants folded in, so the shader only evaluates the polynomials.
+	struct IrradianceSH
+	{
+		glm::vec4 vectors[IBL_SH_UNIFORM_VECTORS];
+	};
+
+	struct IblData
+	{
+		Cubemap environment;
+		Cubemap irradiance;
+		Cubemap prefiltered;
+		SH9 radiance_sh;
+	};
+
+	// Layout of an IBL cache file. All data is float.
+	//   IblCacheHeader
+	//   environment[environment_mips][6][size][size][3]
+	//   irradiance[6][size][size][3]
+	//   prefiltered[prefilter_mips][6][size][size][3]
+	struct IblCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t source_hash;
+		int32_t environment_size;
+		int32_t environment_mips;
+		int32_t irradiance_size;
+		int32_t prefilter_size;
+		int32_t prefilter_mips;
+		float radiance_sh[IBL_SH_COEFFICIENTS * 3];
+	};
+
+	// Direction through a point on a cube face, s and t in [-1, 1]. Matches the GL cubemap face table.
+	glm::vec3 cubemap_direction(int face, float s, float t);
+	// Face and [0, 1] coordinates a direction hits.
+	void cubemap_face_coords(const glm::vec3& dir, int& face, float& s, float& t);
+
+	// Resamples an equirectangular map, as sampled by latlong_fs.glsl, and box filters a full mip chain.
+	void equirect_to_cubemap(const float* rgb, int width, int height, int size, Cubemap& cube, ThreadPool* pool = nullptr);
+	void generate_cubemap_mips(Cubemap& cube, ThreadPool* pool = nullptr);
+
+	void sh9_basis(const glm::vec3& n, float* y);
+	// Projects the largest level no bigger than IBL_SH_PROJECTION_SIZE, weighting each texel by its solid angle.
+	void project_sh9(const Cubemap& cube, SH9& sh, ThreadPool* pool = nullptr);
+	// Irradiance divided by pi, which is what irradiance_fs.glsl outputs.
+	glm::vec3 evaluate_sh9_irradiance(const SH9& sh, const glm::vec3& n);
+	void bake_irradiance(const SH9& sh, int size, Cubemap& irradiance, ThreadPool* pool = nullptr);
+	void pack_irradiance_sh9(const SH9& sh, IrradianceSH& packed);
+	// CPU version of the pbr_fs.glsl evaluation, equal to evaluate_sh9_irradiance.
+	glm::vec3 evaluate_packed_irradiance(const IrradianceSH& packed, const glm::vec3& n);
+
+	// Samples prefilter_fs.glsl takes at a roughness. Only the mirror level takes fewer, every level with a lobe keeps
+	// the full count: fewer samples read coarser source levels, and the error grows with every sample dropped.
+	int prefilter_sample_count(float roughness);
+	// GGX prefiltered radiance with the sampling of prefilter_fs.glsl. Level i has roughness i / (mip_count - 1).
+	void prefilter_environment(const Cubemap& environment, int size, int mip_count, Cubemap& prefiltered, ThreadPool* pool = nullptr);
+
+	// References for regression checks, one direction at a time. The irradiance integrates every texel of the
+	// environment. reference_prefilter is a direct port of prefilter_fs.glsl with any sample count, and
+	// brute_force_prefilter integrates the GGX lobe over every texel.
+	glm::vec3 reference_irradiance(const Cubemap& environment, const glm::vec3& n);
+	glm::vec3 reference_prefilter(const Cubemap& environment, const glm::vec3& n, float roughness, int sample_count);
+	glm::vec3 brute_force_prefilter(const Cubemap& environment, const glm::vec3& n, float roughness);
+
+	bool bake_ibl(const std::string& hdr_file, const IblBakeDesc& desc, IblData& data, ThreadPool* pool = nullptr);
+	// FNV-1a over the source contents and the bake sizes.
+	bool hash_ibl_source(const std::string& hdr_file, const IblBakeDesc& desc, uint64_t& hash);
+	std::string ibl_cache_path(const std::string& hdr_file);
+	bool write_ibl_cache(const std::string& file, uint64_t source_hash, const IblData& data);
+	// Fails if the file is missing, stale or does not match the hash.
+	bool read_ibl_cache(const std::string& file, uint64_t source_hash, IblData& data);
+	// Loads the cache of an HDR file, baking and writing it first if it is missing or out of date.
+	bool load_ibl(const std::string& hdr_file, const IblBakeDesc& desc, IblData& data, ThreadPool* pool = nullptr);
+}
\ No newline at end of file
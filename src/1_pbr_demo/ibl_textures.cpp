@@ -0,0 +1,110 @@
+#include "ibl_textures.h"
+#include <render_device.h>
+#include <Macros.h>
+#include <logger.h>
+
+namespace dw
+{
+	static TextureCube* create_cubemap(RenderDevice* device, const Cubemap& cube)
+	{
+		TextureCubeCreateDesc desc;
+		DW_ZERO_MEMORY(desc);
+
+		desc.format = TextureFormat::R32G32B32_FLOAT;
+		desc.width = cube.size;
+		desc.height = cube.size;
+		desc.mipmap_levels = cube.mip_count;
+
+		TextureCube* texture = device->create_texture_cube(desc);
+
+		if (!texture)
+			return nullptr;
+
+		for (int mip = 0; mip < cube.mip_count; mip++)
+		{
+			for (int face = 0; face < 6; face++)
+				device->set_texture_data(texture, mip, face, (void*)cube.face(mip, face));
+		}
+
+		return texture;
+	}
+
+	static UniformBuffer* create_irradiance_sh(RenderDevice* device, const IrradianceSH& packed)
+	{
+		BufferCreateDesc desc;
+		DW_ZERO_MEMORY(desc);
+
+		desc.data = (void*)&packed;
+		desc.data_type = DataType::FLOAT;
+		desc.size = sizeof(IrradianceSH);
+		desc.usage_type = BufferUsageType::STATIC;
+
+		return device->create_uniform_buffer(desc);
+	}
+
+	bool create_ibl_textures(RenderDevice* device, const IblData& data, IblTextures& textures)
+	{
+		if (data.environment.data.empty() || data.irradiance.data.empty() || data.prefiltered.data.empty())
+		{
+			LOG_ERROR("IBL data is incomplete");
+			return false;
+		}
+
+		destroy_ibl_textures(device, textures);
+
+		textures.environment = create_cubemap(device, data.environment);
+		textures.irradiance = create_cubemap(device, data.irradiance);
+		textures.prefiltered = create_cubemap(device, data.prefiltered);
+
+		IrradianceSH packed;
+		pack_irradiance_sh9(data.radiance_sh, packed);
+
+		textures.irradiance_sh = create_irradiance_sh(device, packed);
+
+		if (!textures.environment || !textures.irradiance || !textures.prefiltered || !textures.irradiance_sh)
+		{
+			LOG_ERROR("Failed to create IBL textures");
+			destroy_ibl_textures(device, textures);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool create_fallback_irradiance_sh(RenderDevice* device, IblTextures& textures)
+	{
+		destroy_ibl_textures(device, textures);
+
+		IrradianceSH packed;
+
+		for (int i = 0; i < IBL_SH_UNIFORM_VECTORS; i++)
+			packed.vectors[i] = glm::vec4(0.0f);
+
+		textures.irradiance_sh = create_irradiance_sh(device, packed);
+
+		if (!textures.irradiance_sh)
+		{
+			LOG_ERROR("Failed to create fallback irradiance SH");
+			return false;
+		}
+
+		return true;
+	}
+
+	void destroy_ibl_textures(RenderDevice* device, IblTextures& textures)
+	{
+		if (textures.environment)
+			device->destroy(textures.environment);
+
+		if (textures.irradiance)
+			device->destroy(textures.irradiance);
+
+		if (textures.prefiltered)
+			device->destroy(textures.prefiltered);
+
+		if (textures.irradiance_sh)
+			device->destroy(textures.irradiance_sh);
+
+		textures = IblTextures();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "ibl_baker.h"
+
+#define IBL_SH_UNIFORM_BINDING 4 // u_Irradiance in pbr_fs.glsl.
+
+class RenderDevice;
+struct TextureCube;
+struct UniformBuffer;
+
+namespace dw
+{
+	// Device resources of baked IBL data. The textures are handed to the scene in place of the maps the renderer would
+	// generate. Cubemaps are RGB32F with their full mip chain, so the float bake uploads without conversion.
+	// irradiance_sh holds the packed IrradianceSH pbr_fs.glsl evaluates for diffuse.
+	struct IblTextures
+	{
+		TextureCube* environment = nullptr;
+		TextureCube* irradiance = nullptr;
+		TextureCube* prefiltered = nullptr;
+		UniformBuffer* irradiance_sh = nullptr;
+	};
+
+	bool create_ibl_textures(RenderDevice* device, const IblData& data, IblTextures& textures);
+	// Only irradiance_sh, holding zeros, so u_Irradiance is bound when the environment was not baked. Diffuse IBL is
+	// black until the scene is baked.
+	bool create_fallback_irradiance_sh(RenderDevice* device, IblTextures& textures);
+	void destroy_ibl_textures(RenderDevice* device, IblTextures& textures);
+}
\ No newline at end of file
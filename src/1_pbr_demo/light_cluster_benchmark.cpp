@@ -0,0 +1,105 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include <gtc/matrix_transform.hpp>
+
+#include "light_clusters.h"
+#include <common/thread_pool.h>
+
+#define NUM_ITERATIONS 50
+#define VIEWPORT_WIDTH 1920
+#define VIEWPORT_HEIGHT 1080
+#define NEAR_PLANE 0.1f
+#define FAR_PLANE 500.0f
+#define SCENE_EXTENT 400.0f
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// Bins random point lights with the brute force reference, the hierarchical SIMD kernels and the thread pool, and
+// checks that all three produce the same lists.
+int main()
+{
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> position(-0.5f * SCENE_EXTENT, 0.5f * SCENE_EXTENT);
+	std::uniform_real_distribution<float> height(0.0f, 20.0f);
+	std::uniform_real_distribution<float> radius(2.0f, 15.0f);
+
+	glm::vec3 eye = glm::vec3(0.0f, 10.0f, 0.0f);
+	glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(1.0f, -0.1f, 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 proj = glm::perspective(glm::radians(60.0f), float(VIEWPORT_WIDTH) / float(VIEWPORT_HEIGHT), NEAR_PLANE, FAR_PLANE);
+
+	dw::ThreadPool pool;
+	// Far more lights than the shader takes, to stress the binning.
+	dw::LightClusters reference(CLUSTER_INDEX_LIMIT);
+	dw::LightClusters clusters(CLUSTER_INDEX_LIMIT);
+
+	reference.update_grid(proj, NEAR_PLANE, FAR_PLANE, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+	clusters.update_grid(proj, NEAR_PLANE, FAR_PLANE, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+
+	std::cout << "SIMD kernel     : " << (DW_SIMD ? "SSE2" : "scalar fallback") << std::endl;
+	std::cout << "Clusters        : " << CLUSTER_GRID_X << " x " << CLUSTER_GRID_Y << " x " << CLUSTER_GRID_Z << std::endl;
+	std::cout << "Threads         : " << pool.worker_count() + 1 << std::endl;
+
+	int failures = 0;
+
+	for (uint32_t light_count = 256; light_count <= 16384; light_count *= 4)
+	{
+		std::vector<glm::vec4> lights(light_count);
+
+		for (auto& light : lights)
+			light = glm::vec4(position(rng), height(rng), position(rng), radius(rng));
+
+		// The reference is slow, so it only runs once.
+		auto start = std::chrono::high_resolution_clock::now();
+		reference.assign_reference(view, &lights[0], light_count);
+		double reference_ms = elapsed_ms(start);
+
+		start = std::chrono::high_resolution_clock::now();
+
+		for (int it = 0; it < NUM_ITERATIONS; it++)
+			clusters.assign(view, &lights[0], light_count);
+
+		double single_ms = elapsed_ms(start) / NUM_ITERATIONS;
+		bool single_match = clusters.grid() == reference.grid() && clusters.light_indices() == reference.light_indices();
+
+		start = std::chrono::high_resolution_clock::now();
+
+		for (int it = 0; it < NUM_ITERATIONS; it++)
+			clusters.assign(view, &lights[0], light_count, 1, &pool);
+
+		double pool_ms = elapsed_ms(start) / NUM_ITERATIONS;
+		bool pool_match = clusters.grid() == reference.grid() && clusters.light_indices() == reference.light_indices();
+
+		uint32_t max_lights = 0;
+		uint32_t occupied = 0;
+
+		for (int i = 0; i < CLUSTER_COUNT; i++)
+		{
+			uint32_t count = clusters.grid()[2 * i + 1];
+			max_lights = std::max(max_lights, count);
+			occupied += count > 0 ? 1 : 0;
+		}
+
+		size_t indices = clusters.light_indices().size();
+
+		std::cout << std::endl;
+		std::cout << "Lights          : " << light_count << std::endl;
+		std::cout << "Reference       : " << reference_ms << " ms" << std::endl;
+		std::cout << "Hierarchical    : " << single_ms << " ms (" << reference_ms / single_ms << "x)" << std::endl;
+		std::cout << "Thread pool     : " << pool_ms << " ms (" << reference_ms / pool_ms << "x)" << std::endl;
+		std::cout << "Indices         : " << indices << " (" << (indices * sizeof(uint16_t) + clusters.grid().size() * sizeof(uint32_t)) / 1024 << " KB with grid)" << std::endl;
+		std::cout << "Lights/cluster  : " << double(indices) / std::max(occupied, 1u) << " average over " << occupied << " occupied, " << max_lights << " max" << std::endl;
+		std::cout << "Matches         : " << (single_match && pool_match ? "yes" : "NO") << std::endl;
+
+		if (!single_match || !pool_match)
+			failures++;
+	}
+
+	return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "light_cluster_buffers.h"
+#include <logger.h>
+#include <string.h>
+#include <algorithm>
+
+namespace dw
+{
+	LightClusterBuffers::LightClusterBuffers() : m_grid_texture(0), m_index_texture(0), m_uniform_offset(UNIFORM_RING_INVALID_OFFSET)
+	{
+
+	}
+
+	LightClusterBuffers::~LightClusterBuffers()
+	{
+		shutdown();
+	}
+
+	bool LightClusterBuffers::initialize()
+	{
+		shutdown();
+
+		if (!m_ring.initialize(LIGHT_CLUSTER_RING_SIZE))
+		{
+			LOG_ERROR("Failed to create light cluster ring");
+			return false;
+		}
+
+		glGenTextures(1, &m_grid_texture);
+		glGenTextures(1, &m_index_texture);
+
+		if (!m_grid_texture || !m_index_texture)
+		{
+			LOG_ERROR("Failed to create light cluster textures");
+			shutdown();
+			return false;
+		}
+
+		return true;
+	}
+
+	void LightClusterBuffers::shutdown()
+	{
+		GLuint textures[] = { m_grid_texture, m_index_texture };
+
+		for (GLuint texture : textures)
+		{
+			if (texture)
+				glDeleteTextures(1, &texture);
+		}
+
+		m_ring.shutdown();
+
+		m_grid_texture = 0;
+		m_index_texture = 0;
+		m_uniform_offset = UNIFORM_RING_INVALID_OFFSET;
+	}
+
+	bool LightClusterBuffers::upload(const LightClusters& clusters)
+	{
+		ClusterUniforms uniforms = clusters.uniforms();
+		const std::vector<uint32_t>& grid = clusters.grid();
+		const std::vector<uint16_t>& indices = clusters.light_indices();
+
+		// Texture buffers can not be empty, an empty list uploads a single unused index.
+		size_t grid_size = grid.size() * sizeof(uint32_t);
+		size_t index_size = std::max(indices.size(), size_t(1)) * sizeof(uint16_t);
+
+		uint8_t* uniform_ptr;
+		uint8_t* grid_ptr;
+		uint8_t* index_ptr;
+
+		m_uniform_offset = m_ring.allocate(sizeof(ClusterUniforms), (void**)&uniform_ptr);
+		size_t grid_offset = m_ring.allocate(grid_size, (void**)&grid_ptr);
+		size_t index_offset = m_ring.allocate(index_size, (void**)&index_ptr);
+
+		if (m_uniform_offset == UNIFORM_RING_INVALID_OFFSET || grid_offset == UNIFORM_RING_INVALID_OFFSET || index_offset == UNIFORM_RING_INVALID_OFFSET)
+		{
+			LOG_ERROR("Light cluster lists do not fit the ring");
+			m_uniform_offset = UNIFORM_RING_INVALID_OFFSET;
+			return false;
+		}
+
+		memcpy(uniform_ptr, &uniforms, sizeof(ClusterUniforms));
+		memcpy(grid_ptr, &grid[0], grid_size);
+
+		if (indices.empty())
+			memset(index_ptr, 0, index_size);
+		else
+			memcpy(index_ptr, &indices[0], index_size);
+
+		glBindTexture(GL_TEXTURE_BUFFER, m_grid_texture);
+		glTexBufferRange(GL_TEXTURE_BUFFER, GL_RG32UI, m_ring.buffer(), grid_offset, grid_size);
+
+		glBindTexture(GL_TEXTURE_BUFFER, m_index_texture);
+		glTexBufferRange(GL_TEXTURE_BUFFER, GL_R16UI, m_ring.buffer(), index_offset, index_size);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		return true;
+	}
+
+	void LightClusterBuffers::bind(GLuint uniform_binding, GLuint grid_unit, GLuint index_unit)
+	{
+		if (m_uniform_offset == UNIFORM_RING_INVALID_OFFSET)
+			return;
+
+		m_ring.bind_uniform(uniform_binding, m_uniform_offset, sizeof(ClusterUniforms));
+
+		glActiveTexture(GL_TEXTURE0 + grid_unit);
+		glBindTexture(GL_TEXTURE_BUFFER, m_grid_texture);
+
+		glActiveTexture(GL_TEXTURE0 + index_unit);
+		glBindTexture(GL_TEXTURE_BUFFER, m_index_texture);
+	}
+}
\ No newline at end of file
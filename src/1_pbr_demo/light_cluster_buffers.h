@@ -0,0 +1,37 @@
+#pragma once
+
+#include <common/uniform_ring_buffer.h>
+#include "light_clusters.h"
+
+// A frame with every cluster full takes about 84 KB, so this keeps several frames in flight.
+#define LIGHT_CLUSTER_RING_SIZE (1024 * 1024)
+// Same as pbr_fs.glsl.
+#define CLUSTER_UNIFORM_BINDING 3
+#define CLUSTER_GRID_SLOT 3
+#define CLUSTER_INDEX_SLOT 4
+
+namespace dw
+{
+	// GPU side of LightClusters: u_Clusters, s_ClusterGrid (RG32UI offset and count per cluster) and s_LightIndices
+	// (R16UI) in pbr_fs.glsl. All three are written into a fenced ring, the texture buffers view the current frame's
+	// range of it.
+	class LightClusterBuffers
+	{
+	public:
+		LightClusterBuffers();
+		~LightClusterBuffers();
+		bool initialize();
+		void shutdown();
+		// Called once per frame after LightClusters::assign().
+		bool upload(const LightClusters& clusters);
+		void bind(GLuint uniform_binding, GLuint grid_unit, GLuint index_unit);
+		// Call once the draws reading the uploaded lists have been submitted.
+		inline void end_frame() { m_ring.end_frame(); }
+
+	private:
+		UniformRingBuffer m_ring;
+		GLuint m_grid_texture;
+		GLuint m_index_texture;
+		size_t m_uniform_offset;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,323 @@
+#include "light_clusters.h"
+#include <common/thread_pool.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#if DW_SIMD
+#include <emmintrin.h>
+#endif
+
+namespace dw
+{
+	void ClusterBounds::resize(size_t count)
+	{
+		min_x.resize(count);
+		min_y.resize(count);
+		min_z.resize(count);
+		max_x.resize(count);
+		max_y.resize(count);
+		max_z.resize(count);
+	}
+
+	void ClusterBounds::set(size_t i, const glm::vec3& min, const glm::vec3& max)
+	{
+		min_x[i] = min.x;
+		min_y[i] = min.y;
+		min_z[i] = min.z;
+		max_x[i] = max.x;
+		max_y[i] = max.y;
+		max_z[i] = max.z;
+	}
+
+	void ClusterLightList::reserve(size_t capacity)
+	{
+		capacity = (capacity + 3) & ~size_t(3);
+
+		x.resize(capacity);
+		y.resize(capacity);
+		z.resize(capacity);
+		radius2.resize(capacity);
+		index.resize(capacity);
+	}
+
+	void ClusterLightList::clear()
+	{
+		count = 0;
+	}
+
+	void ClusterLightList::push(float _x, float _y, float _z, float _radius2, uint16_t _index)
+	{
+		x[count] = _x;
+		y[count] = _y;
+		z[count] = _z;
+		radius2[count] = _radius2;
+		index[count] = _index;
+		count++;
+	}
+
+	void ClusterLightList::pad()
+	{
+		// The distance to a box is never negative.
+		for (uint32_t i = count; i < ((count + 3) & ~3u); i++)
+		{
+			x[i] = 0.0f;
+			y[i] = 0.0f;
+			z[i] = 0.0f;
+			radius2[i] = -1.0f;
+			index[i] = 0;
+		}
+	}
+
+	static inline bool sphere_box(float x, float y, float z, float radius2, const ClusterBounds& b, size_t i)
+	{
+		float dx = glm::max(glm::max(b.min_x[i] - x, x - b.max_x[i]), 0.0f);
+		float dy = glm::max(glm::max(b.min_y[i] - y, y - b.max_y[i]), 0.0f);
+		float dz = glm::max(glm::max(b.min_z[i] - z, z - b.max_z[i]), 0.0f);
+
+		return dx * dx + dy * dy + dz * dz <= radius2;
+	}
+
+	// Bit j is set if light first + j of the list touches box i. Same math as sphere_box.
+	static inline uint32_t sphere_box_x4(const ClusterLightList& lights, uint32_t first, const ClusterBounds& b, size_t i)
+	{
+#if DW_SIMD
+		__m128 x = _mm_loadu_ps(&lights.x[first]);
+		__m128 y = _mm_loadu_ps(&lights.y[first]);
+		__m128 z = _mm_loadu_ps(&lights.z[first]);
+		__m128 zero = _mm_setzero_ps();
+
+		__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(b.min_x[i]), x), _mm_sub_ps(x, _mm_set1_ps(b.max_x[i]))), zero);
+		__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(b.min_y[i]), y), _mm_sub_ps(y, _mm_set1_ps(b.max_y[i]))), zero);
+		__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(b.min_z[i]), z), _mm_sub_ps(z, _mm_set1_ps(b.max_z[i]))), zero);
+		__m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		return uint32_t(_mm_movemask_ps(_mm_cmple_ps(dist2, _mm_loadu_ps(&lights.radius2[first]))));
+#else
+		uint32_t mask = 0;
+
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			if (sphere_box(lights.x[first + j], lights.y[first + j], lights.z[first + j], lights.radius2[first + j], b, i))
+				mask |= 1 << j;
+		}
+
+		return mask;
+#endif
+	}
+
+	// Appends the lights of src that touch box i to dst.
+	static void filter_lights(const ClusterLightList& src, const ClusterBounds& b, size_t i, ClusterLightList& dst)
+	{
+		dst.clear();
+
+		for (uint32_t first = 0; first < src.count; first += 4)
+		{
+			uint32_t mask = sphere_box_x4(src, first, b, i);
+
+			for (uint32_t j = first; mask; j++, mask >>= 1)
+			{
+				if (mask & 1)
+					dst.push(src.x[j], src.y[j], src.z[j], src.radius2[j], src.index[j]);
+			}
+		}
+
+		dst.pad();
+	}
+
+	LightClusters::LightClusters(uint32_t max_lights) : m_max_lights(std::min(max_lights, uint32_t(CLUSTER_INDEX_LIMIT))), m_view(1.0f), m_near(0.1f), m_far(1000.0f), m_width(1), m_height(1)
+	{
+		m_grid.resize(2 * CLUSTER_COUNT, 0);
+	}
+
+	void LightClusters::update_grid(const glm::mat4& projection, float near_plane, float far_plane, int width, int height)
+	{
+		m_near = near_plane;
+		m_far = far_plane;
+		m_width = width;
+		m_height = height;
+
+		// Tile corner rays, scaled to unit depth.
+		glm::mat4 inv_projection = glm::inverse(projection);
+		glm::vec3 rays[(CLUSTER_GRID_X + 1) * (CLUSTER_GRID_Y + 1)];
+
+		for (int y = 0; y <= CLUSTER_GRID_Y; y++)
+		{
+			for (int x = 0; x <= CLUSTER_GRID_X; x++)
+			{
+				glm::vec4 p = inv_projection * glm::vec4(-1.0f + 2.0f * x / CLUSTER_GRID_X, -1.0f + 2.0f * y / CLUSTER_GRID_Y, -1.0f, 1.0f);
+				glm::vec3 v = glm::vec3(p.x, p.y, p.z) / p.w;
+
+				rays[y * (CLUSTER_GRID_X + 1) + x] = v / -v.z;
+			}
+		}
+
+		m_cluster_bounds.resize(CLUSTER_COUNT);
+		m_row_bounds.resize(CLUSTER_GRID_Y * CLUSTER_GRID_Z);
+		m_slice_bounds.resize(CLUSTER_GRID_Z);
+
+		for (int z = 0; z < CLUSTER_GRID_Z; z++)
+		{
+			float near_depth = m_near * powf(m_far / m_near, float(z) / CLUSTER_GRID_Z);
+			float far_depth = m_near * powf(m_far / m_near, float(z + 1) / CLUSTER_GRID_Z);
+
+			glm::vec3 slice_min = glm::vec3(FLT_MAX);
+			glm::vec3 slice_max = glm::vec3(-FLT_MAX);
+
+			for (int y = 0; y < CLUSTER_GRID_Y; y++)
+			{
+				glm::vec3 row_min = glm::vec3(FLT_MAX);
+				glm::vec3 row_max = glm::vec3(-FLT_MAX);
+
+				for (int x = 0; x < CLUSTER_GRID_X; x++)
+				{
+					glm::vec3 min = glm::vec3(FLT_MAX);
+					glm::vec3 max = glm::vec3(-FLT_MAX);
+
+					for (int corner = 0; corner < 4; corner++)
+					{
+						const glm::vec3& ray = rays[(y + (corner >> 1)) * (CLUSTER_GRID_X + 1) + x + (corner & 1)];
+
+						min = glm::min(min, glm::min(ray * near_depth, ray * far_depth));
+						max = glm::max(max, glm::max(ray * near_depth, ray * far_depth));
+					}
+
+					m_cluster_bounds.set(x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z), min, max);
+
+					row_min = glm::min(row_min, min);
+					row_max = glm::max(row_max, max);
+				}
+
+				m_row_bounds.set(y + CLUSTER_GRID_Y * z, row_min, row_max);
+
+				slice_min = glm::min(slice_min, row_min);
+				slice_max = glm::max(slice_max, row_max);
+			}
+
+			m_slice_bounds.set(z, slice_min, slice_max);
+		}
+	}
+
+	void LightClusters::transform_lights(const glm::mat4& view, const glm::vec4* position_radius, uint32_t count, uint32_t stride)
+	{
+		m_view = view;
+		count = std::min(count, m_max_lights);
+
+		m_lights.reserve(count);
+		m_lights.clear();
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const glm::vec4& light = position_radius[i * stride];
+			glm::vec4 p = view * glm::vec4(light.x, light.y, light.z, 1.0f);
+
+			m_lights.push(p.x, p.y, p.z, light.w * light.w, uint16_t(i));
+		}
+
+		m_lights.pad();
+	}
+
+	void LightClusters::assign_slice(int z)
+	{
+		ClusterLightList& slice_lights = m_slice_lights[z];
+		ClusterLightList& row_lights = m_row_lights[z];
+		std::vector<uint16_t>& indices = m_slice_indices[z];
+
+		slice_lights.reserve(m_lights.count);
+		row_lights.reserve(m_lights.count);
+		indices.clear();
+
+		// Slice, then row, then cluster. Each level only tests what passed the coarser one.
+		filter_lights(m_lights, m_slice_bounds, z, slice_lights);
+
+		for (int y = 0; y < CLUSTER_GRID_Y; y++)
+		{
+			uint32_t* grid = &m_grid[2 * CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z)];
+
+			if (slice_lights.count > 0)
+				filter_lights(slice_lights, m_row_bounds, y + CLUSTER_GRID_Y * z, row_lights);
+			else
+				row_lights.clear();
+
+			for (int x = 0; x < CLUSTER_GRID_X; x++)
+			{
+				size_t cluster = x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z);
+				uint32_t offset = uint32_t(indices.size());
+
+				for (uint32_t first = 0; first < row_lights.count; first += 4)
+				{
+					uint32_t mask = sphere_box_x4(row_lights, first, m_cluster_bounds, cluster);
+
+					for (uint32_t j = first; mask; j++, mask >>= 1)
+					{
+						if (mask & 1)
+							indices.push_back(row_lights.index[j]);
+					}
+				}
+
+				// Offsets are relative to the slice until assign() concatenates the slices.
+				grid[2 * x] = offset;
+				grid[2 * x + 1] = uint32_t(indices.size()) - offset;
+			}
+		}
+	}
+
+	void LightClusters::assign(const glm::mat4& view, const glm::vec4* position_radius, uint32_t count, uint32_t stride, ThreadPool* pool)
+	{
+		transform_lights(view, position_radius, count, stride);
+
+		if (pool)
+			pool->parallel_for(CLUSTER_GRID_Z, [this](int z) { assign_slice(z); });
+		else
+		{
+			for (int z = 0; z < CLUSTER_GRID_Z; z++)
+				assign_slice(z);
+		}
+
+		m_light_indices.clear();
+
+		for (int z = 0; z < CLUSTER_GRID_Z; z++)
+		{
+			uint32_t base = uint32_t(m_light_indices.size());
+			uint32_t* grid = &m_grid[2 * CLUSTER_GRID_X * CLUSTER_GRID_Y * z];
+
+			for (int i = 0; i < CLUSTER_GRID_X * CLUSTER_GRID_Y; i++)
+				grid[2 * i] += base;
+
+			m_light_indices.insert(m_light_indices.end(), m_slice_indices[z].begin(), m_slice_indices[z].end());
+		}
+	}
+
+	void LightClusters::assign_reference(const glm::mat4& view, const glm::vec4* position_radius, uint32_t count, uint32_t stride)
+	{
+		transform_lights(view, position_radius, count, stride);
+
+		m_light_indices.clear();
+
+		for (size_t cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+		{
+			uint32_t offset = uint32_t(m_light_indices.size());
+
+			for (uint32_t i = 0; i < m_lights.count; i++)
+			{
+				if (sphere_box(m_lights.x[i], m_lights.y[i], m_lights.z[i], m_lights.radius2[i], m_cluster_bounds, cluster))
+					m_light_indices.push_back(m_lights.index[i]);
+			}
+
+			m_grid[2 * cluster] = offset;
+			m_grid[2 * cluster + 1] = uint32_t(m_light_indices.size()) - offset;
+		}
+	}
+
+	ClusterUniforms LightClusters::uniforms() const
+	{
+		ClusterUniforms uniforms;
+		float log_range = logf(m_far / m_near);
+
+		// slice = log(depth) * scale + bias, 0 at the near plane and CLUSTER_GRID_Z at the far plane.
+		uniforms.view = m_view;
+		uniforms.params = glm::vec4(CLUSTER_GRID_Z / log_range, -CLUSTER_GRID_Z * logf(m_near) / log_range, float(m_width) / CLUSTER_GRID_X, float(m_height) / CLUSTER_GRID_Y);
+
+		return uniforms;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <glm.hpp>
+#include <common/simd.h>
+
+// Same as pbr_fs.glsl.
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+#define CLUSTER_INDEX_LIMIT 65536 // Light indices are 16 bit.
+// Size of u_PerScene::pointLights in pbr_fs.glsl, which the framework uploads. Light indices index it, so the lights
+// have to be clamped to it.
+#define MAX_POINT_LIGHTS 8
+
+namespace dw
+{
+	class ThreadPool;
+
+	// u_Clusters in pbr_fs.glsl, std140.
+	struct ClusterUniforms
+	{
+		glm::mat4 view;
+		glm::vec4 params; // x: slice scale, y: slice bias, z: tile width in pixels, w: tile height in pixels.
+	};
+
+	// View space AABBs in SoA layout.
+	struct ClusterBounds
+	{
+		std::vector<float> min_x, min_y, min_z;
+		std::vector<float> max_x, max_y, max_z;
+
+		void resize(size_t count);
+		void set(size_t i, const glm::vec3& min, const glm::vec3& max);
+	};
+
+	// Lights that passed a level of the hierarchy, SoA and padded like the input.
+	struct ClusterLightList
+	{
+		uint32_t count = 0;
+		std::vector<float> x, y, z, radius2;
+		std::vector<uint16_t> index;
+
+		void reserve(size_t capacity);
+		void clear();
+		void push(float x, float y, float z, float radius2, uint16_t index);
+		// Pads to a multiple of 4 with lights that never pass.
+		void pad();
+	};
+
+	// Bins point lights into a froxel grid: CLUSTER_GRID_X x CLUSTER_GRID_Y screen tiles, each cut into CLUSTER_GRID_Z
+	// slices that grow exponentially with depth. Cluster i = x + CLUSTER_GRID_X * (y + CLUSTER_GRID_Y * z) owns
+	// light_indices()[offset, offset + count) where offset and count are grid()[2 * i] and grid()[2 * i + 1].
+	class LightClusters
+	{
+	public:
+		// Lights past max_lights are dropped, at most CLUSTER_INDEX_LIMIT.
+		LightClusters(uint32_t max_lights = MAX_POINT_LIGHTS);
+		// Recomputes the cluster bounds. Only needed when the projection or the viewport changes.
+		void update_grid(const glm::mat4& projection, float near_plane, float far_plane, int width, int height);
+		// Lights are view independent position and radius, stride is in vec4s so the position_radius member of a light
+		// array can be passed directly. Slices are spread over the pool.
+		void assign(const glm::mat4& view, const glm::vec4* position_radius, uint32_t count, uint32_t stride = 1, ThreadPool* pool = nullptr);
+		// Tests every light against every cluster, single threaded and without SIMD. The reference assign() has to
+		// match exactly.
+		void assign_reference(const glm::mat4& view, const glm::vec4* position_radius, uint32_t count, uint32_t stride = 1);
+		ClusterUniforms uniforms() const;
+		inline const std::vector<uint32_t>& grid() const { return m_grid; }
+		inline const std::vector<uint16_t>& light_indices() const { return m_light_indices; }
+		inline const ClusterBounds& cluster_bounds() const { return m_cluster_bounds; }
+
+	private:
+		void transform_lights(const glm::mat4& view, const glm::vec4* position_radius, uint32_t count, uint32_t stride);
+		void assign_slice(int z);
+
+	private:
+		uint32_t m_max_lights;
+		glm::mat4 m_view;
+		float m_near;
+		float m_far;
+		int m_width;
+		int m_height;
+		ClusterBounds m_cluster_bounds;
+		ClusterBounds m_row_bounds; // Union of the clusters of a row within a slice.
+		ClusterBounds m_slice_bounds;
+		ClusterLightList m_lights; // View space.
+		// Per slice, so slices can be assigned in parallel.
+		ClusterLightList m_slice_lights[CLUSTER_GRID_Z];
+		ClusterLightList m_row_lights[CLUSTER_GRID_Z];
+		std::vector<uint16_t> m_slice_indices[CLUSTER_GRID_Z];
+		std::vector<uint32_t> m_grid;
+		std::vector<uint16_t> m_light_indices;
+	};
+}
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include <macros.h>
 #include <renderer.h>
 #include <memory>
+#include <unordered_map>
 #include <windows.h>
 #include <ImGuizmo.h>
 #include <imgui_helpers.h>
@@ -20,12 +21,20 @@
 #include <json.hpp>
 #include <nfd.h>
 #include "project.h"
+#include "ibl_baker.h"
+#include "ibl_textures.h"
+#include "light_clusters.h"
+#include "light_cluster_buffers.h"
+#include "permutation_programs.h"
+#include <common/thread_pool.h>
 
 #define CAMERA_SPEED 0.01f
 #define CAMERA_SENSITIVITY 0.02f
 #define CAMERA_ROLL 0.0
 #define TEXTURE_TYPE "TextureType"
 #define VIEWPORT_PADDING 5
+// Radiance below which a point light without a radius is considered to have no influence.
+#define POINT_LIGHT_CUTOFF 0.01f
 
 const char* kMeshAssets[] = 
 {
@@ -127,6 +136,12 @@ private:
 	Project*	 m_current_project;
 	EditorState m_editor_state;
 	char* m_string_buffer;
+	dw::ThreadPool* m_thread_pool;
+	dw::IblTextures m_ibl_textures;
+	dw::LightClusters m_light_clusters;
+	dw::LightClusterBuffers m_cluster_buffers;
+	dw::PermutationPrograms m_pbr_programs;
+	std::unordered_map<ID, ShaderProgram*> m_scene_programs; // Programs Scene::load gave each entity.
 
 protected:
 	void print_dir(DirectoryEntry& dir)
@@ -225,6 +240,14 @@ protected:
                             glm::vec3(0.0f, 0.0f, -1.0f));
         
 		m_renderer = new dw::Renderer(&m_device, m_width, m_height);
+		m_thread_pool = new dw::ThreadPool();
+		m_scene = nullptr;
+
+		if (!m_cluster_buffers.initialize())
+			return false;
+
+		if (!m_pbr_programs.initialize(&m_device, "shader/pbr_vs.glsl", "shader/pbr_fs.glsl", "shader"))
+			return false;
 
 		if (argc > 1)
 			open_project(argv[1]);
@@ -234,7 +257,6 @@ protected:
 		m_offscreen_fbo = nullptr;
 		m_color_rt = nullptr;
 		m_depth_rt = nullptr;
-		m_scene = nullptr;
 		m_selected_dir = nullptr;
 
 		m_editor_state.show_asset_browser = true;
@@ -251,7 +273,17 @@ protected:
 		update_camera();
 		render_editor_gui();
 		if (m_scene)
+		{
+			// Diffuse IBL comes from the baked SH, the renderer does not know about u_Irradiance. open_scene always
+			// creates the buffer, with zeros if the environment was not baked.
+			m_device.bind_uniform_buffer(m_ibl_textures.irradiance_sh, ShaderType::FRAGMENT, IBL_SH_UNIFORM_BINDING);
+
+			update_point_lights();
+			update_entity_programs();
+
 			m_renderer->render(m_camera, m_last_dock_size.x, m_last_dock_size.y, m_offscreen_fbo);
+			m_cluster_buffers.end_frame();
+		}
 		m_device.bind_framebuffer(nullptr);
     }
 
@@ -261,7 +293,10 @@ protected:
 		m_device.destroy(m_color_rt);
 		m_device.destroy(m_depth_rt);
 		
-		delete m_scene;
+		close_scene();
+		m_pbr_programs.shutdown();
+		m_cluster_buffers.shutdown();
+		delete m_thread_pool;
 		delete m_renderer;
 		delete m_camera;
     }
@@ -313,12 +348,79 @@ protected:
 		}
 	}
 
+	// Scene::load bakes the IBL maps on the GPU whenever the description names an environment map. If the maps can be
+	// loaded from the CPU baker's cache, scene_path is set to a copy of the description without it.
+	bool load_baked_ibl(const std::string& path, std::string& scene_path)
+	{
+		std::string scene_json;
+
+		if (!Utility::ReadText(path, scene_json))
+			return false;
+
+		nlohmann::json json = nlohmann::json::parse(scene_json, nullptr, false);
+
+		if (json.is_discarded() || !json.is_object() || json.find("environment_map") == json.end() || !json["environment_map"].is_string())
+			return false;
+
+		std::string hdr_file = json["environment_map"];
+		dw::IblData data;
+
+		if (!dw::load_ibl(hdr_file, dw::IblBakeDesc(), data, m_thread_pool))
+			return false;
+
+		if (!dw::create_ibl_textures(&m_device, data, m_ibl_textures))
+			return false;
+
+		json.erase("environment_map");
+		scene_path = path + ".baked_ibl.json";
+
+		std::ofstream file(scene_path);
+
+		if (!file)
+		{
+			dw::destroy_ibl_textures(&m_device, m_ibl_textures);
+			return false;
+		}
+
+		file << json.dump(4);
+
+		return true;
+	}
+
 	bool open_scene(std::string path)
 	{
-		m_scene = dw::Scene::load(path, &m_device, m_renderer);
+		close_scene();
+
+		std::string scene_path = path;
+
+		if (!load_baked_ibl(path, scene_path))
+		{
+			LOG_ERROR("Scene has no baked IBL, diffuse IBL will be black");
+
+			if (!dw::create_fallback_irradiance_sh(&m_device, m_ibl_textures))
+				return false;
+		}
+
+		m_scene = dw::Scene::load(scene_path, &m_device, m_renderer);
 
 		if (!m_scene)
+		{
+			dw::destroy_ibl_textures(&m_device, m_ibl_textures);
 			return false;
+		}
+
+		// The BRDF LUT does not depend on the environment, the renderer keeps generating its own.
+		if (m_ibl_textures.environment)
+		{
+			m_scene->set_env_map(m_ibl_textures.environment);
+			m_scene->set_irradiance_map(m_ibl_textures.irradiance);
+			m_scene->set_prefiltered_map(m_ibl_textures.prefiltered);
+		}
+
+		dw::Entity* entities = m_scene->entities();
+
+		for (int i = 0; i < m_scene->entity_count(); i++)
+			m_scene_programs[entities[i].id] = entities[i].m_program;
 
 		m_renderer->set_scene(m_scene);
 		return true;
@@ -328,10 +430,81 @@ protected:
 	{
 		if (m_scene)
 		{
+			// The baked maps belong to the demo.
+			if (m_ibl_textures.environment)
+			{
+				m_scene->set_env_map(nullptr);
+				m_scene->set_irradiance_map(nullptr);
+				m_scene->set_prefiltered_map(nullptr);
+			}
+
+			// So are the permutation programs.
+			dw::Entity* entities = m_scene->entities();
+
+			for (int i = 0; i < m_scene->entity_count(); i++)
+			{
+				auto it = m_scene_programs.find(entities[i].id);
+
+				if (it != m_scene_programs.end())
+					entities[i].m_program = it->second;
+			}
+
 			delete m_scene;
 			m_scene = nullptr;
 			m_renderer->set_scene(nullptr);
 		}
+
+		dw::destroy_ibl_textures(&m_device, m_ibl_textures);
+		m_scene_programs.clear();
+	}
+
+	// Entities with an override material draw with the pbr permutation that samples the maps the material has, so
+	// maps dropped on in the material editor show up on the next frame. The rest keep the program Scene::load gave
+	// them, as do entities added in the editor, which have none.
+	void update_entity_programs()
+	{
+		dw::Entity* entities = m_scene->entities();
+
+		for (int i = 0; i < m_scene->entity_count(); i++)
+		{
+			dw::Entity& entity = entities[i];
+			auto it = m_scene_programs.find(entity.id);
+
+			if (it == m_scene_programs.end() || !it->second)
+				continue;
+
+			ShaderProgram* program = nullptr;
+
+			if (entity.m_override_mat)
+				program = m_pbr_programs.program(dw::material_features(entity.m_override_mat));
+
+			entity.m_program = program ? program : it->second;
+		}
+	}
+
+	// pbr_fs reads the light list of each cluster, which only holds the lights within position.w of it. Lights without
+	// a radius get the distance at which their brightest channel falls to POINT_LIGHT_CUTOFF.
+	void update_point_lights()
+	{
+		auto per_scene = m_renderer->per_scene_uniform();
+
+		static_assert(sizeof(per_scene->pointLights) / sizeof(per_scene->pointLights[0]) == MAX_POINT_LIGHTS, "MAX_POINT_LIGHTS does not match u_PerScene");
+
+		uint32_t count = std::min(uint32_t(std::max(per_scene->pointLightCount, 0)), uint32_t(MAX_POINT_LIGHTS));
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			glm::vec4& position = per_scene->pointLights[i].position;
+			const glm::vec4& color = per_scene->pointLights[i].color;
+
+			if (position.w <= 0.0f)
+				position.w = sqrtf(std::max(std::max(color.x, color.y), std::max(color.z, 0.0f)) / POINT_LIGHT_CUTOFF);
+		}
+
+		m_light_clusters.assign(m_camera->m_view, &per_scene->pointLights[0].position, count, sizeof(per_scene->pointLights[0]) / sizeof(glm::vec4), m_thread_pool);
+
+		if (m_cluster_buffers.upload(m_light_clusters))
+			m_cluster_buffers.bind(CLUSTER_UNIFORM_BINDING, CLUSTER_GRID_SLOT, CLUSTER_INDEX_SLOT);
 	}
 
 	void rebuild_framebuffer()
@@ -344,6 +517,7 @@ protected:
 			m_device.destroy(m_depth_rt);
 
 		m_camera->update_projection(45.0f, 0.1f, 1000.0f, m_last_dock_size.x / m_last_dock_size.y);
+		m_light_clusters.update_grid(m_camera->m_projection, m_camera->m_near, m_camera->m_far, m_last_dock_size.x, m_last_dock_size.y);
 
 		Texture2DCreateDesc rtDesc;
 		DW_ZERO_MEMORY(rtDesc);
@@ -0,0 +1,121 @@
+#include "permutation_programs.h"
+#include <render_device.h>
+#include <material.h>
+#include <utility.h>
+#include <logger.h>
+
+namespace dw
+{
+	// "shader/pbr_fs.glsl" -> "pbr_fs"
+	static std::string shader_name(const std::string& file)
+	{
+		size_t begin = file.find_last_of("/\\");
+		begin = begin == std::string::npos ? 0 : begin + 1;
+
+		size_t end = file.find_last_of('.');
+		end = end == std::string::npos || end < begin ? file.size() : end;
+
+		return file.substr(begin, end - begin);
+	}
+
+	uint32_t material_features(Material* material)
+	{
+		uint32_t features = 0;
+
+		if (material->texture_albedo())
+			features |= SHADER_FEATURE_ALBEDO_MAP;
+
+		if (material->texture_normal())
+			features |= SHADER_FEATURE_NORMAL_MAP;
+
+		if (material->texture_metalness())
+			features |= SHADER_FEATURE_METALNESS_MAP;
+
+		if (material->texture_roughness())
+			features |= SHADER_FEATURE_ROUGHNESS_MAP;
+
+		return features;
+	}
+
+	PermutationPrograms::PermutationPrograms() : m_device(nullptr), m_feature_mask(0)
+	{
+
+	}
+
+	PermutationPrograms::~PermutationPrograms()
+	{
+		shutdown();
+	}
+
+	bool PermutationPrograms::initialize(RenderDevice* device, const std::string& vs_file, const std::string& fs_file, const std::string& cache_directory)
+	{
+		shutdown();
+
+		m_device = device;
+
+		if (!Utility::ReadText(vs_file, m_vs_source) || !Utility::ReadText(fs_file, m_fs_source))
+		{
+			LOG_ERROR("Failed to read permutation shaders");
+			return false;
+		}
+
+		m_vs_name = shader_name(vs_file);
+		m_fs_name = shader_name(fs_file);
+		m_feature_mask = shader_feature_mask(m_vs_source) | shader_feature_mask(m_fs_source);
+		m_cache = ShaderPermutationCache(cache_directory);
+
+		return true;
+	}
+
+	void PermutationPrograms::shutdown()
+	{
+		for (auto& it : m_programs)
+		{
+			if (it.second.program)
+				m_device->destroy(it.second.program);
+
+			if (it.second.vs)
+				m_device->destroy(it.second.vs);
+
+			if (it.second.fs)
+				m_device->destroy(it.second.fs);
+		}
+
+		m_programs.clear();
+		m_cache.clear();
+	}
+
+	ShaderProgram* PermutationPrograms::program(uint32_t features)
+	{
+		uint32_t permutation_key = key(features);
+		auto it = m_programs.find(permutation_key);
+
+		if (it != m_programs.end())
+			return it->second.program;
+
+		// Failed permutations are remembered as well, so they are not compiled again every frame.
+		Permutation& permutation = m_programs[permutation_key];
+		permutation.vs = nullptr;
+		permutation.fs = nullptr;
+		permutation.program = nullptr;
+
+		std::string vs_source, fs_source;
+
+		if (!m_cache.source(m_vs_name, m_vs_source, permutation_key, vs_source) || !m_cache.source(m_fs_name, m_fs_source, permutation_key, fs_source))
+			return nullptr;
+
+		permutation.vs = m_device->create_shader(vs_source.c_str(), ShaderType::VERTEX);
+		permutation.fs = m_device->create_shader(fs_source.c_str(), ShaderType::FRAGMENT);
+
+		if (!permutation.vs || !permutation.fs)
+		{
+			LOG_ERROR("Failed to compile shader permutation");
+			return nullptr;
+		}
+
+		Shader* shaders[] = { permutation.vs, permutation.fs };
+		permutation.program = m_device->create_shader_program(shaders, 2);
+
+		return permutation.program;
+	}
+}
\ No newline at end of file
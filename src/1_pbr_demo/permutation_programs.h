@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include "shader_permutations.h"
+
+class RenderDevice;
+struct Shader;
+struct ShaderProgram;
+
+namespace dw
+{
+	class Material;
+
+	// Features the textures of a material need. Disabling scene wide features such as IBL and point lights is up to the
+	// caller.
+	uint32_t material_features(Material* material);
+
+	// Programs of a vertex and fragment shader pair, one per feature set, compiled on first use from the
+	// preprocessed permutation sources.
+	class PermutationPrograms
+	{
+	public:
+		PermutationPrograms();
+		~PermutationPrograms();
+		bool initialize(RenderDevice* device, const std::string& vs_file, const std::string& fs_file, const std::string& cache_directory);
+		void shutdown();
+		// nullptr if the permutation fails to compile.
+		ShaderProgram* program(uint32_t features);
+		// Drops the features neither shader tests, so feature sets that only differ in those share a program.
+		inline uint32_t key(uint32_t features) { return features & m_feature_mask; }
+		inline size_t program_count() { return m_programs.size(); }
+		inline ShaderPermutationCache& cache() { return m_cache; }
+
+	private:
+		struct Permutation
+		{
+			Shader* vs;
+			Shader* fs;
+			ShaderProgram* program;
+		};
+
+		RenderDevice* m_device;
+		std::string m_vs_name;
+		std::string m_fs_name;
+		std::string m_vs_source;
+		std::string m_fs_source;
+		uint32_t m_feature_mask;
+		ShaderPermutationCache m_cache;
+		std::unordered_map<uint32_t, Permutation> m_programs;
+	};
+}
\ No newline at end of file
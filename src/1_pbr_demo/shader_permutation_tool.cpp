@@ -0,0 +1,170 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <string.h>
+
+#include "shader_permutations.h"
+
+// Occurrences of a word, e.g. texture fetches in a permutation.
+static int count_calls(const std::string& source, const char* name)
+{
+	int count = 0;
+	std::string call = std::string(name) + "(";
+
+	for (size_t pos = source.find(call); pos != std::string::npos; pos = source.find(call, pos + 1))
+	{
+		char prev = pos > 0 ? source[pos - 1] : ' ';
+
+		if (!isalnum(prev) && prev != '_')
+			count++;
+	}
+
+	return count;
+}
+
+static int count_code_lines(const std::string& source)
+{
+	std::istringstream stream(source);
+	std::string line;
+	int count = 0;
+
+	while (std::getline(stream, line))
+	{
+		if (line.find_first_not_of(" \t\r") != std::string::npos)
+			count++;
+	}
+
+	return count;
+}
+
+// Preprocesses every permutation of the given shaders and reports what each one strips. Needs no GL context.
+// Usage: 1_pbr_shader_permutations [--cache <directory>] <shader.glsl>...
+// With --cache the permutations are also written to and read back from the directory.
+int main(int argc, const char* argv[])
+{
+	std::string cache_directory;
+	std::vector<std::string> files;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+			cache_directory = argv[++i];
+		else
+			files.push_back(argv[i]);
+	}
+
+	if (files.empty())
+	{
+		std::cout << "Usage: 1_pbr_shader_permutations [--cache <directory>] <shader.glsl>..." << std::endl;
+		return 1;
+	}
+
+	int failures = 0;
+
+	for (const std::string& file : files)
+	{
+		std::ifstream stream(file);
+
+		if (!stream)
+		{
+			std::cout << "Failed to open " << file << std::endl;
+			return 1;
+		}
+
+		std::stringstream buffer;
+		buffer << stream.rdbuf();
+		std::string source = buffer.str();
+
+		uint32_t mask = dw::shader_feature_mask(source);
+
+		std::cout << file << " : " << count_code_lines(source) << " lines, features";
+
+		for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+		{
+			if (mask & (1 << i))
+				std::cout << " " << dw::shader_feature_define(i);
+		}
+
+		std::cout << std::endl;
+
+		// Every subset of the features the shader tests.
+		for (uint32_t features = 0; features <= mask; features++)
+		{
+			if (features & ~mask)
+				continue;
+
+			std::string out;
+
+			if (!dw::preprocess_permutation(source, features, out))
+			{
+				std::cout << "  " << features << " : failed" << std::endl;
+				failures++;
+				continue;
+			}
+
+			// Only the inserted defines may mention a feature.
+			std::string without_defines = out;
+
+			for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+			{
+				std::string define = std::string("#define ") + dw::shader_feature_define(i) + "\n";
+				size_t pos = without_defines.find(define);
+
+				if (pos != std::string::npos)
+					without_defines.erase(pos, define.size());
+			}
+
+			bool stripped = dw::shader_feature_mask(without_defines) == 0;
+
+			if (!stripped)
+				failures++;
+
+			std::cout << "  0x" << std::hex << features << std::dec << " : " << count_code_lines(out) << " lines, "
+				<< count_calls(out, "texture") + count_calls(out, "textureLod") + count_calls(out, "texelFetch") << " fetches"
+				<< (stripped ? "" : ", feature conditionals left") << std::endl;
+		}
+
+		if (!cache_directory.empty())
+		{
+			// "shader/pbr_fs.glsl" -> "pbr_fs"
+			size_t begin = file.find_last_of("/\\");
+			begin = begin == std::string::npos ? 0 : begin + 1;
+			std::string name = file.substr(begin, file.find_last_of('.') - begin);
+			dw::ShaderPermutationCache cache(cache_directory);
+
+			// First pass fills memory and disk, the second hits memory, and a fresh cache has to read back from disk
+			// what preprocessing produces.
+			for (int pass = 0; pass < 2; pass++)
+			{
+				for (uint32_t features = 0; features <= mask; features++)
+				{
+					std::string out;
+
+					if (!(features & ~mask))
+						cache.source(name, source, features, out);
+				}
+			}
+
+			dw::ShaderPermutationCache disk_cache(cache_directory);
+
+			for (uint32_t features = 0; features <= mask; features++)
+			{
+				std::string cached, expected;
+
+				if (features & ~mask)
+					continue;
+
+				if (!disk_cache.source(name, source, features, cached) || !dw::preprocess_permutation(source, features, expected) || cached != expected)
+					failures++;
+			}
+
+			std::cout << "  cache : " << cache.misses() << " misses, " << cache.memory_hits() << " memory hits, " << disk_cache.disk_hits() << " disk hits" << std::endl;
+		}
+	}
+
+	std::cout << (failures == 0 ? "All permutations valid" : "Invalid permutations found") << std::endl;
+
+	return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
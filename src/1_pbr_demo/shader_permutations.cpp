@@ -0,0 +1,353 @@
+#include "shader_permutations.h"
+#include <common/hash.h>
+#include <logger.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace dw
+{
+	static const char* kFeatureDefines[SHADER_FEATURE_COUNT] =
+	{
+		"HAS_ALBEDO_MAP",
+		"HAS_NORMAL_MAP",
+		"HAS_METALNESS_MAP",
+		"HAS_ROUGHNESS_MAP",
+		"NO_IBL",
+		"NO_POINT_LIGHTS"
+	};
+
+	struct Conditional
+	{
+		bool resolved; // Tests a feature, otherwise it is left to the GLSL compiler.
+		bool active;
+		bool taken; // A branch of a resolved conditional was already active.
+	};
+
+	static inline bool is_identifier(char c)
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	}
+
+	static std::string trim(const std::string& str)
+	{
+		size_t first = str.find_first_not_of(" \t\r\n");
+
+		if (first == std::string::npos)
+			return "";
+
+		return str.substr(first, str.find_last_not_of(" \t\r\n") - first + 1);
+	}
+
+	static int find_feature(const std::string& name)
+	{
+		for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+		{
+			if (name == kFeatureDefines[i])
+				return i;
+		}
+
+		return -1;
+	}
+
+	// Feature tested by "X", "defined(X)", "defined X" or their negation with "!", -1 for anything else.
+	static int parse_condition(std::string expr, bool& negate)
+	{
+		negate = false;
+
+		if (!expr.empty() && expr[0] == '!')
+		{
+			negate = true;
+			expr = trim(expr.substr(1));
+		}
+
+		if (expr.compare(0, 7, "defined") == 0)
+		{
+			expr = trim(expr.substr(7));
+
+			if (!expr.empty() && expr[0] == '(' && expr[expr.size() - 1] == ')')
+				expr = trim(expr.substr(1, expr.size() - 2));
+		}
+		else if (negate)
+			return -1; // !X tests the value, not whether it is defined.
+
+		return find_feature(expr);
+	}
+
+	// Splits "#  name rest // comment" into name and rest. False if the line is no directive.
+	static bool parse_directive(const std::string& line, std::string& name, std::string& rest)
+	{
+		std::string str = trim(line);
+
+		if (str.empty() || str[0] != '#')
+			return false;
+
+		str = trim(str.substr(1));
+
+		size_t end = 0;
+
+		while (end < str.size() && is_identifier(str[end]))
+			end++;
+
+		name = str.substr(0, end);
+		rest = str.substr(end);
+
+		size_t comment = rest.find("//");
+
+		if (comment != std::string::npos)
+			rest = rest.substr(0, comment);
+
+		rest = trim(rest);
+
+		return true;
+	}
+
+	const char* shader_feature_define(int i)
+	{
+		return kFeatureDefines[i];
+	}
+
+	uint32_t shader_feature_mask(const std::string& source)
+	{
+		uint32_t mask = 0;
+
+		for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+		{
+			std::string name = kFeatureDefines[i];
+			size_t pos = source.find(name);
+
+			while (pos != std::string::npos)
+			{
+				size_t end = pos + name.size();
+
+				if ((pos == 0 || !is_identifier(source[pos - 1])) && (end == source.size() || !is_identifier(source[end])))
+				{
+					mask |= 1 << i;
+					break;
+				}
+
+				pos = source.find(name, end);
+			}
+		}
+
+		return mask;
+	}
+
+	bool preprocess_permutation(const std::string& source, uint32_t features, std::string& out)
+	{
+		std::vector<Conditional> stack;
+		std::string body;
+		size_t defines_pos = 0;
+		size_t begin = 0;
+
+		body.reserve(source.size());
+
+		while (begin < source.size())
+		{
+			size_t end = source.find('\n', begin);
+			end = end == std::string::npos ? source.size() : end + 1;
+
+			std::string line = source.substr(begin, end - begin);
+			std::string name, rest;
+			bool emitting = true;
+
+			begin = end;
+
+			for (const Conditional& c : stack)
+				emitting = emitting && c.active;
+
+			bool keep = emitting;
+
+			if (parse_directive(line, name, rest))
+			{
+				bool negate;
+
+				if (name == "ifdef" || name == "ifndef" || name == "if")
+				{
+					int feature = name == "if" ? parse_condition(rest, negate) : find_feature(rest);
+					Conditional c = { feature >= 0, true, false };
+
+					if (c.resolved)
+					{
+						bool defined = ((features >> feature) & 1) != 0;
+						bool negated = name == "ifndef" || (name == "if" && negate);
+
+						c.active = defined != negated;
+						c.taken = c.active;
+						keep = false;
+					}
+
+					stack.push_back(c);
+				}
+				else if (name == "elif" || name == "else" || name == "endif")
+				{
+					if (stack.empty())
+					{
+						LOG_ERROR("Unbalanced conditional in shader");
+						return false;
+					}
+
+					Conditional& c = stack.back();
+
+					if (c.resolved)
+					{
+						keep = false;
+
+						if (name == "elif")
+						{
+							int feature = parse_condition(rest, negate);
+
+							if (feature < 0)
+							{
+								LOG_ERROR("Unsupported #elif after a shader feature conditional");
+								return false;
+							}
+
+							bool active = (((features >> feature) & 1) != 0) != negate;
+
+							c.active = !c.taken && active;
+							c.taken = c.taken || active;
+						}
+						else if (name == "else")
+						{
+							c.active = !c.taken;
+							c.taken = true;
+						}
+					}
+
+					if (name == "endif")
+						stack.pop_back();
+				}
+				else if (name == "version" && emitting)
+					defines_pos = body.size() + line.size();
+			}
+
+			if (keep)
+				body += line;
+			else
+				body += line[line.size() - 1] == '\n' ? "\n" : "";
+		}
+
+		if (!stack.empty())
+		{
+			LOG_ERROR("Unterminated conditional in shader");
+			return false;
+		}
+
+		std::string defines;
+
+		for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+		{
+			if (features & (1 << i))
+				defines += std::string("#define ") + kFeatureDefines[i] + "\n";
+		}
+
+		// A #version on the last line has no newline to insert after.
+		if (defines_pos > 0 && body[defines_pos - 1] != '\n')
+			defines = "\n" + defines;
+
+		out = body.substr(0, defines_pos) + defines + body.substr(defines_pos);
+
+		return true;
+	}
+
+	ShaderPermutationCache::ShaderPermutationCache(const std::string& directory) : m_directory(directory), m_memory_hits(0), m_disk_hits(0), m_misses(0)
+	{
+
+	}
+
+	bool ShaderPermutationCache::source(const std::string& name, const std::string& source, uint32_t features, std::string& out)
+	{
+		uint32_t version = SHADER_CACHE_VERSION;
+		uint64_t hash = fnv1a(FNV_OFFSET_BASIS, source.data(), source.size());
+		hash = fnv1a(hash, &features, sizeof(features));
+		hash = fnv1a(hash, &version, sizeof(version));
+
+		char file_name[64];
+		snprintf(file_name, sizeof(file_name), "_%08x.glsl", features);
+
+		std::string key = name + file_name;
+		auto it = m_sources.find(key);
+
+		if (it != m_sources.end() && it->second.hash == hash)
+		{
+			m_memory_hits++;
+			out = it->second.text;
+			return true;
+		}
+
+		char header[64];
+		snprintf(header, sizeof(header), "// shader permutation %016llx\n", (unsigned long long)hash);
+
+		std::string path = m_directory + "/" + key;
+
+		if (!m_directory.empty())
+		{
+			FILE* f = fopen(path.c_str(), "rb");
+
+			if (f)
+			{
+				std::string text;
+				char buffer[4096];
+				size_t read;
+
+				while ((read = fread(buffer, 1, sizeof(buffer), f)) > 0)
+					text.append(buffer, read);
+
+				fclose(f);
+
+				if (text.compare(0, strlen(header), header) == 0)
+				{
+					m_disk_hits++;
+					out = text.substr(strlen(header));
+					m_sources[key] = { hash, out };
+					return true;
+				}
+			}
+		}
+
+		m_misses++;
+
+		if (!preprocess_permutation(source, features, out))
+			return false;
+
+		m_sources[key] = { hash, out };
+
+		if (m_directory.empty())
+			return true;
+
+		// Written to a temporary file first so a crash never leaves a truncated permutation behind. A failed write
+		// only costs the next run a preprocess.
+		std::string temp_path = path + ".tmp";
+		FILE* f = fopen(temp_path.c_str(), "wb");
+
+		if (!f)
+		{
+			LOG_ERROR("Failed to create shader permutation cache file");
+			return true;
+		}
+
+		bool success = fwrite(header, 1, strlen(header), f) == strlen(header);
+		success = success && fwrite(out.data(), 1, out.size(), f) == out.size();
+
+		fclose(f);
+
+		remove(path.c_str());
+
+		if (!success || rename(temp_path.c_str(), path.c_str()) != 0)
+		{
+			remove(temp_path.c_str());
+			LOG_ERROR("Failed to write shader permutation cache file");
+		}
+
+		return true;
+	}
+
+	void ShaderPermutationCache::clear()
+	{
+		m_sources.clear();
+		m_memory_hits = 0;
+		m_disk_hits = 0;
+		m_misses = 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+#define SHADER_FEATURE_COUNT 6
+#define SHADER_CACHE_VERSION 2
+
+namespace dw
+{
+	// Optional parts of pbr_vs.glsl and pbr_fs.glsl. Each one is a #define the shaders test with #ifdef, or #ifndef for
+	// the NO_ features, which are on unless disabled so a shader compiled without any defines keeps them.
+	enum ShaderFeature
+	{
+		SHADER_FEATURE_ALBEDO_MAP = 1 << 0,
+		SHADER_FEATURE_NORMAL_MAP = 1 << 1,
+		SHADER_FEATURE_METALNESS_MAP = 1 << 2,
+		SHADER_FEATURE_ROUGHNESS_MAP = 1 << 3,
+		SHADER_FEATURE_NO_IBL = 1 << 4,
+		SHADER_FEATURE_NO_POINT_LIGHTS = 1 << 5
+	};
+
+	// Define of feature bit i, e.g. "HAS_NORMAL_MAP".
+	const char* shader_feature_define(int i);
+	// Features a source tests. Bits it never tests can be dropped from its key, so permutations that only differ in
+	// those share a program.
+	uint32_t shader_feature_mask(const std::string& source);
+	// Resolves #ifdef, #ifndef, #if [!]defined(X), #elif [!]defined(X), #else and #endif on feature defines, and inserts
+	// the #defines of the enabled features after #version, or at the top without one. Conditionals on anything else
+	// are kept for the GLSL compiler. Stripped lines are left empty, so compiler errors keep their line numbers apart
+	// from the offset of the inserted defines. Fails on unbalanced conditionals.
+	bool preprocess_permutation(const std::string& source, uint32_t features, std::string& out);
+
+	// Preprocessed permutations, kept in memory and in <directory>/<name>_<features>.glsl. Files carry a hash of the
+	// source they were made from and are rewritten once it changes.
+	class ShaderPermutationCache
+	{
+	public:
+		// An empty directory keeps permutations in memory only.
+		ShaderPermutationCache(const std::string& directory = "");
+		bool source(const std::string& name, const std::string& source, uint32_t features, std::string& out);
+		void clear();
+		inline uint32_t memory_hits() { return m_memory_hits; }
+		inline uint32_t disk_hits() { return m_disk_hits; }
+		inline uint32_t misses() { return m_misses; }
+
+	private:
+		struct CachedSource
+		{
+			uint64_t hash;
+			std::string text;
+		};
+
+		std::string m_directory;
+		std::unordered_map<std::string, CachedSource> m_sources; // Keyed by file name.
+		uint32_t m_memory_hits;
+		uint32_t m_disk_hits;
+		uint32_t m_misses;
+	};
+}
\ No newline at end of file
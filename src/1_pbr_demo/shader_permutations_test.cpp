@@ -0,0 +1,130 @@
+#include <iostream>
+#include <string>
+#include <stdio.h>
+
+#include "shader_permutations.h"
+
+#define TEST_CACHE_DIRECTORY "."
+#define TEST_CACHE_NAME "shader_permutations_test"
+#define TEST_CACHE_FILE "./shader_permutations_test_00000001.glsl"
+
+struct PermutationCase
+{
+	const char* name;
+	const char* source;
+	uint32_t features;
+	const char* expected;
+};
+
+// Stripped lines stay as empty lines and the enabled defines go after #version, or on top without one.
+static const PermutationCase kCases[] =
+{
+	{ "#ifdef taken", "#version 450\n#ifdef HAS_ALBEDO_MAP\nA\n#else\nB\n#endif\n", dw::SHADER_FEATURE_ALBEDO_MAP,
+	  "#version 450\n#define HAS_ALBEDO_MAP\n\nA\n\n\n\n" },
+	{ "#ifdef else", "#version 450\n#ifdef HAS_ALBEDO_MAP\nA\n#else\nB\n#endif\n", 0,
+	  "#version 450\n\n\n\nB\n\n" },
+	{ "#ifndef kept", "#ifndef NO_IBL\nI\n#endif\n", 0,
+	  "\nI\n\n" },
+	{ "#ifndef stripped", "#ifndef NO_IBL\nI\n#endif\n", dw::SHADER_FEATURE_NO_IBL,
+	  "#define NO_IBL\n\n\n\n" },
+	{ "#elif taken", "#if defined(HAS_NORMAL_MAP)\nN\n#elif !defined(HAS_ROUGHNESS_MAP)\nR\n#else\nE\n#endif\n", 0,
+	  "\n\n\nR\n\n\n\n" },
+	{ "#elif after #if", "#if defined(HAS_NORMAL_MAP)\nN\n#elif !defined(HAS_ROUGHNESS_MAP)\nR\n#else\nE\n#endif\n", dw::SHADER_FEATURE_NORMAL_MAP,
+	  "#define HAS_NORMAL_MAP\n\nN\n\n\n\n\n\n" },
+	{ "#elif else", "#if defined(HAS_NORMAL_MAP)\nN\n#elif !defined(HAS_ROUGHNESS_MAP)\nR\n#else\nE\n#endif\n", dw::SHADER_FEATURE_ROUGHNESS_MAP,
+	  "#define HAS_ROUGHNESS_MAP\n\n\n\n\n\nE\n\n" },
+	{ "nested off", "#if __VERSION__ > 400\n#ifdef HAS_ALBEDO_MAP\nA\n#endif\n#else\n#ifndef NO_IBL\nB\n#endif\n#endif\n", 0,
+	  "#if __VERSION__ > 400\n\n\n\n#else\n\nB\n\n#endif\n" },
+	{ "nested on", "#if __VERSION__ > 400\n#ifdef HAS_ALBEDO_MAP\nA\n#endif\n#else\n#ifndef NO_IBL\nB\n#endif\n#endif\n", dw::SHADER_FEATURE_ALBEDO_MAP | dw::SHADER_FEATURE_NO_IBL,
+	  "#define HAS_ALBEDO_MAP\n#define NO_IBL\n#if __VERSION__ > 400\n\nA\n\n#else\n\n\n\n#endif\n" },
+	{ "#version last", "#version 450", dw::SHADER_FEATURE_NORMAL_MAP,
+	  "#version 450\n#define HAS_NORMAL_MAP\n" }
+};
+
+static const char* kUnbalanced[] =
+{
+	"#ifdef HAS_ALBEDO_MAP\nA\n",
+	"#if __VERSION__ > 400\n#ifndef NO_IBL\nA\n#endif\n",
+	"A\n#endif\n",
+	"#else\nA\n"
+};
+
+static const char* kSourceA = "#version 450\n#ifdef HAS_ALBEDO_MAP\nA\n#endif\n";
+static const char* kSourceB = "#version 450\n#ifdef HAS_ALBEDO_MAP\nB\n#endif\n";
+
+int main()
+{
+	int failures = 0;
+
+	for (const PermutationCase& c : kCases)
+	{
+		std::string out;
+
+		if (!dw::preprocess_permutation(c.source, c.features, out) || out != c.expected)
+		{
+			std::cout << "Wrong permutation for " << c.name << std::endl;
+			failures++;
+		}
+	}
+
+	for (const char* source : kUnbalanced)
+	{
+		std::string out;
+
+		if (dw::preprocess_permutation(source, dw::SHADER_FEATURE_ALBEDO_MAP, out))
+		{
+			std::cout << "Unbalanced conditionals accepted" << std::endl;
+			failures++;
+		}
+	}
+
+	std::string expected_a, expected_b, out;
+	dw::preprocess_permutation(kSourceA, dw::SHADER_FEATURE_ALBEDO_MAP, expected_a);
+	dw::preprocess_permutation(kSourceB, dw::SHADER_FEATURE_ALBEDO_MAP, expected_b);
+
+	remove(TEST_CACHE_FILE);
+
+	// A repeated source hits memory, a changed one has to miss.
+	dw::ShaderPermutationCache cache(TEST_CACHE_DIRECTORY);
+	cache.source(TEST_CACHE_NAME, kSourceA, dw::SHADER_FEATURE_ALBEDO_MAP, out);
+	cache.source(TEST_CACHE_NAME, kSourceA, dw::SHADER_FEATURE_ALBEDO_MAP, out);
+
+	if (cache.misses() != 1 || cache.memory_hits() != 1 || out != expected_a)
+	{
+		std::cout << "Repeated source not served from memory" << std::endl;
+		failures++;
+	}
+
+	cache.source(TEST_CACHE_NAME, kSourceB, dw::SHADER_FEATURE_ALBEDO_MAP, out);
+
+	if (cache.misses() != 2 || cache.memory_hits() != 1 || out != expected_b)
+	{
+		std::cout << "Changed source served from memory" << std::endl;
+		failures++;
+	}
+
+	// The file now holds the changed source, which a fresh cache reads back and the old source no longer matches.
+	dw::ShaderPermutationCache disk_cache(TEST_CACHE_DIRECTORY);
+	disk_cache.source(TEST_CACHE_NAME, kSourceB, dw::SHADER_FEATURE_ALBEDO_MAP, out);
+
+	if (disk_cache.disk_hits() != 1 || disk_cache.misses() != 0 || out != expected_b)
+	{
+		std::cout << "Changed source not rewritten to disk" << std::endl;
+		failures++;
+	}
+
+	dw::ShaderPermutationCache stale_cache(TEST_CACHE_DIRECTORY);
+	stale_cache.source(TEST_CACHE_NAME, kSourceA, dw::SHADER_FEATURE_ALBEDO_MAP, out);
+
+	if (stale_cache.disk_hits() != 0 || stale_cache.misses() != 1 || out != expected_a)
+	{
+		std::cout << "Stale source served from disk" << std::endl;
+		failures++;
+	}
+
+	remove(TEST_CACHE_FILE);
+
+	std::cout << "Failures : " << failures << std::endl;
+
+	return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
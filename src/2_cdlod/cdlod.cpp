@@ -1,4 +1,5 @@
 #include <iostream>
+#include <fstream>
 
 #include <gtc/matrix_transform.hpp>
 #include <gtc/type_ptr.hpp>
@@ -25,6 +26,7 @@
 #define CAMERA_SENSITIVITY 0.02f
 #define CAMERA_ROLL 0.0
 #define FAR_PLANE 10000.0f
+#define TERRAIN_DESC_FILE "terrain.json"
 
 using namespace math;
 
@@ -57,7 +59,22 @@ public:
 							  glm::vec3(5.0f, 5.0f, 5.0f),
 							  glm::vec3(0.0f, 0.0f, -1.0f));
 
-		m_terrain = new dw::Terrain("heightmap.r16", 1024, 6, 50.0f, FAR_PLANE, &m_device);
+		// Maps without a description use the defaults, a description that fails to load stops the demo.
+		dw::TerrainDesc desc;
+		desc.max_range = FAR_PLANE / 2.0f;
+
+		if (std::ifstream(TERRAIN_DESC_FILE))
+		{
+			if (!dw::TerrainDesc::load(TERRAIN_DESC_FILE, desc))
+				return false;
+		}
+		else if (!desc.validate())
+			return false;
+
+		m_terrain = new dw::Terrain();
+
+		if (!m_terrain->initialize(desc, &m_device))
+			return false;
 
         return m_debug_renderer.init(&m_device);;
     }
@@ -73,6 +90,21 @@ public:
 			m_debug_mode = !m_debug_mode;
 		}
 
+		const dw::TerrainStats& stats = m_terrain->stats();
+
+		ImGui::Text("Patches: %u (%u full, %u half)", stats.patches, stats.full_patches, stats.half_patches);
+		ImGui::Text("Triangles: %u", stats.triangles);
+
+		for (uint32_t i = 0; i < stats.lod_count; i++)
+			ImGui::Text("LOD %u: %u", i, stats.patches_per_lod[i]);
+
+		ImGui::Text("Nodes Visited: %u", stats.nodes_visited);
+		ImGui::Text("Culled: %u sphere, %u frustum", stats.sphere_culled, stats.frustum_culled);
+		ImGui::Text("Selection: %.3f ms, Upload: %.3f ms", stats.selection_ms, stats.upload_ms);
+
+		if (ImGui::Button("Export LOD Heatmap"))
+			m_terrain->write_lod_heatmap("lod_heatmap.png", 1024);
+
 		ImGui::End();
 
 		m_device.bind_framebuffer(nullptr);
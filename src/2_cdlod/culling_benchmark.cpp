@@ -0,0 +1,102 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+
+#include <gtc/matrix_transform.hpp>
+
+#include "terrain_culling.h"
+
+#define NUM_SIBLING_GROUPS 65536
+#define NUM_ITERATIONS 200
+
+// Compares the batched sibling culling kernels against the scalar reference on a synthetic set of terrain nodes.
+int main(int argc, const char* argv[])
+{
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> position(0.0f, 16384.0f);
+	std::uniform_real_distribution<float> height(0.0f, 50.0f);
+
+	int count = NUM_SIBLING_GROUPS * 4;
+	float size = 32.0f;
+
+	std::vector<float> x(count);
+	std::vector<float> z(count);
+	std::vector<float> min_y(count);
+	std::vector<float> max_y(count);
+
+	for (int i = 0; i < NUM_SIBLING_GROUPS; i++)
+	{
+		float group_x = position(rng);
+		float group_z = position(rng);
+
+		for (int j = 0; j < 4; j++)
+		{
+			int idx = i * 4 + j;
+			float h0 = height(rng);
+			float h1 = height(rng);
+
+			x[idx] = group_x + (j & 1) * size;
+			z[idx] = group_z + (j >> 1) * size;
+			min_y[idx] = glm::min(h0, h1);
+			max_y[idx] = glm::max(h0, h1);
+		}
+	}
+
+	glm::vec3 eye = glm::vec3(8192.0f, 100.0f, 8192.0f);
+	glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(1.0f, -0.2f, 0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 10000.0f);
+	dw::CullView cull_view = dw::CullView::from_matrix(proj * view, eye);
+	float radius = 2500.0f;
+
+	uint32_t scalar_visible = 0;
+	uint32_t simd_visible = 0;
+	int mismatches = 0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (int it = 0; it < NUM_ITERATIONS; it++)
+	{
+		for (int i = 0; i < count; i += 4)
+		{
+			uint32_t mask = dw::in_sphere_x4_scalar(&x[i], &z[i], size, &min_y[i], &max_y[i], eye, radius);
+			mask &= dw::in_frustum_x4_scalar(&x[i], &z[i], size, &min_y[i], &max_y[i], cull_view);
+			scalar_visible += mask;
+		}
+	}
+
+	auto mid = std::chrono::high_resolution_clock::now();
+
+	for (int it = 0; it < NUM_ITERATIONS; it++)
+	{
+		for (int i = 0; i < count; i += 4)
+		{
+			uint32_t mask = dw::in_sphere_x4(&x[i], &z[i], size, &min_y[i], &max_y[i], eye, radius);
+			mask &= dw::in_frustum_x4(&x[i], &z[i], size, &min_y[i], &max_y[i], cull_view);
+			simd_visible += mask;
+		}
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < count; i += 4)
+	{
+		if (dw::in_sphere_x4(&x[i], &z[i], size, &min_y[i], &max_y[i], eye, radius) != dw::in_sphere_x4_scalar(&x[i], &z[i], size, &min_y[i], &max_y[i], eye, radius) ||
+			dw::in_frustum_x4(&x[i], &z[i], size, &min_y[i], &max_y[i], cull_view) != dw::in_frustum_x4_scalar(&x[i], &z[i], size, &min_y[i], &max_y[i], cull_view))
+			mismatches++;
+	}
+
+	double scalar_ms = std::chrono::duration<double, std::milli>(mid - start).count();
+	double simd_ms = std::chrono::duration<double, std::milli>(end - mid).count();
+	double tests = double(count) * NUM_ITERATIONS;
+
+	std::cout << "SIMD kernel     : " << (DW_SIMD ? "SSE2" : "scalar fallback") << std::endl;
+	std::cout << "Boxes tested    : " << count << " x " << NUM_ITERATIONS << std::endl;
+	std::cout << "Scalar          : " << scalar_ms << " ms (" << scalar_ms * 1000000.0 / tests << " ns/box)" << std::endl;
+	std::cout << "Batched         : " << simd_ms << " ms (" << simd_ms * 1000000.0 / tests << " ns/box)" << std::endl;
+	std::cout << "Speedup         : " << scalar_ms / simd_ms << "x" << std::endl;
+	std::cout << "Mismatches      : " << mismatches << std::endl;
+
+	// Keep the results alive so the loops are not optimized out.
+	return (scalar_visible == simd_visible && mismatches == 0) ? 0 : 1;
+}
\ No newline at end of file
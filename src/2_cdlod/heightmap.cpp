@@ -1,69 +1,193 @@
 #include "heightmap.h"
+#include "heightmap_ingest.h"
+#include "terrain_desc.h"
 #include <render_device.h>
+#include <logger.h>
+#include <Macros.h>
+#include <gtc/packing.hpp>
 #include <stdio.h>
+#include <algorithm>
 
-HeightMap::HeightMap()
+// The heightmap is stored as UNORM16 but sampled from an R16_FLOAT texture.
+inline uint16_t unorm16_to_half(uint16_t value)
+{
+	return glm::packHalf1x16(float(value) / float(UINT16_MAX));
+}
+
+HeightMap::HeightMap() : m_device(nullptr), m_texture(nullptr), m_normal_texture(nullptr), m_slope_curvature_texture(nullptr), m_cache(nullptr), m_data(nullptr), m_width(0), m_height(0), m_base_level(1), m_tiled(nullptr), m_tile_array(nullptr), m_page_table(nullptr)
 {
 	
 }
 
 HeightMap::~HeightMap()
 {
-
+	shutdown();
 }
 
-bool HeightMap::initialize(std::string file, int width, int height, RenderDevice* device)
+bool HeightMap::initialize(const dw::TerrainDesc& desc, RenderDevice* device)
 {
 	m_device = device;
 
-	int error;
-	FILE* filePtr;
-	unsigned long long imageSize, count;
+	std::string ext = desc.heightmap.substr(desc.heightmap.find_last_of('.') + 1);
+
+	if (ext == "tr16")
+		return initialize_tiled(desc.heightmap);
+	else
+		return initialize_cached(desc);
+}
+
+bool HeightMap::initialize_cached(const dw::TerrainDesc& desc)
+{
+	dw::HeightMapIngestDesc ingest_desc;
+
+	ingest_desc.source = desc.heightmap;
+	ingest_desc.raw_width = desc.heightmap_width;
+	ingest_desc.raw_height = desc.heightmap_height;
+	ingest_desc.height_scale = desc.height_scale;
+	ingest_desc.world_width = desc.world_width;
 
-	filePtr = fopen(file.c_str(), "rb");
+	m_cache = new dw::HeightMapCache();
 
-	imageSize = width * height;
-	m_data = new unsigned short[imageSize];
-	if (!m_data)
+	if (!dw::ingest_heightmap(ingest_desc, *m_cache))
 	{
+		delete m_cache;
+		m_cache = nullptr;
 		return false;
 	}
 
-	count = fread(m_data, sizeof(unsigned short), imageSize, filePtr);
-	if (count != imageSize)
+	// Everything below points straight into the mapping, nothing is decoded or copied.
+	const dw::HeightMapCacheHeader& header = m_cache->header();
+
+	m_width = header.width;
+	m_height = header.height;
+	m_data = m_cache->texels();
+	m_base_level = 1;
+
+	for (uint32_t i = 1; i <= header.pyramid_levels; i++)
 	{
-		return false;
+		MinMaxLevel level;
+		m_cache->pyramid_level(i, level.width, level.height, level.min, level.max);
+		m_min_max.push_back(level);
 	}
 
-	error = fclose(filePtr);
-	if (error != 0)
+	if (!m_device)
+		return true;
+
+	int mip_width, mip_height;
+
+	Texture2DCreateDesc tex_desc;
+	DW_ZERO_MEMORY(tex_desc);
+
+	tex_desc.data = (void*)m_cache->gpu_mip(0, mip_width, mip_height);
+	tex_desc.format = TextureFormat::R16_FLOAT;
+	tex_desc.height = m_height;
+	tex_desc.width = m_width;
+	tex_desc.mipmap_levels = header.mip_count;
+
+	m_texture = m_device->create_texture_2d(tex_desc);
+
+	// The device only uploads the top level, the rest of the chain comes from the cache as well.
+	for (uint32_t i = 1; i < header.mip_count; i++)
+		m_device->set_texture_data(m_texture, i, 0, (void*)m_cache->gpu_mip(i, mip_width, mip_height));
+
+	tex_desc.data = (void*)m_cache->normals();
+	tex_desc.format = TextureFormat::R8G8_UNORM;
+	tex_desc.mipmap_levels = 1;
+
+	m_normal_texture = m_device->create_texture_2d(tex_desc);
+
+	tex_desc.data = (void*)m_cache->slope_curvature();
+
+	m_slope_curvature_texture = m_device->create_texture_2d(tex_desc);
+
+	return true;
+}
+
+bool HeightMap::initialize_tiled(std::string file)
+{
+	m_tiled = new dw::TiledHeightMap();
+
+	if (!m_tiled->open(file, HEIGHTMAP_RESIDENT_TILES))
 	{
+		delete m_tiled;
+		m_tiled = nullptr;
 		return false;
 	}
 
+	m_width = m_tiled->width();
+	m_height = m_tiled->height();
+
+	build_tiled_min_max_pyramid();
+
+	if (!m_device)
+		return true;
+
+	Texture2DArrayCreateDesc array_desc;
+	DW_ZERO_MEMORY(array_desc);
+
+	array_desc.array_slices = HEIGHTMAP_RESIDENT_TILES;
+	array_desc.format = TextureFormat::R16_FLOAT;
+	array_desc.height = m_tiled->stored_tile_size();
+	array_desc.width = m_tiled->stored_tile_size();
+	array_desc.mipmap_levels = 1;
+
+	m_tile_array = m_device->create_texture_2d_array(array_desc);
+
+	m_page_table_data.resize(m_tiled->tiles_x() * m_tiled->tiles_y());
+	std::fill(m_page_table_data.begin(), m_page_table_data.end(), -1.0f);
+
 	Texture2DCreateDesc desc;
+	DW_ZERO_MEMORY(desc);
 
-	desc.data = m_data;
-	desc.format = TextureFormat::R16_FLOAT;
-	desc.height = height;
-	desc.width = width;
+	desc.data = &m_page_table_data[0];
+	desc.format = TextureFormat::R32_FLOAT;
+	desc.height = m_tiled->tiles_y();
+	desc.width = m_tiled->tiles_x();
 	desc.mipmap_levels = 1;
 
-	m_texture = m_device->create_texture_2d(desc);
+	m_page_table = m_device->create_texture_2d(desc);
 
 	return true;
 }
 
 void HeightMap::shutdown()
 {
-	if (m_data)
+	m_data = nullptr;
+	m_min_max.clear();
+	m_min_max_storage.clear();
+
+	if (m_cache)
 	{
-		delete m_data;
-		m_data = nullptr;
+		delete m_cache;
+		m_cache = nullptr;
 	}
 
 	if (m_texture)
 		m_device->destroy(m_texture);
+
+	if (m_normal_texture)
+		m_device->destroy(m_normal_texture);
+
+	if (m_slope_curvature_texture)
+		m_device->destroy(m_slope_curvature_texture);
+
+	if (m_tile_array)
+		m_device->destroy(m_tile_array);
+
+	if (m_page_table)
+		m_device->destroy(m_page_table);
+
+	m_texture = nullptr;
+	m_normal_texture = nullptr;
+	m_slope_curvature_texture = nullptr;
+	m_tile_array = nullptr;
+	m_page_table = nullptr;
+
+	if (m_tiled)
+	{
+		delete m_tiled;
+		m_tiled = nullptr;
+	}
 }
 
 Texture2D* HeightMap::texture()
@@ -71,34 +195,200 @@ Texture2D* HeightMap::texture()
 	return m_texture;
 }
 
-float HeightMap::max_height(int _x, int _y, int _width, int _height)
+const uint16_t* HeightMap::normals()
 {
-	uint16_t max_val = 0;
+	return m_cache ? m_cache->normals() : nullptr;
+}
+
+const uint16_t* HeightMap::slope_curvature()
+{
+	return m_cache ? m_cache->slope_curvature() : nullptr;
+}
+
+float HeightMap::sample(int x, int y)
+{
+	if (m_tiled)
+		return float(m_tiled->sample(x, y)) / float(UINT16_MAX);
+
+	x = std::max(std::min(x, m_width - 1), 0);
+	y = std::max(std::min(y, m_height - 1), 0);
+
+	return float(m_data[size_t(m_width) * y + x]) / float(UINT16_MAX);
+}
+
+float HeightMap::sample_bilinear(float x, float y)
+{
+	x = std::max(std::min(x, float(m_width - 1)), 0.0f);
+	y = std::max(std::min(y, float(m_height - 1)), 0.0f);
+
+	int x0 = int(x);
+	int y0 = int(y);
+	float fx = x - float(x0);
+	float fy = y - float(y0);
 
-	for (int y = _y; y < _height; y++)
+	float h00 = sample(x0, y0);
+	float h10 = sample(x0 + 1, y0);
+	float h01 = sample(x0, y0 + 1);
+	float h11 = sample(x0 + 1, y0 + 1);
+
+	float h0 = h00 + (h10 - h00) * fx;
+	float h1 = h01 + (h11 - h01) * fx;
+
+	return h0 + (h1 - h0) * fy;
+}
+
+void HeightMap::request_region(int x, int y, int width, int height)
+{
+	if (m_tiled)
+		m_tiled->request_region(x, y, width, height);
+}
+
+void HeightMap::update_residency()
+{
+	if (!m_tiled)
+		return;
+
+	// Tiles requested from here on belong to the next frame and may evict the ones requested so far.
+	m_tiled->end_frame();
+
+	if (m_tiled->dirty_slots().size() == 0)
+		return;
+
+	if (!m_device)
 	{
-		for (int x = _x; x < _width; x++)
-		{
-			if (m_data[_width * y + x] > max_val)
-				max_val = m_data[_width * y + x];
-		}
+		m_tiled->clear_dirty_slots();
+		return;
+	}
+
+	int tile_size = m_tiled->stored_tile_size();
+	m_upload_buffer.resize(tile_size * tile_size);
+
+	for (int slot : m_tiled->dirty_slots())
+	{
+		const uint16_t* src = m_tiled->slot_data(slot);
+
+		for (int i = 0; i < tile_size * tile_size; i++)
+			m_upload_buffer[i] = unorm16_to_half(src[i]);
+
+		m_device->set_texture_data(m_tile_array, 0, slot, &m_upload_buffer[0]);
+	}
+
+	m_tiled->clear_dirty_slots();
+
+	for (int ty = 0; ty < m_tiled->tiles_y(); ty++)
+	{
+		for (int tx = 0; tx < m_tiled->tiles_x(); tx++)
+			m_page_table_data[size_t(m_tiled->tiles_x()) * ty + tx] = float(m_tiled->tile_slot(tx, ty));
+	}
+
+	m_device->set_texture_data(m_page_table, 0, 0, &m_page_table_data[0]);
+}
+
+void HeightMap::build_tiled_min_max_pyramid()
+{
+	m_min_max.clear();
+	m_min_max_storage.clear();
+
+	// The file already holds the min/max of every tile, which is the pyramid level at the tile size.
+	m_base_level = 0;
+
+	while ((1 << m_base_level) < m_tiled->tile_size())
+		m_base_level++;
+
+	int width = m_tiled->tiles_x();
+	int height = m_tiled->tiles_y();
+	std::vector<uint16_t> min(width * height);
+	std::vector<uint16_t> max(width * height);
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+			m_tiled->tile_min_max(x, y, min[size_t(width) * y + x], max[size_t(width) * y + x]);
+	}
+
+	// Each level reduces 2x2 cells of the level below it, so the total work is linear in the heightmap size.
+	while (true)
+	{
+		m_min_max_storage.push_back(std::move(min));
+		m_min_max_storage.push_back(std::move(max));
+
+		MinMaxLevel level;
+		level.width = width;
+		level.height = height;
+		level.min = &m_min_max_storage[m_min_max_storage.size() - 2][0];
+		level.max = &m_min_max_storage[m_min_max_storage.size() - 1][0];
+		m_min_max.push_back(level);
+
+		if (width == 1 && height == 1)
+			break;
+
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+		min.resize(width * height);
+		max.resize(width * height);
+
+		dw::reduce_min_max(level.min, level.max, level.width, level.height, &min[0], &max[0]);
 	}
+}
 
-	return float(max_val)/float(UINT16_MAX);
+void HeightMap::level_min_max(int level, int x, int y, uint16_t& min_val, uint16_t& max_val)
+{
+	if (level == 0)
+	{
+		min_val = m_data[size_t(m_width) * y + x];
+		max_val = min_val;
+	}
+	else
+	{
+		MinMaxLevel& l = m_min_max[level - m_base_level];
+		min_val = l.min[size_t(l.width) * y + x];
+		max_val = l.max[size_t(l.width) * y + x];
+	}
 }
 
-float HeightMap::min_height(int _x, int _y, int _width, int _height)
+void HeightMap::min_max_height(int x, int y, int width, int height, float& min_h, float& max_h)
 {
-	uint16_t min_val = 0;
+	// Patches share their edge vertices with their neighbours, so the far edge is inclusive.
+	int x0 = std::max(std::min(x, m_width - 1), 0);
+	int y0 = std::max(std::min(y, m_height - 1), 0);
+	int x1 = std::max(std::min(x + width, m_width - 1), 0);
+	int y1 = std::max(std::min(y + height, m_height - 1), 0);
+
+	// Pick the finest level at which the rectangle touches at most 2x2 cells.
+	int level = m_data ? 0 : m_base_level;
+	int max_level = m_base_level + int(m_min_max.size()) - 1;
+
+	while (level < max_level && (((x1 >> level) - (x0 >> level)) > 1 || ((y1 >> level) - (y0 >> level)) > 1))
+		level++;
+
+	uint16_t min_val = UINT16_MAX;
+	uint16_t max_val = 0;
 
-	for (int y = _y; y < _height; y++)
+	for (int cy = y0 >> level; cy <= (y1 >> level); cy++)
 	{
-		for (int x = _x; x < _width; x++)
+		for (int cx = x0 >> level; cx <= (x1 >> level); cx++)
 		{
-			if (m_data[_width * y + x] < min_val)
-				min_val = m_data[_width * y + x];
+			uint16_t cell_min, cell_max;
+			level_min_max(level, cx, cy, cell_min, cell_max);
+			min_val = std::min(min_val, cell_min);
+			max_val = std::max(max_val, cell_max);
 		}
 	}
 
-	return float(min_val)/float(UINT16_MAX);
+	min_h = float(min_val) / float(UINT16_MAX);
+	max_h = float(max_val) / float(UINT16_MAX);
+}
+
+float HeightMap::max_height(int x, int y, int width, int height)
+{
+	float min_h, max_h;
+	min_max_height(x, y, width, height, min_h, max_h);
+	return max_h;
+}
+
+float HeightMap::min_height(int x, int y, int width, int height)
+{
+	float min_h, max_h;
+	min_max_height(x, y, width, height, min_h, max_h);
+	return min_h;
 }
\ No newline at end of file
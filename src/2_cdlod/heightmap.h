@@ -1,28 +1,93 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 
+#define HEIGHTMAP_RESIDENT_TILES 512
+
 struct Texture2D;
+struct Texture2DArray;
 class RenderDevice;
 
+namespace dw
+{
+	class TiledHeightMap;
+	class HeightMapCache;
+	struct TerrainDesc;
+}
+
 class HeightMap
 {
 public:
 	HeightMap();
 	~HeightMap();
-	bool initialize(std::string file, int width, int height, RenderDevice* device);
+	// Tiled .tr16 files are memory mapped and streamed; width and height come from the file. Every other format goes
+	// through the ingest stage (see heightmap_ingest.h) once and is then memory mapped from its cache.
+	// Without a device no GPU resources are created, which is enough for selection and CPU meshing.
+	bool initialize(const dw::TerrainDesc& desc, RenderDevice* device);
 	void shutdown();
 	Texture2D* texture();
+	// RG8 octahedral normals and RG8 slope/curvature (see terrain_maps.h), nullptr in tiled mode.
+	inline Texture2D* normal_texture() { return m_normal_texture; }
+	inline Texture2D* slope_curvature_texture() { return m_slope_curvature_texture; }
+	// Same data as the textures, nullptr in tiled mode.
+	const uint16_t* normals();
+	const uint16_t* slope_curvature();
+	// Conservative bounds of the texel rectangle [x, x + width] x [y, y + height] in the [0, 1] range. O(1) via the min/max pyramid.
+	void min_max_height(int x, int y, int width, int height, float& min_h, float& max_h);
 	float max_height(int x, int y, int width, int height);
 	float min_height(int x, int y, int width, int height);
+	// Height of a texel in the [0, 1] range. Coordinates are clamped to the edges. Pages in the tile in tiled mode.
+	float sample(int x, int y);
+	// Bilinear height between texel centers, e.g. (0.5, 0) is halfway between texel 0 and 1. Same clamping as sample().
+	float sample_bilinear(float x, float y);
+	// Texels of a cached heightmap, nullptr in tiled mode.
+	inline const uint16_t* data() { return m_data; }
+	// Tiled mode: make sure the tiles under a texel rectangle are resident, then upload whatever was paged in.
+	void request_region(int x, int y, int width, int height);
+	void update_residency();
+	inline bool is_tiled() { return m_tiled != nullptr; }
+	// Tiled mode: resident tiles live in the slices of tile_array(). page_table() is a tiles_x x tiles_y R32_FLOAT
+	// texture holding the slice of each tile, or -1 if it is not resident.
+	inline Texture2DArray* tile_array() { return m_tile_array; }
+	inline Texture2D* page_table() { return m_page_table; }
+	inline dw::TiledHeightMap* tiled() { return m_tiled; }
 	inline int width() { return m_width; };
 	inline int height() { return m_height; };
 
+private:
+	struct MinMaxLevel
+	{
+		int width;
+		int height;
+		const uint16_t* min;
+		const uint16_t* max;
+	};
+
+	bool initialize_cached(const dw::TerrainDesc& desc);
+	bool initialize_tiled(std::string file);
+	void build_tiled_min_max_pyramid();
+	void level_min_max(int level, int x, int y, uint16_t& min_val, uint16_t& max_val);
+
 private:
 	RenderDevice* m_device;
 	Texture2D* m_texture;
-	uint16_t* m_data;
+	Texture2D* m_normal_texture;
+	Texture2D* m_slope_curvature_texture;
+	dw::HeightMapCache* m_cache;
+	const uint16_t* m_data;
 	int m_width;
 	int m_height;
+	// m_min_max[i] holds pyramid level m_base_level + i, where each cell spans 2^level texels per side. Level 0 is
+	// m_data itself. In tiled mode the pyramid starts at the tile level, since individual texels are not resident.
+	// The levels point into the cache, or into m_min_max_storage in tiled mode.
+	int m_base_level;
+	std::vector<MinMaxLevel> m_min_max;
+	std::vector< std::vector<uint16_t> > m_min_max_storage;
+	dw::TiledHeightMap* m_tiled;
+	Texture2DArray* m_tile_array;
+	Texture2D* m_page_table;
+	std::vector<float> m_page_table_data;
+	std::vector<uint16_t> m_upload_buffer;
 };
\ No newline at end of file
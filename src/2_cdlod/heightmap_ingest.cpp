@@ -0,0 +1,464 @@
+#include "heightmap_ingest.h"
+#include "terrain_maps.h"
+#include <common/thread_pool.h>
+#include <common/hash.h>
+#include <logger.h>
+#include <stb_image.h>
+#include <gtc/packing.hpp>
+#include <glm.hpp>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+namespace dw
+{
+	inline uint64_t align16(uint64_t offset)
+	{
+		return (offset + 15) & ~uint64_t(15);
+	}
+
+	inline bool valid_heightmap_size(int width, int height)
+	{
+		return width >= 2 && height >= 2 && width <= HEIGHTMAP_MAX_SIZE && height <= HEIGHTMAP_MAX_SIZE;
+	}
+
+	// Fills in the section offsets of a cache for the given size and returns the total file size.
+	uint64_t cache_layout(HeightMapCacheHeader& header)
+	{
+		uint64_t texel_count = uint64_t(header.width) * header.height;
+
+		header.mip_count = 1;
+
+		while ((header.width >> header.mip_count) > 0 || (header.height >> header.mip_count) > 0)
+			header.mip_count++;
+
+		uint64_t mip_texels = 0;
+
+		for (uint32_t i = 0; i < header.mip_count; i++)
+			mip_texels += uint64_t(std::max(header.width >> i, 1u)) * std::max(header.height >> i, 1u);
+
+		header.pyramid_levels = 0;
+
+		uint64_t pyramid_cells = 0;
+		uint32_t width = header.width;
+		uint32_t height = header.height;
+
+		while (width > 1 || height > 1)
+		{
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
+			pyramid_cells += uint64_t(width) * height;
+			header.pyramid_levels++;
+		}
+
+		header.texels_offset = align16(sizeof(HeightMapCacheHeader));
+		header.mips_offset = align16(header.texels_offset + texel_count * sizeof(uint16_t));
+		header.normals_offset = align16(header.mips_offset + mip_texels * sizeof(uint16_t));
+		header.slope_curvature_offset = align16(header.normals_offset + texel_count * sizeof(uint16_t));
+		header.pyramid_offset = align16(header.slope_curvature_offset + texel_count * sizeof(uint16_t));
+
+		return header.pyramid_offset + pyramid_cells * 2 * sizeof(uint16_t);
+	}
+
+	bool read_raw_heightmap(const std::string& file, size_t texel_size, int width, int height, std::vector<uint8_t>& bytes)
+	{
+		FILE* f = fopen(file.c_str(), "rb");
+
+		if (!f)
+		{
+			LOG_ERROR("Failed to open heightmap");
+			return false;
+		}
+
+		bytes.resize(size_t(width) * height * texel_size);
+
+		// The file has to hold exactly width x height texels, anything else means the dimensions are wrong.
+		bool success = fread(&bytes[0], 1, bytes.size(), f) == bytes.size() && fgetc(f) == EOF;
+		fclose(f);
+
+		if (!success)
+			LOG_ERROR("Heightmap size does not match its dimensions");
+
+		return success;
+	}
+
+	bool decode_heightmap(const HeightMapIngestDesc& desc, std::vector<uint16_t>& texels, int& width, int& height)
+	{
+		std::string ext = desc.source.substr(desc.source.find_last_of('.') + 1);
+
+		if (ext == "r16" || ext == "r32")
+		{
+			width = desc.raw_width;
+			height = desc.raw_height;
+
+			if (!valid_heightmap_size(width, height))
+			{
+				LOG_ERROR("Invalid heightmap dimensions");
+				return false;
+			}
+
+			size_t count = size_t(width) * height;
+			std::vector<uint8_t> bytes;
+
+			if (!read_raw_heightmap(desc.source, ext == "r16" ? sizeof(uint16_t) : sizeof(float), width, height, bytes))
+				return false;
+
+			texels.resize(count);
+
+			if (ext == "r16")
+			{
+				memcpy(&texels[0], &bytes[0], count * sizeof(uint16_t));
+				return true;
+			}
+
+			// Float heights have no fixed range, so they are remapped from their own range.
+			const float* src = (const float*)&bytes[0];
+			float min_h = FLT_MAX;
+			float max_h = -FLT_MAX;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				min_h = std::min(min_h, src[i]);
+				max_h = std::max(max_h, src[i]);
+			}
+
+			float scale = max_h > min_h ? float(UINT16_MAX) / (max_h - min_h) : 0.0f;
+
+			for (size_t i = 0; i < count; i++)
+				texels[i] = uint16_t((src[i] - min_h) * scale + 0.5f);
+
+			return true;
+		}
+
+		// 8-bit images are expanded to 16 bits. Colour images are converted to grey.
+		int channels;
+		stbi_us* data = stbi_load_16(desc.source.c_str(), &width, &height, &channels, 1);
+
+		if (!data)
+		{
+			LOG_ERROR("Failed to decode heightmap");
+			return false;
+		}
+
+		bool valid = valid_heightmap_size(width, height);
+
+		if (valid)
+			texels.assign(data, data + size_t(width) * height);
+		else
+			LOG_ERROR("Invalid heightmap dimensions");
+
+		stbi_image_free(data);
+
+		return valid;
+	}
+
+	bool hash_heightmap_source(const HeightMapIngestDesc& desc, uint64_t& hash)
+	{
+		// Hashing the contents would read the whole source on every launch. Size and modification time catch every
+		// real edit for a fraction of the cost.
+#ifdef WIN32
+		struct __stat64 st;
+
+		if (_stat64(desc.source.c_str(), &st) != 0)
+#else
+		struct stat st;
+
+		if (stat(desc.source.c_str(), &st) != 0)
+#endif
+		{
+			LOG_ERROR("Failed to open heightmap");
+			return false;
+		}
+
+		uint64_t size = uint64_t(st.st_size);
+		int64_t mtime = int64_t(st.st_mtime);
+		uint32_t version = HEIGHTMAP_CACHE_VERSION;
+
+		hash = fnv1a(FNV_OFFSET_BASIS, &size, sizeof(size));
+		hash = fnv1a(hash, &mtime, sizeof(mtime));
+		hash = fnv1a(hash, &version, sizeof(version));
+		hash = fnv1a(hash, &desc.raw_width, sizeof(desc.raw_width));
+		hash = fnv1a(hash, &desc.raw_height, sizeof(desc.raw_height));
+		hash = fnv1a(hash, &desc.height_scale, sizeof(desc.height_scale));
+		hash = fnv1a(hash, &desc.world_width, sizeof(desc.world_width));
+
+		return true;
+	}
+
+	std::string heightmap_cache_path(const std::string& source)
+	{
+		return source + ".hmc";
+	}
+
+	void reduce_min_max(const uint16_t* src_min, const uint16_t* src_max, int src_width, int src_height, uint16_t* dst_min, uint16_t* dst_max)
+	{
+		int width = (src_width + 1) / 2;
+		int height = (src_height + 1) / 2;
+
+		for (int y = 0; y < height; y++)
+		{
+			int sy1 = std::min(2 * y + 1, src_height - 1);
+
+			for (int x = 0; x < width; x++)
+			{
+				int sx1 = std::min(2 * x + 1, src_width - 1);
+
+				uint16_t min_val = UINT16_MAX;
+				uint16_t max_val = 0;
+
+				for (int sy = 2 * y; sy <= sy1; sy++)
+				{
+					for (int sx = 2 * x; sx <= sx1; sx++)
+					{
+						min_val = std::min(min_val, src_min[src_width * sy + sx]);
+						max_val = std::max(max_val, src_max[src_width * sy + sx]);
+					}
+				}
+
+				dst_min[width * y + x] = min_val;
+				dst_max[width * y + x] = max_val;
+			}
+		}
+	}
+
+	void build_gpu_mips(const std::vector<uint16_t>& texels, int width, int height, std::vector<uint16_t>& mips)
+	{
+		std::vector<float> level(texels.size());
+
+		for (size_t i = 0; i < texels.size(); i++)
+			level[i] = float(texels[i]) / float(UINT16_MAX);
+
+		while (true)
+		{
+			for (size_t i = 0; i < level.size(); i++)
+				mips.push_back(glm::packHalf1x16(level[i]));
+
+			if (width == 1 && height == 1)
+				break;
+
+			// 2x2 box filter. Odd edges reuse the last texel.
+			int next_width = std::max(width >> 1, 1);
+			int next_height = std::max(height >> 1, 1);
+			std::vector<float> next(size_t(next_width) * next_height);
+
+			for (int y = 0; y < next_height; y++)
+			{
+				int y0 = std::min(2 * y, height - 1);
+				int y1 = std::min(2 * y + 1, height - 1);
+
+				for (int x = 0; x < next_width; x++)
+				{
+					int x0 = std::min(2 * x, width - 1);
+					int x1 = std::min(2 * x + 1, width - 1);
+
+					next[size_t(next_width) * y + x] = 0.25f * (level[size_t(width) * y0 + x0] + level[size_t(width) * y0 + x1] + level[size_t(width) * y1 + x0] + level[size_t(width) * y1 + x1]);
+				}
+			}
+
+			level.swap(next);
+			width = next_width;
+			height = next_height;
+		}
+	}
+
+	// Sections are written in file order and the gaps between them zero filled, so the writer never seeks past
+	// the 2 GB a long can address on Windows.
+	bool write_section(FILE* f, uint64_t& position, uint64_t offset, const void* data, size_t size)
+	{
+		static const uint8_t padding[16] = {};
+
+		while (position < offset)
+		{
+			size_t count = size_t(std::min(offset - position, uint64_t(sizeof(padding))));
+
+			if (fwrite(padding, 1, count, f) != count)
+				return false;
+
+			position += count;
+		}
+
+		if (position != offset || fwrite(data, 1, size, f) != size)
+			return false;
+
+		position += size;
+
+		return true;
+	}
+
+	bool build_heightmap_cache(const HeightMapIngestDesc& desc, uint64_t source_hash, const std::string& cache_file)
+	{
+		std::vector<uint16_t> texels;
+		int width, height;
+
+		if (!decode_heightmap(desc, texels, width, height))
+			return false;
+
+		HeightMapCacheHeader header;
+		header.magic = HEIGHTMAP_CACHE_MAGIC;
+		header.version = HEIGHTMAP_CACHE_VERSION;
+		header.source_hash = source_hash;
+		header.width = width;
+		header.height = height;
+
+		cache_layout(header);
+
+		std::vector<uint16_t> mips;
+		build_gpu_mips(texels, width, height, mips);
+
+		std::vector<uint16_t> normals(texels.size());
+		std::vector<uint16_t> slope_curvature(texels.size());
+
+		{
+			ThreadPool pool;
+			generate_terrain_maps(&texels[0], width, height, desc.height_scale, desc.world_width / float(width), &normals[0], &slope_curvature[0], &pool);
+		}
+
+		FILE* f = fopen(cache_file.c_str(), "wb");
+
+		if (!f)
+		{
+			LOG_ERROR("Failed to create heightmap cache");
+			return false;
+		}
+
+		// The header goes in last, so an interrupted write never leaves a cache that looks valid.
+		HeightMapCacheHeader empty;
+		memset(&empty, 0, sizeof(empty));
+
+		uint64_t position = 0;
+
+		bool success = write_section(f, position, 0, &empty, sizeof(empty));
+		success = success && write_section(f, position, header.texels_offset, &texels[0], texels.size() * sizeof(uint16_t));
+		success = success && write_section(f, position, header.mips_offset, &mips[0], mips.size() * sizeof(uint16_t));
+		success = success && write_section(f, position, header.normals_offset, &normals[0], normals.size() * sizeof(uint16_t));
+		success = success && write_section(f, position, header.slope_curvature_offset, &slope_curvature[0], slope_curvature.size() * sizeof(uint16_t));
+
+		const uint16_t* src_min = &texels[0];
+		const uint16_t* src_max = &texels[0];
+		std::vector<uint16_t> level_min, level_max, prev_min, prev_max;
+		uint64_t offset = header.pyramid_offset;
+
+		while (success && (width > 1 || height > 1))
+		{
+			int level_width = (width + 1) / 2;
+			int level_height = (height + 1) / 2;
+			size_t count = size_t(level_width) * level_height;
+
+			level_min.resize(count);
+			level_max.resize(count);
+			reduce_min_max(src_min, src_max, width, height, &level_min[0], &level_max[0]);
+
+			success = write_section(f, position, offset, &level_min[0], count * sizeof(uint16_t));
+			success = success && write_section(f, position, offset + count * sizeof(uint16_t), &level_max[0], count * sizeof(uint16_t));
+			offset += count * 2 * sizeof(uint16_t);
+
+			prev_min.swap(level_min);
+			prev_max.swap(level_max);
+			src_min = &prev_min[0];
+			src_max = &prev_max[0];
+			width = level_width;
+			height = level_height;
+		}
+
+		// The header is at offset 0, the one seek that always fits in a long.
+		success = success && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+		success = fclose(f) == 0 && success;
+
+		if (!success)
+		{
+			remove(cache_file.c_str());
+			LOG_ERROR("Failed to write heightmap cache");
+		}
+
+		return success;
+	}
+
+	bool HeightMapCache::open(const std::string& file, uint64_t source_hash)
+	{
+		if (!m_file.open(file))
+			return false;
+
+		if (m_file.size() < sizeof(HeightMapCacheHeader))
+		{
+			close();
+			return false;
+		}
+
+		HeightMapCacheHeader expected = header();
+
+		if (expected.magic != HEIGHTMAP_CACHE_MAGIC || expected.version != HEIGHTMAP_CACHE_VERSION || expected.source_hash != source_hash || !valid_heightmap_size(int(expected.width), int(expected.height)) || cache_layout(expected) != m_file.size() || memcmp(&expected, &header(), sizeof(expected)) != 0)
+		{
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void HeightMapCache::close()
+	{
+		m_file.close();
+	}
+
+	const uint16_t* HeightMapCache::gpu_mip(int level, int& width, int& height)
+	{
+		const uint16_t* data = (const uint16_t*)(m_file.data() + header().mips_offset);
+
+		for (int i = 0; i < level; i++)
+			data += size_t(std::max(header().width >> i, 1u)) * std::max(header().height >> i, 1u);
+
+		width = std::max(header().width >> level, 1u);
+		height = std::max(header().height >> level, 1u);
+
+		return data;
+	}
+
+	void HeightMapCache::pyramid_level(int level, int& width, int& height, const uint16_t*& min, const uint16_t*& max)
+	{
+		const uint16_t* data = (const uint16_t*)(m_file.data() + header().pyramid_offset);
+
+		width = header().width;
+		height = header().height;
+
+		for (int i = 1; i <= level; i++)
+		{
+			if (i > 1)
+				data += size_t(width) * height * 2;
+
+			width = (width + 1) / 2;
+			height = (height + 1) / 2;
+		}
+
+		min = data;
+		max = data + size_t(width) * height;
+	}
+
+	bool ingest_heightmap(const HeightMapIngestDesc& desc, HeightMapCache& cache)
+	{
+		uint64_t hash;
+
+		if (!hash_heightmap_source(desc, hash))
+			return false;
+
+		std::string cache_file = heightmap_cache_path(desc.source);
+
+		if (cache.open(cache_file, hash))
+			return true;
+
+		LOG_INFO("Building heightmap cache");
+
+		if (!build_heightmap_cache(desc, hash, cache_file))
+			return false;
+
+		if (!cache.open(cache_file, hash))
+		{
+			LOG_ERROR("Failed to open heightmap cache");
+			return false;
+		}
+
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "tiled_heightmap.h"
+
+#define HEIGHTMAP_CACHE_MAGIC 0x31434D48 // "HMC1"
+#define HEIGHTMAP_CACHE_VERSION 2
+#define HEIGHTMAP_MAX_SIZE 65536
+
+namespace dw
+{
+	// Parameters that change the cached data. They are hashed together with the size and modification time of the source.
+	struct HeightMapIngestDesc
+	{
+		std::string source;
+		int			raw_width;	  // Only used for headerless sources (.r16, .r32).
+		int			raw_height;
+		float		height_scale; // World units per unit of normalized height.
+		float		world_width;  // Normals are built in world space, so they depend on the size of a texel.
+	};
+
+	// Layout of a heightmap cache file. Every section is 16 byte aligned.
+	//   HeightMapCacheHeader
+	//   uint16_t texels[height][width]							UNORM16 heights for CPU queries
+	//   uint16_t gpu_mips[mip_count][...]						Half float mip chain, level i is max(width >> i, 1) x max(height >> i, 1)
+	//   uint16_t normals[height][width]						RG8 octahedral normals, see terrain_maps.h
+	//   uint16_t slope_curvature[height][width]				RG8 slope and curvature, see terrain_maps.h
+	//   uint16_t pyramid[pyramid_levels][2][...]				Min then max of every reduced min/max pyramid level
+	struct HeightMapCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t source_hash;
+		uint32_t width;
+		uint32_t height;
+		uint32_t mip_count;
+		uint32_t pyramid_levels;
+		uint64_t texels_offset;
+		uint64_t mips_offset;
+		uint64_t normals_offset;
+		uint64_t slope_curvature_offset;
+		uint64_t pyramid_offset;
+	};
+
+	// Decodes a heightmap into UNORM16 texels. Supports raw UNORM16 (.r16), raw float32 (.r32, remapped from its
+	// value range to [0, 1]) and everything stb_image reads, e.g. 16-bit PNG and PGM.
+	bool decode_heightmap(const HeightMapIngestDesc& desc, std::vector<uint16_t>& texels, int& width, int& height);
+	// FNV-1a over the size and modification time of the source and every parameter that affects the cache.
+	bool hash_heightmap_source(const HeightMapIngestDesc& desc, uint64_t& hash);
+	bool build_heightmap_cache(const HeightMapIngestDesc& desc, uint64_t source_hash, const std::string& cache_file);
+	// Path of the cache that belongs to a source.
+	std::string heightmap_cache_path(const std::string& source);
+	// Reduces 2x2 cells of a min/max pyramid level into a (src_width + 1) / 2 x (src_height + 1) / 2 level. Level 0
+	// passes the texels as both src_min and src_max.
+	void reduce_min_max(const uint16_t* src_min, const uint16_t* src_max, int src_width, int src_height, uint16_t* dst_min, uint16_t* dst_max);
+
+	// Memory mapped, read-only view of a heightmap cache.
+	class HeightMapCache
+	{
+	public:
+		// Fails if the file is missing, truncated, from another version or was built from a different source.
+		bool open(const std::string& file, uint64_t source_hash);
+		void close();
+		inline const HeightMapCacheHeader& header() { return *(const HeightMapCacheHeader*)m_file.data(); }
+		inline const uint16_t* texels() { return (const uint16_t*)(m_file.data() + header().texels_offset); }
+		inline const uint16_t* normals() { return (const uint16_t*)(m_file.data() + header().normals_offset); }
+		inline const uint16_t* slope_curvature() { return (const uint16_t*)(m_file.data() + header().slope_curvature_offset); }
+		const uint16_t* gpu_mip(int level, int& width, int& height);
+		// Level 1 is the first reduced level, each cell spans 2^level texels per side. Level 0 is texels().
+		void pyramid_level(int level, int& width, int& height, const uint16_t*& min, const uint16_t*& max);
+
+	private:
+		MappedFile m_file;
+	};
+
+	// Makes sure an up to date cache exists for the source and opens it. Rebuilds the cache if the source, the
+	// parameters or the cache version changed.
+	bool ingest_heightmap(const HeightMapIngestDesc& desc, HeightMapCache& cache);
+}
\ No newline at end of file
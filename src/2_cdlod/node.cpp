@@ -1,132 +1,207 @@
 #include "node.h"
 #include "heightmap.h"
-#include <camera.h>
+#include "terrain_culling.h"
+#include <logger.h>
 #include <algorithm>
+#include <math.h>
 
 namespace dw
 {
-	Node::Node(HeightMap* heightMap, float node_size, int lod_depth, float x, float z, float height_scale)
+	Quadtree::Quadtree() : m_lod_depth(0), m_root_count(0), m_nodes_per_root(0)
 	{
-		x_pos = x;
-		z_pos = z;
-		size = node_size;
 
-		if (lod_depth == 1)
+	}
+
+	Quadtree::~Quadtree()
+	{
+
+	}
+
+	bool Quadtree::build(HeightMap* height_map, float root_size, int lod_depth, int grid_width, int grid_height, float height_scale, float texel_scale)
+	{
+		// (4^depth - 1) / 3 nodes per root. Child offsets are 16-bit, which allows up to 8 levels below each root.
+		uint32_t nodes_per_root = ((1u << (2 * lod_depth)) - 1) / 3;
+
+		if (lod_depth < 1 || nodes_per_root > UINT16_MAX)
 		{
-			top_left = nullptr;
-			top_right = nullptr;
-			bottom_left = nullptr;
-			bottom_right = nullptr;
-			max_height = height_scale;// heightMap->max_height(x_pos, z_pos, size, size) * height_scale;
-			min_height = 0.0f; // heightMap->min_height(x_pos, z_pos, size, size) * height_scale;
+			LOG_ERROR("Unsupported LOD depth for the terrain quadtree");
+			return false;
 		}
-		else
+
+		m_lod_depth = lod_depth;
+		m_root_count = grid_width * grid_height;
+		m_nodes_per_root = nodes_per_root;
+
+		m_level_size.resize(lod_depth);
+
+		for (int i = 0; i < lod_depth; i++)
+			m_level_size[i] = root_size / float(1 << (lod_depth - 1 - i));
+
+		uint32_t total = m_nodes_per_root * m_root_count;
+
+		m_x_pos.resize(total);
+		m_z_pos.resize(total);
+		m_min_height.resize(total);
+		m_max_height.resize(total);
+		m_first_child.resize(total);
+
+		for (int i = 0; i < grid_width; i++)
 		{
-			float half_size = size / 2.0f;
+			for (int j = 0; j < grid_height; j++)
+			{
+				uint32_t base = (i * grid_height + j) * m_nodes_per_root;
 
-			top_left = new Node(heightMap, half_size, lod_depth - 1, x_pos, z_pos, height_scale);
-			top_right = new Node(heightMap, half_size, lod_depth - 1, x_pos + half_size, z_pos, height_scale);
-			bottom_left = new Node(heightMap, half_size, lod_depth - 1, x_pos, z_pos + half_size, height_scale);
-			bottom_right = new Node(heightMap, half_size, lod_depth - 1, x_pos + half_size, z_pos + half_size, height_scale);
+				m_x_pos[base] = i * root_size;
+				m_z_pos[base] = j * root_size;
 
-			max_height = std::max(std::max(top_left->max_height, top_right->max_height),
-								  std::max(bottom_left->max_height, bottom_right->max_height));
+				// Breadth-first: the children of local node k live at 4k + 1 ... 4k + 4.
+				uint32_t level_start = 0;
+				uint32_t level_count = 1;
 
-			min_height = std::max(std::max(top_left->min_height, top_right->min_height),
-								  std::max(bottom_left->min_height, bottom_right->min_height));
+				for (int depth = 0; depth < lod_depth; depth++)
+				{
+					float size = m_level_size[lod_depth - 1 - depth];
+					float half_size = size / 2.0f;
+
+					for (uint32_t k = level_start; k < level_start + level_count; k++)
+					{
+						uint32_t idx = base + k;
+
+						int texel_x = int(m_x_pos[idx] * texel_scale);
+						int texel_z = int(m_z_pos[idx] * texel_scale);
+						int texel_size = int(ceil(size * texel_scale));
+
+						float min_h, max_h;
+						height_map->min_max_height(texel_x, texel_z, texel_size, texel_size, min_h, max_h);
+
+						m_min_height[idx] = min_h * height_scale;
+						m_max_height[idx] = max_h * height_scale;
+
+						if (depth == lod_depth - 1)
+						{
+							m_first_child[idx] = 0;
+							continue;
+						}
+
+						uint16_t first_child = uint16_t(4 * k + 1);
+						m_first_child[idx] = first_child;
+
+						// Top left, top right, bottom left, bottom right.
+						m_x_pos[base + first_child + 0] = m_x_pos[idx];
+						m_z_pos[base + first_child + 0] = m_z_pos[idx];
+						m_x_pos[base + first_child + 1] = m_x_pos[idx] + half_size;
+						m_z_pos[base + first_child + 1] = m_z_pos[idx];
+						m_x_pos[base + first_child + 2] = m_x_pos[idx];
+						m_z_pos[base + first_child + 2] = m_z_pos[idx] + half_size;
+						m_x_pos[base + first_child + 3] = m_x_pos[idx] + half_size;
+						m_z_pos[base + first_child + 3] = m_z_pos[idx] + half_size;
+					}
+
+					level_start += level_count;
+					level_count *= 4;
+				}
+			}
 		}
+
+		return true;
 	}
 
-	Node::~Node()
+	void Quadtree::lod_select(std::vector<float>& ranges, Camera* camera, std::vector<Node>& patches)
 	{
-		if (top_left)
-		{
-			delete top_left;
-			top_left = nullptr;
-		}
+		lod_select(ranges, CullView::from_camera(camera), patches);
+	}
 
-		if (top_right)
-		{
-			delete top_right;
-			top_right = nullptr;
-		}
+	void Quadtree::lod_select(std::vector<float>& ranges, const CullView& view, std::vector<Node>& patches)
+	{
+		for (int i = 0; i < m_root_count; i++)
+			lod_select_root(i, ranges, view, patches);
+	}
 
-		if (bottom_left)
-		{
-			delete bottom_left;
-			bottom_left = nullptr;
-		}
+	void Quadtree::lod_select_root(int root, std::vector<float>& ranges, const CullView& view, std::vector<Node>& patches, float* slack, SelectionCounters* counters)
+	{
+		uint32_t base = root * m_nodes_per_root;
+		int lod_level = m_lod_depth - 1;
+		float size = m_level_size[lod_level];
 
-		if (bottom_right)
+		bool in_range = in_sphere_scalar(m_x_pos[base], m_z_pos[base], size, m_min_height[base], m_max_height[base], view.position, ranges[lod_level]);
+		bool visible = in_frustum_scalar(m_x_pos[base], m_z_pos[base], size, m_min_height[base], m_max_height[base], view);
+		bool in_next_range = lod_level > 0 && in_sphere_scalar(m_x_pos[base], m_z_pos[base], size, m_min_height[base], m_max_height[base], view.position, ranges[lod_level - 1]);
+
+		if (slack)
 		{
-			delete bottom_right;
-			bottom_right = nullptr;
+			*slack = std::min(*slack, sphere_margin(m_x_pos[base], m_z_pos[base], size, m_min_height[base], m_max_height[base], view.position, ranges[lod_level]));
+			*slack = std::min(*slack, frustum_margin(m_x_pos[base], m_z_pos[base], size, m_min_height[base], m_max_height[base], view));
+
+			if (lod_level > 0)
+				*slack = std::min(*slack, sphere_margin(m_x_pos[base], m_z_pos[base], size, m_min_height[base], m_max_height[base], view.position, ranges[lod_level - 1]));
 		}
+
+		lod_select(base, 0, lod_level, in_range, visible, in_next_range, ranges, view, patches, slack, counters);
 	}
 
-	bool Node::lod_select(std::vector<float>& ranges, int lod_level, Camera *camera, std::vector<Node*>& sdraw_stack, dd::Renderer* debug_renderer)
+	bool Quadtree::lod_select(uint32_t base, uint16_t local, int lod_level, bool in_range, bool in_frustum, bool in_next_range, std::vector<float>& ranges, const CullView& view, std::vector<Node>& patches, float* slack, SelectionCounters* counters)
 	{
-		current_range = ranges[lod_level];
+		uint32_t idx = base + local;
+		float current_range = ranges[lod_level];
+
+		if (counters)
+		{
+			counters->nodes_visited++;
+			counters->sphere_culled += in_range ? 0 : 1;
+			counters->frustum_culled += in_range && !in_frustum ? 1 : 0;
+		}
 
-		if (!in_sphere(current_range, camera->m_position))
+		if (!in_range)
 			return false;
 
-		if (!in_frustum(camera))
+		if (!in_frustum)
 			return true;
 
 		if (lod_level == 0)
 		{
-			full_resolution = true;
-			sdraw_stack.push_back(this);
-			//debug_renderer->aabb(glm::vec3(x_pos, min_height, z_pos), glm::vec3(x_pos + size, max_height, z_pos + size), glm::vec3(1.0f, 0.0f, 0.0f));
-			return true;		   
+			patches.push_back(make_patch(idx, lod_level, current_range, true));
+			return true;
 		}
 		else
 		{
-			if (!in_sphere(ranges[lod_level - 1], camera->m_position))
-			{
-				full_resolution = true;
-				sdraw_stack.push_back(this);
-				//debug_renderer->aabb(glm::vec3(x_pos, min_height, z_pos), glm::vec3(x_pos + size, max_height, z_pos + size), glm::vec3(1.0f, 0.0f, 0.0f));
-			}
+			if (!in_next_range)
+				patches.push_back(make_patch(idx, lod_level, current_range, true));
 			else
 			{
-				Node *child;
-				child = top_left;
+				uint16_t first_child = m_first_child[idx];
+				uint32_t children = base + first_child;
+				int child_level = lod_level - 1;
+				float child_size = m_level_size[child_level];
 
-				if (!child->lod_select(ranges, lod_level - 1, camera, sdraw_stack, debug_renderer))
-				{
-					child->full_resolution = false;
-					child->current_range = current_range;
-					sdraw_stack.push_back(child);
-					//debug_renderer->aabb(glm::vec3(child->x_pos, child->min_height, child->z_pos), glm::vec3(child->x_pos + child->size, child->max_height, child->z_pos + child->size), glm::vec3(1.0f, 0.0f, 0.0f));
-				}
+				const float* x = &m_x_pos[children];
+				const float* z = &m_z_pos[children];
+				const float* min_y = &m_min_height[children];
+				const float* max_y = &m_max_height[children];
 
-				child = top_right;
-				if (!child->lod_select(ranges, lod_level - 1, camera, sdraw_stack, debug_renderer))
-				{
-					child->full_resolution = false;
-					child->current_range = current_range;
-					sdraw_stack.push_back(child);
-					//debug_renderer->aabb(glm::vec3(child->x_pos, child->min_height, child->z_pos), glm::vec3(child->x_pos + child->size, child->max_height, child->z_pos + child->size), glm::vec3(1.0f, 0.0f, 0.0f));
-				}
+				uint32_t range_mask = in_sphere_x4(x, z, child_size, min_y, max_y, view.position, ranges[child_level]);
+				uint32_t frustum_mask = in_frustum_x4(x, z, child_size, min_y, max_y, view);
+				uint32_t next_range_mask = child_level > 0 ? in_sphere_x4(x, z, child_size, min_y, max_y, view.position, ranges[child_level - 1]) : 0;
 
-				child = bottom_left;
-				if (!child->lod_select(ranges, lod_level - 1, camera, sdraw_stack, debug_renderer))
+				if (slack)
 				{
-					child->full_resolution = false;
-					child->current_range = current_range;
-					sdraw_stack.push_back(child);
-					//debug_renderer->aabb(glm::vec3(child->x_pos, child->min_height, child->z_pos), glm::vec3(child->x_pos + child->size, child->max_height, child->z_pos + child->size), glm::vec3(1.0f, 0.0f, 0.0f));
+					for (int i = 0; i < 4; i++)
+					{
+						*slack = std::min(*slack, sphere_margin(x[i], z[i], child_size, min_y[i], max_y[i], view.position, ranges[child_level]));
+						*slack = std::min(*slack, frustum_margin(x[i], z[i], child_size, min_y[i], max_y[i], view));
+
+						if (child_level > 0)
+							*slack = std::min(*slack, sphere_margin(x[i], z[i], child_size, min_y[i], max_y[i], view.position, ranges[child_level - 1]));
+					}
 				}
 
-				child = bottom_right;
-				if (!child->lod_select(ranges, lod_level - 1, camera, sdraw_stack, debug_renderer))
+				for (uint16_t i = 0; i < 4; i++)
 				{
-					child->full_resolution = false;
-					child->current_range = current_range;
-					sdraw_stack.push_back(child);
-					//debug_renderer->aabb(glm::vec3(child->x_pos, child->min_height, child->z_pos), glm::vec3(child->x_pos + child->size, child->max_height, child->z_pos + child->size), glm::vec3(1.0f, 0.0f, 0.0f));
+					uint16_t child = first_child + i;
+					uint32_t bit = 1 << i;
+
+					// Children outside of their own range are covered by this node's range at half resolution.
+					if (!lod_select(base, child, child_level, (range_mask & bit) != 0, (frustum_mask & bit) != 0, (next_range_mask & bit) != 0, ranges, view, patches, slack, counters))
+						patches.push_back(make_patch(base + child, child_level, current_range, false));
 				}
 			}
 
@@ -134,29 +209,19 @@ namespace dw
 		}
 	}
 
-	inline float squared(float v) { return v * v; }
-
-	bool Node::in_sphere(float r, glm::vec3 s)
-	{
-		float dist_squared = r * r;
-		glm::vec3 c1 = glm::vec3(x_pos, min_height, z_pos);
-		glm::vec3 c2 = glm::vec3(x_pos + size, max_height, z_pos + size);
-		
-		if (s.x < c1.x) dist_squared -= squared(s.x - c1.x);
-		else if (s.x > c2.x) dist_squared -= squared(s.x - c2.x);
-		if (s.y < c1.y) dist_squared -= squared(s.y - c1.y);
-		else if (s.y > c2.y) dist_squared -= squared(s.y - c2.y);
-		if (s.z < c1.z) dist_squared -= squared(s.z - c1.z);
-		else if (s.z > c2.z) dist_squared -= squared(s.z - c2.z);
-
-		return dist_squared > 0;
-	}
-
-	bool Node::in_frustum(Camera *camera)
+	Node Quadtree::make_patch(uint32_t idx, int lod_level, float range, bool full_resolution)
 	{
-		dw::AABB aabb;
-		aabb.min = glm::vec3(x_pos, min_height, z_pos);
-		aabb.max = glm::vec3(x_pos + size, max_height, z_pos + size);
-		return dw::intersects(camera->m_frustum, aabb);
+		Node node;
+
+		node.max_height = m_max_height[idx];
+		node.min_height = m_min_height[idx];
+		node.x_pos = m_x_pos[idx];
+		node.z_pos = m_z_pos[idx];
+		node.size = m_level_size[lod_level];
+		node.current_range = range;
+		node.lod_level = lod_level;
+		node.full_resolution = full_resolution;
+
+		return node;
 	}
 }
\ No newline at end of file
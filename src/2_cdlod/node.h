@@ -1,16 +1,17 @@
 #pragma once
 
 #include <vector>
+#include <stdint.h>
 #include <glm.hpp>
-#include <debug_draw.h>
 
 class HeightMap;
-struct Camera;
+class Camera;
 
 namespace dw
 {
-	struct Node;
-	
+	struct CullView;
+
+	// A patch chosen by LOD selection. Stored by value in the patch list.
 	struct Node
 	{
 		float max_height;
@@ -19,16 +20,52 @@ namespace dw
 		float z_pos;
 		float size;
 		float current_range;
+		int	  lod_level;
 		bool  full_resolution;
-		Node* top_left;
-		Node* top_right;
-		Node* bottom_left;
-		Node* bottom_right;
-
-		Node(HeightMap* heightMap, float node_size, int lod_depth, float x, float z, float height_scale);
-		~Node();
-		bool lod_select(std::vector<float>& ranges, int lod_level, Camera *camera, std::vector<Node*>& sdraw_stack, dd::Renderer* debug_renderer = nullptr);
-		bool in_sphere(float radius, glm::vec3 position);
-		bool in_frustum(Camera *camera);
+	};
+
+	// Work done by a selection pass. A node is culled by the sphere when it is out of its LOD range, in which case its
+	// parent covers it at half resolution, or by the frustum when it is in range but not visible.
+	struct SelectionCounters
+	{
+		uint32_t nodes_visited;
+		uint32_t sphere_culled;
+		uint32_t frustum_culled;
+	};
+
+	// Linearized quadtree forest. Every root subtree is stored breadth-first in one contiguous block, so a node's
+	// children are four consecutive entries and can be addressed with a 16-bit offset from the root. Bounds are
+	// kept as separate arrays to keep the selection loop's working set small.
+	class Quadtree
+	{
+	public:
+		Quadtree();
+		~Quadtree();
+		bool build(HeightMap* height_map, float root_size, int lod_depth, int grid_width, int grid_height, float height_scale, float texel_scale);
+		void lod_select(std::vector<float>& ranges, Camera* camera, std::vector<Node>& patches);
+		void lod_select(std::vector<float>& ranges, const CullView& view, std::vector<Node>& patches);
+		// If slack is given it is lowered to the distance the view can be translated, without rotating, before any test
+		// made for this root changes its result. Until then the selection of the root stays the same.
+		// If counters are given they are incremented, not reset.
+		void lod_select_root(int root, std::vector<float>& ranges, const CullView& view, std::vector<Node>& patches, float* slack = nullptr, SelectionCounters* counters = nullptr);
+		inline int root_count() { return m_root_count; }
+		inline int lod_depth() { return m_lod_depth; }
+		inline uint32_t node_count() { return uint32_t(m_x_pos.size()); }
+
+	private:
+		// The range and frustum tests for a node are done by its parent, four siblings at a time.
+		bool lod_select(uint32_t base, uint16_t local, int lod_level, bool in_range, bool in_frustum, bool in_next_range, std::vector<float>& ranges, const CullView& view, std::vector<Node>& patches, float* slack, SelectionCounters* counters);
+		Node make_patch(uint32_t idx, int lod_level, float range, bool full_resolution);
+
+	private:
+		int m_lod_depth;
+		int m_root_count;
+		uint32_t m_nodes_per_root;
+		std::vector<float> m_level_size;
+		std::vector<float> m_x_pos;
+		std::vector<float> m_z_pos;
+		std::vector<float> m_min_height;
+		std::vector<float> m_max_height;
+		std::vector<uint16_t> m_first_child; // Offset from the owning root, 0 for leaves.
 	};
 }
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+#include "terrain_patch.h"
+
+// Average cache miss ratio: vertex shader invocations per triangle with a FIFO post-transform cache.
+float acmr(const uint16_t* indices, int index_count, int cache_size)
+{
+	std::deque<uint16_t> cache;
+	int misses = 0;
+
+	for (int i = 0; i < index_count; i++)
+	{
+		if (std::find(cache.begin(), cache.end(), indices[i]) != cache.end())
+			continue;
+
+		misses++;
+		cache.push_back(indices[i]);
+
+		if (int(cache.size()) > cache_size)
+			cache.pop_front();
+	}
+
+	return float(misses) / float(index_count / 3);
+}
+
+template <int N, int Stripe>
+void report(const char* name)
+{
+	static constexpr PatchGrid<N, Stripe> grid = PatchGrid<N, Stripe>();
+
+	std::cout << name << " " << N << "x" << N << " stripe " << Stripe << " :";
+
+	int cache_sizes[] = { 16, 24, 32 };
+
+	for (int cache_size : cache_sizes)
+		std::cout << " " << acmr(grid.indices, PatchGrid<N, Stripe>::index_count, cache_size) << " (" << cache_size << ")";
+
+	std::cout << std::endl;
+}
+
+// Reports ACMR of the patch index orders for a few FIFO cache sizes. 0.5 is the limit for a regular grid.
+int main()
+{
+	report<32, 32>("Row order");
+	report<32, 6>("Stripes  ");
+	report<32, 7>("Stripes  ");
+	report<32, 8>("Stripes  ");
+	report<16, 16>("Row order");
+	report<16, 6>("Stripes  ");
+	report<16, 7>("Stripes  ");
+	report<16, 8>("Stripes  ");
+
+	// Previously vec3 float positions and 32-bit indices.
+	int vertex_count = PatchGrid<32>::vertex_count;
+	int index_count = PatchGrid<32>::index_count;
+
+	std::cout << "32x32 patch bytes: " << vertex_count * 12 + index_count * 4 << " -> " << sizeof(PatchGrid<32>) << std::endl;
+
+	return 0;
+}
\ No newline at end of file
@@ -1,56 +1,92 @@
 #include "terrain.h"
 #include "heightmap.h"
+#include "tiled_heightmap.h"
 #include "node.h"
 #include "terrain_patch.h"
+#include <common/thread_pool.h>
+#include "terrain_culling.h"
+#include "terrain_instancing.h"
+#include "terrain_mesher.h"
+#include <common/uniform_ring_buffer.h>
 
 #include <utility.h>
 #include <render_device.h>
 #include <logger.h>
 #include <camera.h>
+#include <stddef.h>
+#include <float.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
 
 namespace dw
 {
-	Terrain::Terrain(std::string file, int size, int lod_depth, float scale, float far_plane, RenderDevice* device)
+	inline float elapsed_ms(const std::chrono::high_resolution_clock::time_point& start)
 	{
+		return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	Terrain::Terrain() : m_height_map(nullptr), m_device(nullptr), m_quadtree(nullptr), m_query(nullptr), m_vs(nullptr), m_fs(nullptr), m_program(nullptr), m_rs(nullptr), m_ds(nullptr),
+		m_uniform_ring(nullptr), m_full_patch(nullptr), m_half_patch(nullptr), m_sampler(nullptr), m_thread_pool(nullptr)
+	{
+
+	}
+
+	Terrain::~Terrain()
+	{
+		shutdown();
+	}
+
+	bool Terrain::initialize(const TerrainDesc& desc, RenderDevice* device)
+	{
+		shutdown();
+
 		m_device = device;
-		m_lod_depth = lod_depth;
+		m_lod_depth = desc.lod_count;
+		m_patch_resolution = desc.patch_resolution;
 		m_leaf_node_size = 1.0f;
+		m_world_width = desc.world_width;
+		m_world_depth = desc.world_depth;
+		m_height_scale = desc.height_scale;
 
-		m_full_patch = new TerrainPatch(32, 32, m_device);
-		m_half_patch = new TerrainPatch(16, 16, m_device);
+		m_full_patch = TerrainPatch::create(m_patch_resolution, m_device);
+		m_half_patch = TerrainPatch::create(m_patch_resolution / 2, m_device);
 
-		float view_distance_split = far_plane / m_lod_depth;
+		desc.lod_ranges(m_ranges);
 
-		std::vector<float> temp_ranges;
-		
-		m_ranges.resize(lod_depth);
-		m_ranges[lod_depth - 1] = far_plane / 2.0f;
+		m_height_map = new HeightMap();
 
-		for (int i = (lod_depth - 2); i >= 0 ; i--)
+		if (!m_height_map->initialize(desc, device))
 		{
-			m_ranges[i] = m_ranges[i + 1] / 2.0f;
+			LOG_ERROR("Failed to load terrain heightmap");
+			shutdown();
+			return false;
 		}
 
-		m_height_map = new HeightMap();
-		m_height_map->initialize(file, size, size, device);
+		// Tiled heightmaps report their own size, so the texel scale is only known after loading.
+		m_texel_scale = float(m_height_map->width()) / desc.world_width;
 
-		float rootNodeSize = 1024.0f;// m_leaf_node_size * pow(2, m_lod_depth - 1);
+		m_query = new TerrainQuery(m_height_map, m_texel_scale, desc.height_scale);
+		m_quadtree = new Quadtree();
 
-		int gridWidth = floor(16384.0f / rootNodeSize);
-		int gridHeight = floor(16384.0f / rootNodeSize);
-
-		m_grid.resize(gridWidth);
-		for (int i = 0; i < gridWidth; i++) 
+		if (!m_quadtree->build(m_height_map, desc.root_size, m_lod_depth, desc.grid_width(), desc.grid_depth(), desc.height_scale, m_texel_scale))
 		{
-			m_grid[i].resize(gridHeight);
-			for (int j = 0; j < gridHeight; j++) 
-			{
-				float xPos = i * rootNodeSize;
-				float zPos = j * rootNodeSize;
-				m_grid[i][j] = new Node(m_height_map, rootNodeSize, m_lod_depth, xPos, zPos, scale);
-			}
+			LOG_ERROR("Failed to build terrain quadtree");
+			shutdown();
+			return false;
 		}
 
+		m_thread_pool = new ThreadPool();
+		m_root_patches.resize(m_quadtree->root_count());
+		m_root_slack.resize(m_quadtree->root_count());
+		m_root_position.resize(m_quadtree->root_count());
+		m_root_counters.resize(m_quadtree->root_count());
+		m_root_reselected.resize(m_quadtree->root_count());
+		m_selection_valid = false;
+		m_reselected_roots = 0;
+
+		DW_ZERO_MEMORY(m_stats);
+
 		std::string vs_str;
 		Utility::ReadText("shader/terrain_vs.glsl", vs_str);
 
@@ -62,8 +98,9 @@ namespace dw
 
 		if (!m_vs || !m_fs)
 		{
-			LOG_FATAL("Failed to create Shaders");
-			return;
+			LOG_ERROR("Failed to create Shaders");
+			shutdown();
+			return false;
 		}
 
 		Shader* shaders[] = { m_vs, m_fs };
@@ -88,22 +125,14 @@ namespace dw
 
 		m_ds = m_device->create_depth_stencil_state(ds_desc);
 
-		BufferCreateDesc uboDesc;
-		DW_ZERO_MEMORY(uboDesc);
-		uboDesc.data = nullptr;
-		uboDesc.data_type = DataType::FLOAT;
-		uboDesc.size = 256 * 1024;
-		uboDesc.usage_type = BufferUsageType::DYNAMIC;
-
-		m_terrain_ubo = m_device->create_uniform_buffer(uboDesc);
-
-		DW_ZERO_MEMORY(uboDesc);
-		uboDesc.data = nullptr;
-		uboDesc.data_type = DataType::FLOAT;
-		uboDesc.size = sizeof(PerFrameUniform);
-		uboDesc.usage_type = BufferUsageType::DYNAMIC;
+		m_uniform_ring = new UniformRingBuffer();
 
-		m_camera_ubo = m_device->create_uniform_buffer(uboDesc);
+		if (!m_uniform_ring->initialize(TERRAIN_UNIFORM_RING_SIZE))
+		{
+			LOG_ERROR("Failed to create terrain uniform ring");
+			shutdown();
+			return false;
+		}
 
 		SamplerStateCreateDesc ssDesc;
 		DW_ZERO_MEMORY(ssDesc);
@@ -115,99 +144,162 @@ namespace dw
 		ssDesc.wrap_mode_w = TextureWrapMode::CLAMP_TO_EDGE;
 
 		m_sampler = m_device->create_sampler_state(ssDesc);
-		//m_root = new Node(m_height_map, size, m_lod_depth - 1, 0, 0, 100.0f);
+
+		return true;
 	}
 
-	Terrain::~Terrain()
+	void Terrain::shutdown()
 	{
-		m_device->destroy(m_sampler);
-		m_device->destroy(m_camera_ubo);
-		m_device->destroy(m_terrain_ubo);
-		m_device->destroy(m_program);
-		m_device->destroy(m_vs);
-		m_device->destroy(m_fs);
+		delete m_uniform_ring;
+		m_uniform_ring = nullptr;
 
-		for (unsigned int i = 0; i < m_grid.size(); i++) 
-		{
-			for (unsigned int j = 0; j < m_grid[0].size(); j++) 
-			{
-				delete m_grid[i][j];
-			}
-		}
+		if (m_sampler)
+			m_device->destroy(m_sampler);
+
+		if (m_program)
+			m_device->destroy(m_program);
+
+		if (m_vs)
+			m_device->destroy(m_vs);
+
+		if (m_fs)
+			m_device->destroy(m_fs);
+
+		if (m_rs)
+			m_device->destroy(m_rs);
 
+		if (m_ds)
+			m_device->destroy(m_ds);
+
+		m_sampler = nullptr;
+		m_program = nullptr;
+		m_vs = nullptr;
+		m_fs = nullptr;
+		m_rs = nullptr;
+		m_ds = nullptr;
+
+		delete m_thread_pool;
+		delete m_quadtree;
+		delete m_query;
 		delete m_height_map;
 		delete m_half_patch;
 		delete m_full_patch;
+
+		m_thread_pool = nullptr;
+		m_quadtree = nullptr;
+		m_query = nullptr;
+		m_height_map = nullptr;
+		m_half_patch = nullptr;
+		m_full_patch = nullptr;
 	}
 
-	void Terrain::render(Camera* lod_camera, Camera* draw_camera, int width, int height, dd::Renderer* debug_renderer)
+	void Terrain::select(Camera* lod_camera, std::vector<Node>& patches)
 	{
-		m_patch_list.clear();
+		patches.clear();
 
-		// Select Nodes
-		for (unsigned int i = 0; i < m_grid.size(); i++) 
+		CullView view = CullView::from_camera(lod_camera);
+
+		// A pure translation leaves the plane normals untouched, anything else invalidates all cached roots.
+		bool reuse = m_coherent_selection && m_selection_valid;
+
+		for (int i = 0; i < 6 && reuse; i++)
+			reuse = glm::vec3(view.planes[i]) == glm::vec3(m_cached_planes[i]);
+
+		for (int i = 0; i < 6; i++)
+			m_cached_planes[i] = view.planes[i];
+
+		m_selection_valid = m_coherent_selection;
+		m_reselected_roots = 0;
+
+		if (!m_parallel_selection || m_thread_pool->worker_count() == 0)
+		{
+			for (int root = 0; root < m_quadtree->root_count(); root++)
+				select_root(root, view, reuse);
+		}
+		else
 		{
-			for (unsigned int j = 0; j < m_grid[0].size(); j++) 
+			m_thread_pool->parallel_for(m_quadtree->root_count(), [&](int root)
 			{
-				m_grid[i][j]->lod_select(m_ranges, m_lod_depth - 1, lod_camera, m_patch_list, debug_renderer);
-			}
+				select_root(root, view, reuse);
+			});
 		}
 
-		assert(m_patch_list.size() < MAX_PATCHES);
+		for (auto& root_patches : m_root_patches)
+			patches.insert(patches.end(), root_patches.begin(), root_patches.end());
 
-		std::cout << m_patch_list.size() << std::endl;
+		count_terrain_patches(patches, m_lod_depth, m_patch_resolution, m_stats);
 
-		// Update Uniforms
-		m_per_frame.view = draw_camera->m_view;
-		m_per_frame.proj = draw_camera->m_projection;
-		m_per_frame.pos = glm::vec4(lod_camera->m_position.x, lod_camera->m_position.y, lod_camera->m_position.z, 0.0f);
+		m_stats.nodes_visited = 0;
+		m_stats.sphere_culled = 0;
+		m_stats.frustum_culled = 0;
+		m_stats.reselected_roots = m_reselected_roots;
 
-		char* ptr = (char*)m_device->map_buffer(m_camera_ubo, BufferMapType::WRITE);
-		memcpy(ptr, &m_per_frame, sizeof(PerFrameUniform));
-		m_device->unmap_buffer(m_camera_ubo);
+		// Reused roots did no work this frame, but their culling results are still part of the selection.
+		for (int root = 0; root < m_quadtree->root_count(); root++)
+		{
+			m_stats.nodes_visited += m_root_reselected[root] ? m_root_counters[root].nodes_visited : 0;
+			m_stats.sphere_culled += m_root_counters[root].sphere_culled;
+			m_stats.frustum_culled += m_root_counters[root].frustum_culled;
+		}
+	}
 
-		ptr = (char*)m_device->map_buffer(m_terrain_ubo, BufferMapType::WRITE);
+	void Terrain::select_root(int root, const CullView& view, bool reuse)
+	{
+		m_root_reselected[root] = 0;
 
-		for (int i = 0; i < m_patch_list.size(); i++)
-		{
-			Node* node = m_patch_list[i];
-			char* current_ptr = ptr + 256 * i;
+		if (reuse && glm::length(view.position - m_root_position[root]) < m_root_slack[root])
+			return;
 
-			glm::vec3 translation = glm::vec3(node->x_pos, 0.0f, node->z_pos);
-			glm::vec3 grid_dim = node->full_resolution ? glm::vec3(32, 32, 0) : glm::vec3(16, 16, 0);
-			float scale = node->size;
-			float range = node->current_range;
+		float slack = FLT_MAX;
 
-			glm::vec4 color = glm::vec4(0.5, 0.5, 0.5, 1.0);
-			if (range == m_ranges[0])
-			{
-				color = glm::vec4(1.0);
-			}
-			else if (range == m_ranges[1])
-			{
-				color = glm::vec4(0.0, 1.0, 0.0, 1.0);
-			}
-			else if (range == m_ranges[2])
-			{
-				color = glm::vec4(0.0, 0.0, 1.0, 1.0);
-			}
-			else if (range == m_ranges[3])
-			{
-				color = glm::vec4(1.0, 1.0, 0.0, 1.0);
-			}
-			else if (range == m_ranges[4])
-			{
-				color = glm::vec4(0.8, 0.5, 0.2, 1.0);
-			}
+		m_root_patches[root].clear();
+		memset(&m_root_counters[root], 0, sizeof(SelectionCounters));
+		m_quadtree->lod_select_root(root, m_ranges, view, m_root_patches[root], m_coherent_selection ? &slack : nullptr, &m_root_counters[root]);
 
-			m_uniforms[i].translation_range = glm::vec4(translation.x, translation.y, translation.z, range);
-			m_uniforms[i].griddim_scale = glm::vec4(grid_dim.x, grid_dim.y, scale, 0.0f);
-			m_uniforms[i].color = color;
+		// Leave some room for rounding in the margins.
+		m_root_slack[root] = slack - TERRAIN_COHERENCE_EPSILON;
+		m_root_position[root] = view.position;
+		m_root_reselected[root] = 1;
+		m_reselected_roots++;
+	}
 
-			memcpy(current_ptr, &m_uniforms[i], sizeof(TerrainUniforms));
+	void Terrain::render(Camera* lod_camera, Camera* draw_camera, int width, int height, dd::Renderer* debug_renderer)
+	{
+		// Select Nodes
+		auto select_start = std::chrono::high_resolution_clock::now();
+
+		select(lod_camera, m_patch_list);
+
+		m_stats.selection_ms = elapsed_ms(select_start);
+
+		auto upload_start = std::chrono::high_resolution_clock::now();
+
+		if (m_height_map->is_tiled())
+			update_residency();
+
+		// Update Uniforms
+		m_per_frame.view = draw_camera->m_view;
+		m_per_frame.proj = draw_camera->m_projection;
+		m_per_frame.pos = glm::vec4(lod_camera->m_position.x, lod_camera->m_position.y, lod_camera->m_position.z, TERRAIN_MORPH_START);
+		m_per_frame.height_map = glm::vec4(m_height_map->width(), m_height_map->height(), m_texel_scale, m_height_scale);
+		m_per_frame.tiling = glm::vec4(0.0f);
+
+		if (m_height_map->is_tiled())
+			m_per_frame.tiling = glm::vec4(1.0f, m_height_map->tiled()->tile_size(), m_height_map->tiled()->border(), 0.0f);
+
+		void* ptr;
+		size_t camera_offset = m_uniform_ring->allocate(sizeof(PerFrameUniform), &ptr);
+
+		if (camera_offset == UNIFORM_RING_INVALID_OFFSET)
+		{
+			LOG_ERROR("Terrain uniform ring is too small");
+			return;
 		}
 
-		m_device->unmap_buffer(m_terrain_ubo);
+		memcpy(ptr, &m_per_frame, sizeof(PerFrameUniform));
+
+		// The patch uniforms or instances are uploaded by the render path and add to this.
+		m_stats.upload_ms = elapsed_ms(upload_start);
 
 		m_device->bind_framebuffer(nullptr);
 		m_device->set_viewport(width, height, 0, 0);
@@ -218,22 +310,155 @@ namespace dw
 		m_device->bind_depth_stencil_state(m_ds);
 		m_device->bind_shader_program(m_program);
 		m_device->set_primitive_type(PrimitiveType::TRIANGLES);
-		m_device->bind_uniform_buffer(m_camera_ubo, ShaderType::VERTEX, 0);
+		m_uniform_ring->bind_uniform(0, camera_offset, sizeof(PerFrameUniform));
 		m_device->bind_sampler_state(m_sampler, ShaderType::VERTEX, 0);
-		m_device->bind_texture(m_height_map->texture(), ShaderType::VERTEX, 0);
+
+		// Samplers of different types can't share a unit, so the tiled textures get units of their own.
+		if (m_height_map->is_tiled())
+		{
+			// The vertex shader looks up the slice of a tile in the page table with texelFetch, then samples the tile array.
+			m_device->bind_sampler_state(m_sampler, ShaderType::VERTEX, 1);
+			m_device->bind_texture(m_height_map->tile_array(), ShaderType::VERTEX, 1);
+			m_device->bind_sampler_state(m_sampler, ShaderType::VERTEX, 2);
+			m_device->bind_texture(m_height_map->page_table(), ShaderType::VERTEX, 2);
+		}
+		else
+			m_device->bind_texture(m_height_map->texture(), ShaderType::VERTEX, 0);
+
+		if (m_instanced_rendering)
+			render_instanced();
+		else
+			render_patches();
+
+		// Everything written this frame stays untouched until the GPU is done with these draws.
+		m_uniform_ring->end_frame();
+
+		m_stats_log.record(m_stats);
+		m_stats.frame++;
+	}
+
+	bool Terrain::write_lod_heatmap(const std::string& file, int image_width)
+	{
+		return dw::write_lod_heatmap(file, m_patch_list, m_lod_depth, m_world_width, m_world_depth, image_width);
+	}
+
+	void Terrain::update_residency()
+	{
+		uint64_t dropped = m_height_map->tiled()->dropped_requests();
+
+		// Page in the tiles under every selected patch. The geomorph reads one texel past the patch edge.
+		for (auto& node : m_patch_list)
+		{
+			int x = int(node.x_pos * m_texel_scale);
+			int z = int(node.z_pos * m_texel_scale);
+			int size = int(ceil(node.size * m_texel_scale)) + 1;
+
+			m_height_map->request_region(x, z, size, size);
+		}
+
+		if (dropped == 0 && m_height_map->tiled()->dropped_requests() > 0)
+			LOG_ERROR("Terrain selection needs more than HEIGHTMAP_RESIDENT_TILES tiles, the rest render flat");
+
+		m_height_map->update_residency();
+	}
+
+	void Terrain::render_patches()
+	{
+		assert(m_patch_list.size() < MAX_PATCHES);
+
+		auto upload_start = std::chrono::high_resolution_clock::now();
+
+		size_t stride = m_uniform_ring->ring().aligned_size(sizeof(TerrainUniforms));
+		char* ptr;
+		size_t base_offset = m_uniform_ring->allocate(stride * m_patch_list.size(), (void**)&ptr);
+
+		if (base_offset == UNIFORM_RING_INVALID_OFFSET)
+		{
+			LOG_ERROR("Terrain uniform ring is too small");
+			return;
+		}
+
+		for (int i = 0; i < m_patch_list.size(); i++)
+		{
+			Node& node = m_patch_list[i];
+			char* current_ptr = ptr + stride * i;
+
+			glm::vec3 translation = glm::vec3(node.x_pos, 0.0f, node.z_pos);
+			float grid = float(patch_grid_dim(node, m_patch_resolution));
+			glm::vec3 grid_dim = glm::vec3(grid, grid, 0);
+			float scale = node.size;
+			float range = node.current_range;
+
+			m_uniforms[i].translation_range = glm::vec4(translation.x, translation.y, translation.z, range);
+			m_uniforms[i].griddim_scale = glm::vec4(grid_dim.x, grid_dim.y, scale, 0.0f);
+			m_uniforms[i].color = lod_color(range, m_ranges);
+
+			memcpy(current_ptr, &m_uniforms[i], sizeof(TerrainUniforms));
+		}
+
+		m_stats.upload_ms += elapsed_ms(upload_start);
 
 		// Draw
 		for (int i = 0; i < m_patch_list.size(); i++)
 		{
-			Node* node = m_patch_list[i];
 			TerrainPatch* patch = m_half_patch;
 
-			if (node->full_resolution)
+			if (m_patch_list[i].full_resolution)
 				patch = m_full_patch;
 
-			m_device->bind_uniform_buffer_range(m_terrain_ubo, ShaderType::VERTEX, 1, 256 * i, sizeof(TerrainUniforms));
+			m_uniform_ring->bind_uniform(1, base_offset + stride * i, sizeof(TerrainUniforms));
 			m_device->bind_vertex_array(patch->m_vao);
 			m_device->draw_indexed(patch->m_index_count);
 		}
 	}
+
+	void Terrain::render_instanced()
+	{
+		auto upload_start = std::chrono::high_resolution_clock::now();
+
+		uint32_t full_count = pack_terrain_instances(m_patch_list, m_ranges, m_instances);
+		uint32_t half_count = uint32_t(m_instances.size()) - full_count;
+
+		// Only the grid dimensions are per draw. Everything else comes from the instance stream, which lives in the
+		// same ring. A w of one in griddim_scale tells the vertex shader to read the patch from the stream.
+		size_t stride = m_uniform_ring->ring().aligned_size(sizeof(TerrainUniforms));
+		size_t size = sizeof(TerrainInstance) * m_instances.size();
+		char* ptr;
+		char* instance_ptr;
+		size_t uniform_offset = m_uniform_ring->allocate(2 * stride, (void**)&ptr);
+		size_t instance_offset = m_uniform_ring->allocate(std::max(size, sizeof(TerrainInstance)), (void**)&instance_ptr);
+
+		if (uniform_offset == UNIFORM_RING_INVALID_OFFSET || instance_offset == UNIFORM_RING_INVALID_OFFSET)
+		{
+			LOG_ERROR("Terrain uniform ring is too small");
+			return;
+		}
+
+		TerrainUniforms uniforms;
+		uniforms.translation_range = glm::vec4(0.0f);
+		uniforms.color = glm::vec4(1.0f);
+
+		uniforms.griddim_scale = glm::vec4(m_full_patch->m_grid_dim, m_full_patch->m_grid_dim, 1.0f, 1.0f);
+		memcpy(ptr, &uniforms, sizeof(TerrainUniforms));
+
+		uniforms.griddim_scale = glm::vec4(m_half_patch->m_grid_dim, m_half_patch->m_grid_dim, 1.0f, 1.0f);
+		memcpy(ptr + stride, &uniforms, sizeof(TerrainUniforms));
+
+		if (size > 0)
+			memcpy(instance_ptr, &m_instances[0], size);
+
+		m_stats.upload_ms += elapsed_ms(upload_start);
+
+		if (full_count > 0)
+		{
+			m_uniform_ring->bind_uniform(1, uniform_offset, sizeof(TerrainUniforms));
+			m_full_patch->draw_instanced(m_uniform_ring->buffer(), instance_offset, full_count);
+		}
+
+		if (half_count > 0)
+		{
+			m_uniform_ring->bind_uniform(1, uniform_offset + stride, sizeof(TerrainUniforms));
+			m_half_patch->draw_instanced(m_uniform_ring->buffer(), instance_offset + sizeof(TerrainInstance) * full_count, half_count);
+		}
+	}
 }
\ No newline at end of file
@@ -2,9 +2,15 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 #include <glm.hpp>
 #include <Macros.h>
 #include <debug_draw.h>
+#include "terrain_instancing.h"
+#include "terrain_desc.h"
+#include "terrain_query.h"
+#include "terrain_stats.h"
+#include "node.h"
 
 class Camera;
 class HeightMap;
@@ -14,14 +20,18 @@ struct Shader;
 struct ShaderProgram;
 struct RasterizerState;
 struct DepthStencilState;
-struct UniformBuffer;
 struct SamplerState;
 
 #define MAX_PATCHES 2048
+#define TERRAIN_COHERENCE_EPSILON 0.01f
+#define TERRAIN_UNIFORM_RING_SIZE (4 * 1024 * 1024)
 
 namespace dw
 {
-	struct Node;
+	class Quadtree;
+	class ThreadPool;
+	class UniformRingBuffer;
+	struct CullView;
 
 	struct DW_ALIGNED(16) TerrainUniforms
 	{
@@ -34,7 +44,9 @@ namespace dw
 	{
 		glm::mat4 view;
 		glm::mat4 proj;
-		glm::vec4 pos;
+		glm::vec4 pos;		  // w: morph start
+		glm::vec4 height_map; // xy: size in texels, z: texels per world unit, w: height scale
+		glm::vec4 tiling;	  // x: 1 if the heightmap is tiled, y: tile size, z: tile border
 	};
 
 	class Terrain
@@ -42,14 +54,14 @@ namespace dw
 	private:
 		HeightMap * m_height_map;
 		RenderDevice* m_device;
-		Node* m_root;
+		Quadtree* m_quadtree;
+		TerrainQuery* m_query;
 		Shader* m_vs;
 		Shader* m_fs;
 		ShaderProgram* m_program;
 		RasterizerState* m_rs;
 		DepthStencilState* m_ds;
-		UniformBuffer* m_terrain_ubo;
-		UniformBuffer* m_camera_ubo;
+		UniformRingBuffer* m_uniform_ring;
 		TerrainUniforms m_uniforms[MAX_PATCHES];
 		PerFrameUniform m_per_frame;
 		TerrainPatch* m_full_patch;
@@ -57,13 +69,64 @@ namespace dw
 		SamplerState* m_sampler;
 		int m_lod_depth;
 		int  m_leaf_node_size;
+		int m_patch_resolution;
+		float m_texel_scale;
+		float m_height_scale;
 		std::vector<float> m_ranges;
-		std::vector<Node*> m_patch_list;
-		std::vector< std::vector<Node*> > m_grid;
+		std::vector<Node> m_patch_list;
+		ThreadPool* m_thread_pool;
+		std::vector< std::vector<Node> > m_root_patches;
+		std::vector<float> m_root_slack;
+		std::vector<glm::vec3> m_root_position;
+		glm::vec4 m_cached_planes[6];
+		bool m_selection_valid;
+		std::atomic<int> m_reselected_roots;
+		std::vector<SelectionCounters> m_root_counters;
+		std::vector<uint8_t> m_root_reselected;
+		float m_world_width;
+		float m_world_depth;
+		TerrainStats m_stats;
+		TerrainStatsLog m_stats_log;
+		std::vector<TerrainInstance> m_instances;
 
 	public:
-		Terrain(std::string file, int size, int lod_depth, float scale, float far_plane, RenderDevice* device);
+		// Select roots on the worker pool. Per-root results are merged in root order, so the output matches the serial path.
+		bool m_parallel_selection = true;
+		// Reuse the previous selection of every root the camera has not moved far enough to change. Rotating the
+		// camera, or changing its projection, reselects everything.
+		bool m_coherent_selection = true;
+		// Submit all patches of a type as one instanced draw instead of one draw per patch. Lifts the MAX_PATCHES limit.
+		bool m_instanced_rendering = true;
+
+		Terrain();
 		~Terrain();
+		// Returns false, with everything released again, if the heightmap, quadtree or GPU resources fail.
+		bool initialize(const TerrainDesc& desc, RenderDevice* device);
+		void shutdown();
+		void select(Camera* lod_camera, std::vector<Node>& patches);
 		void render(Camera* lod_camera, Camera* draw_camera, int width, int height, dd::Renderer* debug_renderer);
+		inline uint32_t patch_count() { return uint32_t(m_patch_list.size()); }
+		inline int reselected_roots() { return m_reselected_roots; }
+		inline void invalidate_selection() { m_selection_valid = false; }
+		// Statistics of the last rendered frame. Selection statistics are also updated by select().
+		inline const TerrainStats& stats() { return m_stats; }
+		// Log the stats of every interval-th frame to CSV, or JSON lines if the file ends in ".json". See TerrainStatsLog.
+		inline bool open_stats_log(const std::string& file, int interval = 1) { return m_stats_log.open(file, interval); }
+		inline void close_stats_log() { m_stats_log.close(); }
+		// Top-down image of the last selection, see dw::write_lod_heatmap().
+		bool write_lod_heatmap(const std::string& file, int image_width);
+
+		// CPU queries against the terrain surface, see TerrainQuery.
+		inline float height_at(float x, float z) { return m_query->height_at(x, z); }
+		inline glm::vec3 normal_at(float x, float z) { return m_query->normal_at(x, z); }
+		inline void heights_at(const float* x, const float* z, float* heights, uint32_t count) { m_query->heights_at(x, z, heights, count); }
+		inline bool raycast(const glm::vec3& origin, const glm::vec3& dir, float max_distance, TerrainHit& hit) { return m_query->raycast(origin, dir, max_distance, hit); }
+		inline TerrainQuery* query() { return m_query; }
+
+	private:
+		void select_root(int root, const CullView& view, bool reuse);
+		void update_residency();
+		void render_patches();
+		void render_instanced();
 	};
 }
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <string>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <gtc/matrix_transform.hpp>
+
+#include "heightmap.h"
+#include "node.h"
+#include "terrain_culling.h"
+#include "terrain_mesher.h"
+#include "terrain_desc.h"
+
+#define FAR_PLANE 10000.0f
+#define ORBIT_FRAMES 240
+#define SYNTHETIC_HEIGHTMAP "benchmark_heightmap.r16"
+#define SYNTHETIC_SIZE 1024
+#define CRACK_EPSILON 0.01f
+
+struct CameraKey
+{
+	glm::vec3 position;
+	glm::vec3 direction;
+};
+
+// One key per line: px py pz dx dy dz
+bool load_camera_path(const std::string& file, std::vector<CameraKey>& keys)
+{
+	std::ifstream f(file);
+
+	if (!f.is_open())
+		return false;
+
+	CameraKey key;
+
+	while (f >> key.position.x >> key.position.y >> key.position.z >> key.direction.x >> key.direction.y >> key.direction.z)
+		keys.push_back(key);
+
+	return keys.size() > 0;
+}
+
+void orbit_camera_path(const dw::TerrainDesc& desc, std::vector<CameraKey>& keys)
+{
+	glm::vec3 center = glm::vec3(desc.world_width * 0.5f, 0.0f, desc.world_depth * 0.5f);
+
+	for (int i = 0; i < ORBIT_FRAMES; i++)
+	{
+		float angle = 2.0f * 3.14159265f * float(i) / float(ORBIT_FRAMES);
+
+		CameraKey key;
+		key.position = center + glm::vec3(cos(angle), 0.0f, sin(angle)) * (glm::min(desc.world_width, desc.world_depth) * 0.3f) + glm::vec3(0.0f, 100.0f, 0.0f);
+		key.direction = glm::vec3(-sin(angle), -0.2f, cos(angle));
+
+		keys.push_back(key);
+	}
+}
+
+// Sum of sines, so the benchmark can run without any data.
+bool write_synthetic_heightmap(const std::string& file, int size)
+{
+	std::vector<uint16_t> data(size * size);
+
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			float h = 0.5f + 0.25f * sin(x * 0.013f) * cos(y * 0.017f) + 0.125f * sin(x * 0.071f + y * 0.053f);
+			data[size * y + x] = uint16_t(glm::clamp(h, 0.0f, 1.0f) * 65535.0f);
+		}
+	}
+
+	FILE* f = fopen(file.c_str(), "wb");
+
+	if (!f)
+		return false;
+
+	bool success = fwrite(&data[0], sizeof(uint16_t), data.size(), f) == data.size();
+	fclose(f);
+
+	return success;
+}
+
+// Replays a camera path through LOD selection and the CPU reference mesher, then checks every frame for cracks.
+// Usage: 2_cdlod_terrain_benchmark [terrain.json] [camera_path.txt]
+int main(int argc, const char* argv[])
+{
+	dw::TerrainDesc desc;
+	desc.max_range = FAR_PLANE / 2.0f;
+
+	if (argc > 1)
+	{
+		if (!dw::TerrainDesc::load(argv[1], desc))
+			return 1;
+	}
+	else
+	{
+		desc.heightmap = SYNTHETIC_HEIGHTMAP;
+		desc.heightmap_width = SYNTHETIC_SIZE;
+		desc.heightmap_height = SYNTHETIC_SIZE;
+
+		if (!write_synthetic_heightmap(desc.heightmap, SYNTHETIC_SIZE))
+		{
+			std::cout << "Failed to write synthetic heightmap" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<CameraKey> keys;
+
+	if (argc > 2)
+	{
+		if (!load_camera_path(argv[2], keys))
+		{
+			std::cout << "Failed to load camera path" << std::endl;
+			return 1;
+		}
+	}
+	else
+		orbit_camera_path(desc, keys);
+
+	HeightMap height_map;
+
+	if (!height_map.initialize(desc, nullptr))
+	{
+		std::cout << "Failed to load heightmap" << std::endl;
+		return 1;
+	}
+
+	dw::TerrainMeshParams params;
+	params.height_scale = desc.height_scale;
+	params.texel_scale = float(height_map.width()) / desc.world_width;
+	params.morph_start = TERRAIN_MORPH_START;
+	params.patch_resolution = desc.patch_resolution;
+
+	dw::Quadtree quadtree;
+
+	if (!quadtree.build(&height_map, desc.root_size, desc.lod_count, desc.grid_width(), desc.grid_depth(), desc.height_scale, params.texel_scale))
+		return 1;
+
+	std::vector<float> ranges;
+	desc.lod_ranges(ranges);
+
+	glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, FAR_PLANE);
+
+	std::vector<dw::Node> patches;
+	std::vector<glm::vec3> vertices;
+	std::vector<uint32_t> first_vertex;
+
+	double select_ms = 0.0;
+	double mesh_ms = 0.0;
+	uint64_t total_patches = 0;
+	uint64_t total_vertices = 0;
+	uint64_t t_junctions = 0;
+	uint64_t cracks = 0;
+	int bad_frames = 0;
+	float max_gap = 0.0f;
+
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		const CameraKey& key = keys[i];
+
+		// Keep the camera above the ground, like a fly camera would.
+		params.camera_position = key.position;
+		params.camera_position.y += dw::sample_height(&height_map, key.position.x, key.position.z, params);
+
+		glm::mat4 view = glm::lookAt(params.camera_position, params.camera_position + key.direction, glm::vec3(0.0f, 1.0f, 0.0f));
+		dw::CullView cull_view = dw::CullView::from_matrix(proj * view, params.camera_position);
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		patches.clear();
+		quadtree.lod_select(ranges, cull_view, patches);
+
+		auto mid = std::chrono::high_resolution_clock::now();
+
+		dw::mesh_terrain_patches(patches, &height_map, params, vertices, first_vertex);
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		select_ms += std::chrono::duration<double, std::milli>(mid - start).count();
+		mesh_ms += std::chrono::duration<double, std::milli>(end - mid).count();
+		total_patches += patches.size();
+		total_vertices += vertices.size();
+
+		dw::TerrainMeshErrors errors = dw::validate_terrain_mesh(patches, desc.patch_resolution, vertices, first_vertex, CRACK_EPSILON);
+
+		t_junctions += errors.t_junctions;
+		cracks += errors.cracks;
+		max_gap = glm::max(max_gap, errors.max_gap);
+
+		if (errors.cracks > 0)
+			bad_frames++;
+	}
+
+	double frames = double(keys.size());
+
+	std::cout << "Frames          : " << keys.size() << std::endl;
+	std::cout << "Patches / frame : " << total_patches / frames << std::endl;
+	std::cout << "Selection       : " << select_ms / frames << " ms / frame" << std::endl;
+	std::cout << "Meshing         : " << mesh_ms / frames << " ms / frame (" << total_vertices / (mesh_ms * 1000.0) << " M vertices / s)" << std::endl;
+	std::cout << "T-junctions     : " << t_junctions << std::endl;
+	std::cout << "Cracks          : " << cracks << " in " << bad_frames << " frames (max gap " << max_gap << ")" << std::endl;
+
+	height_map.shutdown();
+
+	return cracks == 0 ? 0 : 1;
+}
\ No newline at end of file
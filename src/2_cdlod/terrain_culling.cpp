@@ -0,0 +1,202 @@
+#include "terrain_culling.h"
+#include <camera.h>
+#include <float.h>
+#include <math.h>
+
+#if DW_SIMD
+#include <emmintrin.h>
+#endif
+
+namespace dw
+{
+	CullView CullView::from_camera(Camera* camera)
+	{
+		return from_matrix(camera->m_view_projection, camera->m_position);
+	}
+
+	CullView CullView::from_matrix(const glm::mat4& m, const glm::vec3& position)
+	{
+		CullView view;
+
+		view.position = position;
+
+		// Gribb/Hartmann plane extraction for a GL style [-1, 1] clip volume.
+		glm::vec4 row0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+		glm::vec4 row1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+		glm::vec4 row2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+		glm::vec4 row3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		view.planes[0] = row3 + row0; // Left
+		view.planes[1] = row3 - row0; // Right
+		view.planes[2] = row3 + row1; // Bottom
+		view.planes[3] = row3 - row1; // Top
+		view.planes[4] = row3 + row2; // Near
+		view.planes[5] = row3 - row2; // Far
+
+		return view;
+	}
+
+	inline float squared(float v) { return v * v; }
+
+	bool in_sphere_scalar(float x, float z, float size, float min_y, float max_y, const glm::vec3& s, float r)
+	{
+		float dist_squared = r * r;
+
+		if (s.x < x) dist_squared -= squared(x - s.x);
+		else if (s.x > x + size) dist_squared -= squared(s.x - (x + size));
+		if (s.y < min_y) dist_squared -= squared(min_y - s.y);
+		else if (s.y > max_y) dist_squared -= squared(s.y - max_y);
+		if (s.z < z) dist_squared -= squared(z - s.z);
+		else if (s.z > z + size) dist_squared -= squared(s.z - (z + size));
+
+		return dist_squared > 0;
+	}
+
+	bool in_frustum_scalar(float x, float z, float size, float min_y, float max_y, const CullView& view)
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& p = view.planes[i];
+
+			// Test the corner furthest along the plane normal.
+			float px = p.x >= 0.0f ? x + size : x;
+			float py = p.y >= 0.0f ? max_y : min_y;
+			float pz = p.z >= 0.0f ? z + size : z;
+
+			if (((p.x * px + p.y * py) + p.z * pz) + p.w < 0.0f)
+				return false;
+		}
+
+		return true;
+	}
+
+	float sphere_margin(float x, float z, float size, float min_y, float max_y, const glm::vec3& s, float r)
+	{
+		float dx = glm::max(glm::max(x - s.x, s.x - (x + size)), 0.0f);
+		float dy = glm::max(glm::max(min_y - s.y, s.y - max_y), 0.0f);
+		float dz = glm::max(glm::max(z - s.z, s.z - (z + size)), 0.0f);
+
+		// Moving the center changes its distance to the box by at most the distance moved.
+		return fabs(r - sqrt(dx * dx + dy * dy + dz * dz));
+	}
+
+	float frustum_margin(float x, float z, float size, float min_y, float max_y, const CullView& view)
+	{
+		float min_dist = FLT_MAX;
+
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& p = view.planes[i];
+
+			float px = p.x >= 0.0f ? x + size : x;
+			float py = p.y >= 0.0f ? max_y : min_y;
+			float pz = p.z >= 0.0f ? z + size : z;
+
+			// Translating the view moves every plane rigidly, which changes the normalized distance by at most the translation.
+			float dist = (((p.x * px + p.y * py) + p.z * pz) + p.w) / glm::length(glm::vec3(p.x, p.y, p.z));
+			min_dist = glm::min(min_dist, dist);
+		}
+
+		return fabs(min_dist);
+	}
+
+	uint32_t in_sphere_x4_scalar(const float* x, const float* z, float size, const float* min_y, const float* max_y, const glm::vec3& center, float radius)
+	{
+		uint32_t mask = 0;
+
+		for (int i = 0; i < 4; i++)
+		{
+			if (in_sphere_scalar(x[i], z[i], size, min_y[i], max_y[i], center, radius))
+				mask |= 1 << i;
+		}
+
+		return mask;
+	}
+
+	uint32_t in_frustum_x4_scalar(const float* x, const float* z, float size, const float* min_y, const float* max_y, const CullView& view)
+	{
+		uint32_t mask = 0;
+
+		for (int i = 0; i < 4; i++)
+		{
+			if (in_frustum_scalar(x[i], z[i], size, min_y[i], max_y[i], view))
+				mask |= 1 << i;
+		}
+
+		return mask;
+	}
+
+#if DW_SIMD
+	uint32_t in_sphere_x4(const float* x, const float* z, float size, const float* min_y, const float* max_y, const glm::vec3& center, float radius)
+	{
+		__m128 zero = _mm_setzero_ps();
+		__m128 vsize = _mm_set1_ps(size);
+
+		__m128 min_x = _mm_loadu_ps(x);
+		__m128 max_x = _mm_add_ps(min_x, vsize);
+		__m128 min_z = _mm_loadu_ps(z);
+		__m128 max_z = _mm_add_ps(min_z, vsize);
+		__m128 vmin_y = _mm_loadu_ps(min_y);
+		__m128 vmax_y = _mm_loadu_ps(max_y);
+
+		__m128 sx = _mm_set1_ps(center.x);
+		__m128 sy = _mm_set1_ps(center.y);
+		__m128 sz = _mm_set1_ps(center.z);
+
+		// At most one of (min - s) and (s - max) is positive, so max(., ., 0) picks the same term as the scalar branches.
+		__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_x, sx), _mm_sub_ps(sx, max_x)), zero);
+		__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(vmin_y, sy), _mm_sub_ps(sy, vmax_y)), zero);
+		__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(min_z, sz), _mm_sub_ps(sz, max_z)), zero);
+
+		__m128 dist_squared = _mm_set1_ps(radius * radius);
+		dist_squared = _mm_sub_ps(dist_squared, _mm_mul_ps(dx, dx));
+		dist_squared = _mm_sub_ps(dist_squared, _mm_mul_ps(dy, dy));
+		dist_squared = _mm_sub_ps(dist_squared, _mm_mul_ps(dz, dz));
+
+		return uint32_t(_mm_movemask_ps(_mm_cmpgt_ps(dist_squared, zero)));
+	}
+
+	uint32_t in_frustum_x4(const float* x, const float* z, float size, const float* min_y, const float* max_y, const CullView& view)
+	{
+		__m128 zero = _mm_setzero_ps();
+		__m128 vsize = _mm_set1_ps(size);
+
+		__m128 min_x = _mm_loadu_ps(x);
+		__m128 max_x = _mm_add_ps(min_x, vsize);
+		__m128 min_z = _mm_loadu_ps(z);
+		__m128 max_z = _mm_add_ps(min_z, vsize);
+		__m128 vmin_y = _mm_loadu_ps(min_y);
+		__m128 vmax_y = _mm_loadu_ps(max_y);
+
+		__m128 outside = zero;
+
+		for (int i = 0; i < 6; i++)
+		{
+			const glm::vec4& p = view.planes[i];
+
+			// The furthest corner only depends on the plane, so the selection is uniform across lanes.
+			__m128 px = p.x >= 0.0f ? max_x : min_x;
+			__m128 py = p.y >= 0.0f ? vmax_y : vmin_y;
+			__m128 pz = p.z >= 0.0f ? max_z : min_z;
+
+			__m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.x), px), _mm_mul_ps(_mm_set1_ps(p.y), py));
+			d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.z), pz));
+			d = _mm_add_ps(d, _mm_set1_ps(p.w));
+
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(d, zero));
+		}
+
+		return uint32_t(~_mm_movemask_ps(outside)) & 0xF;
+	}
+#else
+	uint32_t in_sphere_x4(const float* x, const float* z, float size, const float* min_y, const float* max_y, const glm::vec3& center, float radius)
+	{
+		return in_sphere_x4_scalar(x, z, size, min_y, max_y, center, radius);
+	}
+
+	uint32_t in_frustum_x4(const float* x, const float* z, float size, const float* min_y, const float* max_y, const CullView& view)
+	{
+		return in_frustum_x4_scalar(x, z, size, min_y, max_y, view);
+	}
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <glm.hpp>
+#include <common/simd.h>
+
+class Camera;
+
+namespace dw
+{
+	// Everything LOD selection needs to know about a view, independent of Camera so it can be driven headless.
+	struct CullView
+	{
+		glm::vec3 position;
+		glm::vec4 planes[6]; // xyz: inward facing normal, w: distance. Not normalized.
+
+		static CullView from_camera(Camera* camera);
+		static CullView from_matrix(const glm::mat4& view_proj, const glm::vec3& position);
+	};
+
+	// Single box tests. These are the reference the batched kernels must match bit for bit.
+	bool in_sphere_scalar(float x, float z, float size, float min_y, float max_y, const glm::vec3& center, float radius);
+	bool in_frustum_scalar(float x, float z, float size, float min_y, float max_y, const CullView& view);
+
+	// Distance the sphere center (or the view) can be translated before the result of the matching scalar test flips.
+	float sphere_margin(float x, float z, float size, float min_y, float max_y, const glm::vec3& center, float radius);
+	float frustum_margin(float x, float z, float size, float min_y, float max_y, const CullView& view);
+
+	// Batched tests for four boxes of equal size (i.e. quadtree siblings) in SoA layout. Bit i of the returned mask
+	// is set if box i passes.
+	uint32_t in_sphere_x4(const float* x, const float* z, float size, const float* min_y, const float* max_y, const glm::vec3& center, float radius);
+	uint32_t in_frustum_x4(const float* x, const float* z, float size, const float* min_y, const float* max_y, const CullView& view);
+	uint32_t in_sphere_x4_scalar(const float* x, const float* z, float size, const float* min_y, const float* max_y, const glm::vec3& center, float radius);
+	uint32_t in_frustum_x4_scalar(const float* x, const float* z, float size, const float* min_y, const float* max_y, const CullView& view);
+}
\ No newline at end of file
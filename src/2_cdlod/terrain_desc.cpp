@@ -0,0 +1,106 @@
+#include "terrain_desc.h"
+#include <utility.h>
+#include <logger.h>
+#include <json.hpp>
+
+namespace dw
+{
+	inline bool is_type(const nlohmann::json& json, const std::string&) { return json.is_string(); }
+	inline bool is_type(const nlohmann::json& json, const int&) { return json.is_number_integer(); }
+	inline bool is_type(const nlohmann::json& json, const float&) { return json.is_number(); }
+
+	// Returns false if the key is present but has the wrong type. get<T>() would throw instead.
+	template <typename T>
+	bool read_optional(const nlohmann::json& json, const char* key, T& value)
+	{
+		auto it = json.find(key);
+
+		if (it == json.end())
+			return true;
+
+		if (!is_type(*it, value))
+			return false;
+
+		value = it->get<T>();
+		return true;
+	}
+
+	bool TerrainDesc::load(const std::string& file, TerrainDesc& desc)
+	{
+		std::string str;
+
+		if (!Utility::ReadText(file, str))
+		{
+			LOG_ERROR("Failed to read terrain description");
+			return false;
+		}
+
+		// Parse without exceptions, malformed files are reported like any other invalid description.
+		nlohmann::json json = nlohmann::json::parse(str, nullptr, false);
+
+		if (json.is_discarded() || !json.is_object())
+		{
+			LOG_ERROR("Failed to parse terrain description");
+			return false;
+		}
+
+		bool valid = read_optional(json, "heightmap", desc.heightmap);
+		valid = read_optional(json, "heightmap_width", desc.heightmap_width) && valid;
+		valid = read_optional(json, "heightmap_height", desc.heightmap_height) && valid;
+		valid = read_optional(json, "world_width", desc.world_width) && valid;
+		valid = read_optional(json, "world_depth", desc.world_depth) && valid;
+		valid = read_optional(json, "height_scale", desc.height_scale) && valid;
+		valid = read_optional(json, "root_size", desc.root_size) && valid;
+		valid = read_optional(json, "lod_count", desc.lod_count) && valid;
+		valid = read_optional(json, "lod_distance_ratio", desc.lod_distance_ratio) && valid;
+		valid = read_optional(json, "max_range", desc.max_range) && valid;
+		valid = read_optional(json, "patch_resolution", desc.patch_resolution) && valid;
+
+		if (!valid)
+		{
+			LOG_ERROR("Terrain description has keys of the wrong type");
+			return false;
+		}
+
+		return desc.validate();
+	}
+
+	bool TerrainDesc::validate() const
+	{
+		if (world_width <= 0.0f || world_depth <= 0.0f || root_size <= 0.0f)
+		{
+			LOG_ERROR("Terrain extents and root size must be positive");
+			return false;
+		}
+
+		if (lod_count < 1 || lod_count > TERRAIN_MAX_LOD_COUNT)
+		{
+			LOG_ERROR("Terrain LOD count must be between 1 and 8");
+			return false;
+		}
+
+		// The conventional CDLOD minimum. Use the terrain benchmark to check a description for cracks.
+		if (lod_distance_ratio < 2.0f || max_range <= 0.0f)
+		{
+			LOG_ERROR("LOD distance ratio must be at least 2 and the max range positive");
+			return false;
+		}
+
+		if (patch_resolution != 8 && patch_resolution != 16 && patch_resolution != 32 && patch_resolution != 64)
+		{
+			LOG_ERROR("Patch resolution must be 8, 16, 32 or 64");
+			return false;
+		}
+
+		return true;
+	}
+
+	void TerrainDesc::lod_ranges(std::vector<float>& ranges) const
+	{
+		ranges.resize(lod_count);
+		ranges[lod_count - 1] = max_range;
+
+		for (int i = lod_count - 2; i >= 0; i--)
+			ranges[i] = ranges[i + 1] / lod_distance_ratio;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <math.h>
+
+// Quadtree child offsets are 16-bit, which allows (4^8 - 1) / 3 nodes per root.
+#define TERRAIN_MAX_LOD_COUNT 8
+
+namespace dw
+{
+	// Everything that sizes a terrain. Loaded from JSON so the LOD budget can be tuned per map; every key is optional
+	// and defaults to the values below.
+	//
+	// {
+	//     "heightmap": "heightmap.r16",
+	//     "heightmap_width": 1024,
+	//     "heightmap_height": 1024,
+	//     "world_width": 16384.0,
+	//     "world_depth": 16384.0,
+	//     "height_scale": 50.0,
+	//     "root_size": 1024.0,
+	//     "lod_count": 6,
+	//     "lod_distance_ratio": 2.0,
+	//     "max_range": 5000.0,
+	//     "patch_resolution": 32
+	// }
+	struct TerrainDesc
+	{
+		std::string heightmap = "heightmap.r16";
+		int			heightmap_width = 1024;  // Ignored for tiled heightmaps, which store their own size.
+		int			heightmap_height = 1024;
+		float		world_width = 16384.0f;
+		float		world_depth = 16384.0f;
+		float		height_scale = 50.0f;
+		float		root_size = 1024.0f;
+		int			lod_count = 6;			   // At most TERRAIN_MAX_LOD_COUNT.
+		float		lod_distance_ratio = 2.0f; // Range of a level divided by the range of the next finer level.
+		float		max_range = 5000.0f;	   // Range of the coarsest level.
+		int			patch_resolution = 32;	   // Quads per side of a full resolution patch. Half resolution patches use half.
+
+		static bool load(const std::string& file, TerrainDesc& desc);
+		bool validate() const;
+		// Morph range of every LOD level, finest first.
+		void lod_ranges(std::vector<float>& ranges) const;
+		inline int grid_width() const { return int(ceil(world_width / root_size)); }
+		inline int grid_depth() const { return int(ceil(world_depth / root_size)); }
+	};
+}
\ No newline at end of file
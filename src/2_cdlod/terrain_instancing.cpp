@@ -0,0 +1,60 @@
+#include "terrain_instancing.h"
+#include "node.h"
+
+namespace dw
+{
+	glm::vec4 lod_color(float range, const std::vector<float>& ranges)
+	{
+		static const glm::vec4 kColors[] =
+		{
+			glm::vec4(1.0, 1.0, 1.0, 1.0),
+			glm::vec4(0.0, 1.0, 0.0, 1.0),
+			glm::vec4(0.0, 0.0, 1.0, 1.0),
+			glm::vec4(1.0, 1.0, 0.0, 1.0),
+			glm::vec4(0.8, 0.5, 0.2, 1.0)
+		};
+
+		for (int i = 0; i < ranges.size() && i < 5; i++)
+		{
+			if (range == ranges[i])
+				return kColors[i];
+		}
+
+		return glm::vec4(0.5, 0.5, 0.5, 1.0);
+	}
+
+	inline uint32_t pack_color(const glm::vec4& color)
+	{
+		return uint32_t(color.x * 255.0f + 0.5f) |
+			  (uint32_t(color.y * 255.0f + 0.5f) << 8) |
+			  (uint32_t(color.z * 255.0f + 0.5f) << 16) |
+			  (uint32_t(color.w * 255.0f + 0.5f) << 24);
+	}
+
+	uint32_t pack_terrain_instances(const std::vector<Node>& patches, const std::vector<float>& ranges, std::vector<TerrainInstance>& instances)
+	{
+		uint32_t full_count = 0;
+
+		for (const Node& node : patches)
+		{
+			if (node.full_resolution)
+				full_count++;
+		}
+
+		instances.resize(patches.size());
+
+		// Counting sort on the patch type keeps the selection order within each group.
+		uint32_t full_idx = 0;
+		uint32_t half_idx = full_count;
+
+		for (const Node& node : patches)
+		{
+			TerrainInstance& instance = instances[node.full_resolution ? full_idx++ : half_idx++];
+
+			instance.position_scale_range = glm::vec4(node.x_pos, node.z_pos, node.size, node.current_range);
+			instance.color = pack_color(lod_color(node.current_range, ranges));
+		}
+
+		return full_count;
+	}
+}
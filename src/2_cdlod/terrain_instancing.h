@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <glm.hpp>
+
+namespace dw
+{
+	struct Node;
+
+	// Per-instance vertex stream for instanced patch submission. Attribute 1 and 2 of the terrain vertex shader.
+	struct TerrainInstance
+	{
+		glm::vec4 position_scale_range; // x: x_pos, y: z_pos, z: size, w: morph range
+		uint32_t  color;				// RGBA8 debug color of the LOD the range belongs to
+	};
+
+	// Debug color for the LOD level a morph range belongs to.
+	glm::vec4 lod_color(float range, const std::vector<float>& ranges);
+
+	// Packs the patch list into instances grouped by patch type: all full resolution patches first, then all half
+	// resolution ones, each group in selection order. Returns the number of full resolution instances.
+	uint32_t pack_terrain_instances(const std::vector<Node>& patches, const std::vector<float>& ranges, std::vector<TerrainInstance>& instances);
+}
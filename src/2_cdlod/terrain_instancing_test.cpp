@@ -0,0 +1,131 @@
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "node.h"
+#include "terrain_instancing.h"
+
+// Patch i is tagged by x_pos = i, so the packed order can be traced back to the selection order.
+static dw::Node make_patch(int i, bool full_resolution, float range)
+{
+	dw::Node node;
+
+	node.max_height = 1.0f;
+	node.min_height = 0.0f;
+	node.x_pos = float(i);
+	node.z_pos = float(-i);
+	node.size = 8.0f;
+	node.current_range = range;
+	node.lod_level = 0;
+	node.full_resolution = full_resolution;
+
+	return node;
+}
+
+// Full resolution patches have to come first and the half resolution ones after them, each group in selection order.
+static int check(const std::string& name, const std::vector<dw::Node>& patches, const std::vector<float>& ranges)
+{
+	std::vector<dw::TerrainInstance> instances;
+	std::vector<int> expected;
+	uint32_t expected_full = 0;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (int i = 0; i < int(patches.size()); i++)
+		{
+			if (patches[i].full_resolution == (pass == 0))
+				expected.push_back(i);
+		}
+
+		if (pass == 0)
+			expected_full = uint32_t(expected.size());
+	}
+
+	uint32_t full_count = dw::pack_terrain_instances(patches, ranges, instances);
+	int failures = 0;
+
+	if (full_count != expected_full)
+	{
+		std::cout << name << " : " << full_count << " full resolution instances, expected " << expected_full << std::endl;
+		failures++;
+	}
+
+	if (instances.size() != patches.size())
+	{
+		std::cout << name << " : " << instances.size() << " instances, expected " << patches.size() << std::endl;
+		return failures + 1;
+	}
+
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		const dw::Node& node = patches[expected[i]];
+		glm::vec4 psr = instances[i].position_scale_range;
+
+		if (psr.x != node.x_pos || psr.y != node.z_pos || psr.z != node.size || psr.w != node.current_range)
+		{
+			std::cout << name << " : instance " << i << " is patch " << psr.x << ", expected " << expected[i] << std::endl;
+			failures++;
+		}
+
+		// Alpha is always 1, the LOD color is packed as RGBA8.
+		if ((instances[i].color >> 24) != 0xff)
+		{
+			std::cout << name << " : instance " << i << " has color " << std::hex << instances[i].color << std::dec << std::endl;
+			failures++;
+		}
+	}
+
+	return failures;
+}
+
+int main()
+{
+	std::vector<float> ranges = { 16.0f, 32.0f, 64.0f };
+	std::vector<dw::Node> patches;
+	int failures = 0;
+
+	failures += check("Empty", patches, ranges);
+
+	for (int i = 0; i < 7; i++)
+		patches.push_back(make_patch(i, true, ranges[i % 3]));
+
+	failures += check("All full", patches, ranges);
+
+	for (dw::Node& node : patches)
+		node.full_resolution = false;
+
+	failures += check("All half", patches, ranges);
+
+	patches.clear();
+
+	for (int i = 0; i < 13; i++)
+		patches.push_back(make_patch(i, (i % 3) != 1, ranges[i % 3]));
+
+	failures += check("Mixed", patches, ranges);
+
+	// The draw ranges of both patch types are contiguous, packing again into a larger vector shrinks it.
+	std::vector<dw::TerrainInstance> instances(64);
+	patches.resize(2);
+	dw::pack_terrain_instances(patches, ranges, instances);
+
+	if (instances.size() != 2)
+	{
+		std::cout << "Reused vector : " << instances.size() << " instances, expected 2" << std::endl;
+		failures++;
+	}
+
+	// LOD colors follow the range of the patch, unknown ranges are grey.
+	std::vector<dw::TerrainInstance> colored;
+	patches = { make_patch(0, true, ranges[0]), make_patch(1, true, ranges[1]), make_patch(2, true, 1000.0f) };
+	dw::pack_terrain_instances(patches, ranges, colored);
+
+	if (colored[0].color != 0xffffffff || colored[1].color != 0xff00ff00 || colored[2].color != 0xff808080)
+	{
+		std::cout << "LOD colors : " << std::hex << colored[0].color << " " << colored[1].color << " " << colored[2].color << std::dec << std::endl;
+		failures++;
+	}
+
+	std::cout << "Failures : " << failures << std::endl;
+
+	return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "terrain_maps.h"
+#include <common/thread_pool.h>
+#include <math.h>
+#include <algorithm>
+
+namespace dw
+{
+	inline uint8_t unorm8(float value)
+	{
+		return uint8_t(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	inline float sign_not_zero(float value)
+	{
+		return value < 0.0f ? -1.0f : 1.0f;
+	}
+
+	uint16_t encode_octahedral(const glm::vec3& n)
+	{
+		float inv_l1 = 1.0f / (fabs(n.x) + fabs(n.y) + fabs(n.z));
+		float x = n.x * inv_l1;
+		float y = n.z * inv_l1;
+
+		// Fold the lower hemisphere over the diagonals. Terrain normals practically never point down.
+		if (n.y < 0.0f)
+		{
+			float fx = (1.0f - fabs(y)) * sign_not_zero(x);
+			float fy = (1.0f - fabs(x)) * sign_not_zero(y);
+			x = fx;
+			y = fy;
+		}
+
+		return uint16_t(unorm8(x * 0.5f + 0.5f)) | uint16_t(unorm8(y * 0.5f + 0.5f) << 8);
+	}
+
+	glm::vec3 decode_octahedral(uint16_t packed)
+	{
+		float x = float(packed & 0xFF) / 255.0f * 2.0f - 1.0f;
+		float y = float(packed >> 8) / 255.0f * 2.0f - 1.0f;
+
+		glm::vec3 n = glm::vec3(x, 1.0f - fabs(x) - fabs(y), y);
+
+		if (n.y < 0.0f)
+		{
+			n.x = (1.0f - fabs(y)) * sign_not_zero(x);
+			n.z = (1.0f - fabs(x)) * sign_not_zero(y);
+		}
+
+		return glm::normalize(n);
+	}
+
+	void generate_terrain_map_tile(const uint16_t* texels, int width, int height, float height_scale, float texel_size, int x0, int y0, int x1, int y1, uint16_t* normals, uint16_t* slope_curvature)
+	{
+		float scale = height_scale / float(UINT16_MAX);
+
+		for (int y = y0; y < y1; y++)
+		{
+			const uint16_t* row_u = texels + size_t(width) * std::max(y - 1, 0);
+			const uint16_t* row_c = texels + size_t(width) * y;
+			const uint16_t* row_d = texels + size_t(width) * std::min(y + 1, height - 1);
+
+			for (int x = x0; x < x1; x++)
+			{
+				int l = std::max(x - 1, 0);
+				int r = std::min(x + 1, width - 1);
+
+				float ul = float(row_u[l]), uc = float(row_u[x]), ur = float(row_u[r]);
+				float cl = float(row_c[l]), cc = float(row_c[x]), cr = float(row_c[r]);
+				float dl = float(row_d[l]), dc = float(row_d[x]), dr = float(row_d[r]);
+
+				// Sobel gradients in world units. The kernels weigh 8 texels spanning 2 texels each.
+				float dh_dx = ((ur + 2.0f * cr + dr) - (ul + 2.0f * cl + dl)) * scale / (8.0f * texel_size);
+				float dh_dz = ((dl + 2.0f * dc + dr) - (ul + 2.0f * uc + ur)) * scale / (8.0f * texel_size);
+
+				glm::vec3 n = glm::normalize(glm::vec3(-dh_dx, 1.0f, -dh_dz));
+
+				float slope = acos(glm::clamp(n.y, -1.0f, 1.0f)) / 1.57079633f;
+				float curvature = (cl + cr + uc + dc - 4.0f * cc) * scale / texel_size;
+
+				size_t index = size_t(width) * y + x;
+				normals[index] = encode_octahedral(n);
+				slope_curvature[index] = uint16_t(unorm8(slope)) | uint16_t(unorm8(curvature * 0.5f + 0.5f) << 8);
+			}
+		}
+	}
+
+	void generate_terrain_maps(const uint16_t* texels, int width, int height, float height_scale, float texel_size, uint16_t* normals, uint16_t* slope_curvature, ThreadPool* pool)
+	{
+		int tiles_x = (width + TERRAIN_MAP_TILE_SIZE - 1) / TERRAIN_MAP_TILE_SIZE;
+		int tiles_y = (height + TERRAIN_MAP_TILE_SIZE - 1) / TERRAIN_MAP_TILE_SIZE;
+
+		// Tiles only read the heightmap and write their own texels, so they need no synchronization.
+		auto generate_tile = [&](int tile) {
+			int x0 = (tile % tiles_x) * TERRAIN_MAP_TILE_SIZE;
+			int y0 = (tile / tiles_x) * TERRAIN_MAP_TILE_SIZE;
+			int x1 = std::min(x0 + TERRAIN_MAP_TILE_SIZE, width);
+			int y1 = std::min(y0 + TERRAIN_MAP_TILE_SIZE, height);
+
+			generate_terrain_map_tile(texels, width, height, height_scale, texel_size, x0, y0, x1, y1, normals, slope_curvature);
+		};
+
+		if (pool)
+			pool->parallel_for(tiles_x * tiles_y, generate_tile);
+		else
+		{
+			for (int i = 0; i < tiles_x * tiles_y; i++)
+				generate_tile(i);
+		}
+	}
+}
\ No newline at end of file
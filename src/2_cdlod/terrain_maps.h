@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <glm.hpp>
+
+#define TERRAIN_MAP_TILE_SIZE 64
+
+namespace dw
+{
+	class ThreadPool;
+
+	// Octahedral encoding of a unit normal around the y axis, packed as RG8_UNORM with x in the low byte. Decode with
+	//   vec2 e = texel.xy * 2.0 - 1.0;
+	//   vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+	//   if (n.y < 0.0) n.xz = (1.0 - abs(n.zx)) * sign(n.xz);
+	//   n = normalize(n);
+	uint16_t encode_octahedral(const glm::vec3& n);
+	glm::vec3 decode_octahedral(uint16_t packed);
+
+	// Builds the normal and slope/curvature maps of a UNORM16 heightmap, one output texel per height texel.
+	//   normals:         Sobel normals in world space, see encode_octahedral().
+	//   slope_curvature: RG8_UNORM. R is the slope angle, 0 is flat and 1 is vertical. G is the Laplacian of the
+	//                    height divided by the texel size, i.e. the change in slope across a texel, mapped from
+	//                    [-1, 1] to [0, 1]. Above 0.5 is concave (valleys), below is convex (ridges).
+	// The map is split into TERRAIN_MAP_TILE_SIZE^2 tiles that run on the pool, or serially without one.
+	void generate_terrain_maps(const uint16_t* texels, int width, int height, float height_scale, float texel_size, uint16_t* normals, uint16_t* slope_curvature, ThreadPool* pool = nullptr);
+}
\ No newline at end of file
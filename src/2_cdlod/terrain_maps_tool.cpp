@@ -0,0 +1,87 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <string>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include "heightmap_ingest.h"
+#include "terrain_maps.h"
+#include "terrain_desc.h"
+#include <common/thread_pool.h>
+
+// Expands an RG8 map to RGB so it can be viewed and reimported as a regular image.
+bool write_rg8_png(const std::string& file, const std::vector<uint16_t>& map, int width, int height)
+{
+	std::vector<uint8_t> rgb(map.size() * 3);
+
+	for (size_t i = 0; i < map.size(); i++)
+	{
+		rgb[3 * i + 0] = uint8_t(map[i] & 0xFF);
+		rgb[3 * i + 1] = uint8_t(map[i] >> 8);
+		rgb[3 * i + 2] = 0;
+	}
+
+	return stbi_write_png(file.c_str(), width, height, 3, &rgb[0], width * 3) != 0;
+}
+
+// Bakes the octahedral normal map and the slope/curvature map of a terrain offline.
+// Usage: 2_cdlod_terrain_maps <terrain.json> <output prefix>
+// Writes <output prefix>_normals.png and <output prefix>_slope_curvature.png.
+int main(int argc, const char* argv[])
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: 2_cdlod_terrain_maps <terrain.json> <output prefix>" << std::endl;
+		return 1;
+	}
+
+	dw::TerrainDesc desc;
+
+	if (!dw::TerrainDesc::load(argv[1], desc))
+		return 1;
+
+	dw::HeightMapIngestDesc ingest_desc;
+
+	ingest_desc.source = desc.heightmap;
+	ingest_desc.raw_width = desc.heightmap_width;
+	ingest_desc.raw_height = desc.heightmap_height;
+	ingest_desc.height_scale = desc.height_scale;
+	ingest_desc.world_width = desc.world_width;
+
+	std::vector<uint16_t> texels;
+	int width, height;
+
+	if (!dw::decode_heightmap(ingest_desc, texels, width, height))
+	{
+		std::cout << "Failed to load heightmap" << std::endl;
+		return 1;
+	}
+
+	std::vector<uint16_t> normals(texels.size());
+	std::vector<uint16_t> slope_curvature(texels.size());
+
+	dw::ThreadPool pool;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	dw::generate_terrain_maps(&texels[0], width, height, desc.height_scale, desc.world_width / float(width), &normals[0], &slope_curvature[0], &pool);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+	std::cout << "Heightmap : " << width << " x " << height << std::endl;
+	std::cout << "Threads   : " << pool.worker_count() + 1 << std::endl;
+	std::cout << "Generate  : " << ms << " ms (" << double(texels.size()) / (ms * 1000.0) << " M texels / s)" << std::endl;
+
+	std::string prefix = argv[2];
+
+	if (!write_rg8_png(prefix + "_normals.png", normals, width, height) || !write_rg8_png(prefix + "_slope_curvature.png", slope_curvature, width, height))
+	{
+		std::cout << "Failed to write maps" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "terrain_mesher.h"
+#include "heightmap.h"
+#include "node.h"
+#include <map>
+#include <math.h>
+#include <algorithm>
+
+namespace dw
+{
+	struct PatchEdge
+	{
+		uint32_t patch;
+		bool	 far_side; // Right or bottom edge of the patch.
+		float	 start;
+		float	 end;
+	};
+
+	int patch_grid_dim(const Node& node, int patch_resolution)
+	{
+		return node.full_resolution ? patch_resolution : patch_resolution / 2;
+	}
+
+	float morph_factor(float distance, float range, float morph_start)
+	{
+		float start = range * morph_start;
+		return glm::clamp((distance - start) / (range - start), 0.0f, 1.0f);
+	}
+
+	glm::vec2 morph_grid_position(const glm::vec2& grid_pos, float grid_dim, float k)
+	{
+		// Odd lattice points are one cell away from the even point below them, even points stay where they are.
+		glm::vec2 frac_part = glm::fract(grid_pos * grid_dim * 0.5f) * 2.0f / grid_dim;
+		return grid_pos - frac_part * k;
+	}
+
+	float sample_height(HeightMap* height_map, float x, float z, const TerrainMeshParams& params)
+	{
+		return height_map->sample_bilinear(x * params.texel_scale, z * params.texel_scale) * params.height_scale;
+	}
+
+	void mesh_terrain_patches(const std::vector<Node>& patches, HeightMap* height_map, const TerrainMeshParams& params, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& first_vertex)
+	{
+		vertices.clear();
+		first_vertex.resize(patches.size());
+
+		for (uint32_t i = 0; i < patches.size(); i++)
+		{
+			const Node& node = patches[i];
+			int grid = patch_grid_dim(node, params.patch_resolution);
+			float grid_dim = float(grid);
+
+			first_vertex[i] = uint32_t(vertices.size());
+
+			for (int y = 0; y <= grid; y++)
+			{
+				for (int x = 0; x <= grid; x++)
+				{
+					glm::vec2 grid_pos = glm::vec2(float(x) / grid_dim, float(y) / grid_dim);
+
+					// The morph factor is based on the distance to the unmorphed vertex, as in the shader.
+					float wx = node.x_pos + grid_pos.x * node.size;
+					float wz = node.z_pos + grid_pos.y * node.size;
+					float wy = sample_height(height_map, wx, wz, params);
+
+					float k = morph_factor(glm::length(glm::vec3(wx, wy, wz) - params.camera_position), node.current_range, params.morph_start);
+					glm::vec2 morphed = morph_grid_position(grid_pos, grid_dim, k);
+
+					wx = node.x_pos + morphed.x * node.size;
+					wz = node.z_pos + morphed.y * node.size;
+
+					vertices.push_back(glm::vec3(wx, sample_height(height_map, wx, wz, params), wz));
+				}
+			}
+		}
+	}
+
+	// Position of an edge vertex along the edge and its height.
+	inline glm::vec2 edge_vertex(const glm::vec3& v, int axis)
+	{
+		return glm::vec2(axis == 0 ? v.z : v.x, v.y);
+	}
+
+	static void edge_polyline(const Node& node, int patch_resolution, const glm::vec3* patch_vertices, int axis, bool far_side, std::vector<glm::vec2>& polyline)
+	{
+		int grid = patch_grid_dim(node, patch_resolution);
+		int stride = grid + 1;
+
+		polyline.resize(stride);
+
+		// Axis 0 edges run along z (left and right), axis 1 edges run along x (top and bottom).
+		for (int i = 0; i <= grid; i++)
+		{
+			int idx;
+
+			if (axis == 0)
+				idx = stride * i + (far_side ? grid : 0);
+			else
+				idx = stride * (far_side ? grid : 0) + i;
+
+			polyline[i] = edge_vertex(patch_vertices[idx], axis);
+		}
+	}
+
+	// Tests the vertices of one edge against the polyline of the edge it touches.
+	static void check_edge(const std::vector<glm::vec2>& a, const std::vector<glm::vec2>& b, float start, float end, float epsilon, TerrainMeshErrors& errors)
+	{
+		for (const glm::vec2& v : a)
+		{
+			if (v.x < start - epsilon || v.x > end + epsilon)
+				continue;
+
+			errors.edge_vertices++;
+
+			size_t j = 0;
+
+			while (j + 2 < b.size() && b[j + 1].x < v.x)
+				j++;
+
+			const glm::vec2& p0 = b[j];
+			const glm::vec2& p1 = b[j + 1];
+			float expected;
+
+			if (fabs(v.x - p0.x) <= epsilon)
+				expected = p0.y;
+			else if (fabs(v.x - p1.x) <= epsilon)
+				expected = p1.y;
+			else
+			{
+				errors.t_junctions++;
+				expected = p0.y + (p1.y - p0.y) * (v.x - p0.x) / (p1.x - p0.x);
+			}
+
+			float gap = fabs(v.y - expected);
+
+			if (gap > epsilon)
+				errors.cracks++;
+
+			errors.max_gap = std::max(errors.max_gap, gap);
+		}
+	}
+
+	TerrainMeshErrors validate_terrain_mesh(const std::vector<Node>& patches, int patch_resolution, const std::vector<glm::vec3>& vertices, const std::vector<uint32_t>& first_vertex, float epsilon)
+	{
+		TerrainMeshErrors errors;
+
+		errors.shared_edges = 0;
+		errors.edge_vertices = 0;
+		errors.t_junctions = 0;
+		errors.cracks = 0;
+		errors.max_gap = 0.0f;
+
+		// Bucket edges by the line they lie on. Patch corners are multiples of the leaf size, so the keys are exact.
+		std::map<std::pair<int, float>, std::vector<PatchEdge> > lines;
+
+		for (uint32_t i = 0; i < patches.size(); i++)
+		{
+			const Node& node = patches[i];
+
+			lines[std::make_pair(0, node.x_pos)].push_back({ i, false, node.z_pos, node.z_pos + node.size });
+			lines[std::make_pair(0, node.x_pos + node.size)].push_back({ i, true, node.z_pos, node.z_pos + node.size });
+			lines[std::make_pair(1, node.z_pos)].push_back({ i, false, node.x_pos, node.x_pos + node.size });
+			lines[std::make_pair(1, node.z_pos + node.size)].push_back({ i, true, node.x_pos, node.x_pos + node.size });
+		}
+
+		std::vector<glm::vec2> a;
+		std::vector<glm::vec2> b;
+
+		for (auto& line : lines)
+		{
+			int axis = line.first.first;
+			std::vector<PatchEdge>& edges = line.second;
+
+			for (const PatchEdge& near_edge : edges)
+			{
+				if (near_edge.far_side)
+					continue;
+
+				for (const PatchEdge& far_edge : edges)
+				{
+					if (!far_edge.far_side)
+						continue;
+
+					float start = std::max(near_edge.start, far_edge.start);
+					float end = std::min(near_edge.end, far_edge.end);
+
+					if (end <= start)
+						continue;
+
+					errors.shared_edges++;
+
+					edge_polyline(patches[near_edge.patch], patch_resolution, &vertices[first_vertex[near_edge.patch]], axis, false, a);
+					edge_polyline(patches[far_edge.patch], patch_resolution, &vertices[first_vertex[far_edge.patch]], axis, true, b);
+
+					check_edge(a, b, start, end, epsilon, errors);
+					check_edge(b, a, start, end, epsilon, errors);
+				}
+			}
+		}
+
+		return errors;
+	}
+}
\ No newline at end of file
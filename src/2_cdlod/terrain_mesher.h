@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <glm.hpp>
+
+#define TERRAIN_MORPH_START 0.7f
+
+class HeightMap;
+
+namespace dw
+{
+	struct Node;
+
+	// Inputs of the terrain vertex shader that are not part of a patch.
+	struct TerrainMeshParams
+	{
+		glm::vec3 camera_position;
+		float	  height_scale;
+		float	  texel_scale;
+		float	  morph_start; // Fraction of the morph range at which a patch starts morphing towards its parent.
+		int		  patch_resolution;
+	};
+
+	struct TerrainMeshErrors
+	{
+		uint32_t shared_edges;	 // Pairs of patch edges that touch.
+		uint32_t edge_vertices;	 // Vertices tested against a neighbouring edge.
+		uint32_t t_junctions;	 // Vertices that land between two vertices of the neighbouring edge.
+		uint32_t cracks;		 // Vertices whose height is off the neighbouring edge by more than the tolerance.
+		float	 max_gap;
+	};
+
+	int patch_grid_dim(const Node& node, int patch_resolution);
+
+	// CPU mirror of the terrain vertex shader. Patch vertices sit on a (grid + 1) x (grid + 1) lattice over [0, 1]^2,
+	// matching TerrainPatch. A vertex is moved towards the even lattice point below it by the morph factor, which
+	// ramps from 0 at morph_start * range to 1 at the range, so that a fully morphed patch matches its parent.
+	float morph_factor(float distance, float range, float morph_start);
+	glm::vec2 morph_grid_position(const glm::vec2& grid_pos, float grid_dim, float k);
+	// Bilinearly filtered height at a world space position, in world units.
+	float sample_height(HeightMap* height_map, float x, float z, const TerrainMeshParams& params);
+
+	// Appends the final vertex positions of every patch. Patch i starts at first_vertex[i] and is laid out row by row.
+	void mesh_terrain_patches(const std::vector<Node>& patches, HeightMap* height_map, const TerrainMeshParams& params, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& first_vertex);
+
+	// Checks every shared edge of a meshed patch list for T-junctions and cracks.
+	TerrainMeshErrors validate_terrain_mesh(const std::vector<Node>& patches, int patch_resolution, const std::vector<glm::vec3>& vertices, const std::vector<uint32_t>& first_vertex, float epsilon);
+}
\ No newline at end of file
@@ -1,69 +1,44 @@
 #include "terrain_patch.h"
+#include "terrain_instancing.h"
 #include <Macros.h>
 #include <render_device.h>
-#include <glm.hpp>
-#include <vector>
-#include <stdio.h>
 
-TerrainPatch::TerrainPatch(int width, int height, RenderDevice* device)
+TerrainPatch::TerrainPatch(int grid_dim, const uint8_t* vertices, size_t vertices_size, const void* indices, int index_size, int index_count, RenderDevice* device)
 {
-	std::vector<glm::vec3> vertices;
-	std::vector<GLuint>	   index;
-
-	for (int y = 0; y <= height; ++y)
-	{
-		for (int x = 0; x <= width; ++x)
-		{
-			float xx = (x - width / 2);
-			float yy = (y - height / 2);
-			xx = x;
-			yy = y;
-			vertices.push_back(glm::vec3(xx / width, 0.0, yy / height));
-		}
-	}
-
-	for (int y = 0; y < height; ++y)
-	{
-		for (int x = 0; x < width; ++x)
-		{
-			index.push_back((x + 0) + (width + 1)*(y + 0));
-			index.push_back((x + 1) + (width + 1)*(y + 0));
-			index.push_back((x + 1) + (width + 1)*(y + 1));
-
-			index.push_back((x + 1) + (width + 1)*(y + 1));
-			index.push_back((x + 0) + (width + 1)*(y + 1));
-			index.push_back((x + 0) + (width + 1)*(y + 0));
-		}
-	}
+	m_device = device;
+	m_grid_dim = grid_dim;
+	m_index_size = index_size;
 
 	BufferCreateDesc desc;
 	DW_ZERO_MEMORY(desc);
 
-	desc.data = &vertices[0];
-	desc.data_type = DataType::FLOAT;
-	desc.size = sizeof(glm::vec3) * vertices.size();
+	desc.data = (void*)vertices;
+	desc.data_type = DataType::UINT8;
+	desc.size = vertices_size;
 	desc.usage_type = BufferUsageType::STATIC;
 
 	m_vbo = m_device->create_vertex_buffer(desc);
 
 	DW_ZERO_MEMORY(desc);
 
-	desc.data = &index[0];
-	desc.data_type = DataType::UINT32;
-	desc.size = sizeof(GLuint) * index.size();
+	// The index buffer carries its type, the device draws with it.
+	desc.data = (void*)indices;
+	desc.data_type = index_size == sizeof(uint16_t) ? DataType::UINT16 : DataType::UINT32;
+	desc.size = size_t(index_size) * index_count;
 	desc.usage_type = BufferUsageType::STATIC;
 
 	m_ibo = m_device->create_index_buffer(desc);
 
 	InputLayoutCreateDesc il_desc;
 
+	// Unnormalized lattice coordinates. The vertex shader divides by the grid dimension.
 	InputElement elements[] =
 	{
-		{ 3, DataType::FLOAT, false, 0, "POSITION" }
+		{ 2, DataType::UINT8, false, 0, "POSITION" }
 	};
 
 	il_desc.num_elements = 1;
-	il_desc.vertex_size = sizeof(glm::vec3);
+	il_desc.vertex_size = sizeof(uint8_t) * 2;
 	il_desc.elements = elements;
 
 	m_il = m_device->create_input_layout(il_desc);
@@ -77,11 +52,76 @@ TerrainPatch::TerrainPatch(int width, int height, RenderDevice* device)
 
 	m_vao = m_device->create_vertex_array(vao_desc);
 
-	m_index_count = index.size();
+	m_index_count = index_count;
+
+	// Binding 0 is the lattice, binding 1 the instance stream. The formats are fixed here, draw_instanced() only
+	// points binding 1 at the current slice of the stream.
+	glGenBuffers(1, &m_instanced_vbo);
+	glGenBuffers(1, &m_instanced_ibo);
+	glGenVertexArrays(1, &m_instanced_vao);
+
+	glBindVertexArray(m_instanced_vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanced_vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_instanced_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, size_t(index_size) * index_count, indices, GL_STATIC_DRAW);
+
+	glBindVertexBuffer(0, m_instanced_vbo, 0, sizeof(uint8_t) * 2);
+
+	glEnableVertexAttribArray(0);
+	glVertexAttribFormat(0, 2, GL_UNSIGNED_BYTE, GL_FALSE, 0);
+	glVertexAttribBinding(0, 0);
+
+	glEnableVertexAttribArray(1);
+	glVertexAttribFormat(1, 4, GL_FLOAT, GL_FALSE, offsetof(dw::TerrainInstance, position_scale_range));
+	glVertexAttribBinding(1, 1);
+
+	glEnableVertexAttribArray(2);
+	glVertexAttribFormat(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(dw::TerrainInstance, color));
+	glVertexAttribBinding(2, 1);
+
+	glVertexBindingDivisor(1, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void TerrainPatch::draw_instanced(uint32_t buffer, size_t offset, uint32_t count)
+{
+	glBindVertexArray(m_instanced_vao);
+	glBindVertexBuffer(1, buffer, offset, sizeof(dw::TerrainInstance));
+	glDrawElementsInstanced(GL_TRIANGLES, m_index_count, m_index_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, nullptr, count);
+	glBindVertexArray(0);
+}
+
+TerrainPatch* TerrainPatch::create(int grid_dim, RenderDevice* device)
+{
+	switch (grid_dim)
+	{
+	case 4:
+		return create<4>(device);
+	case 8:
+		return create<8>(device);
+	case 16:
+		return create<16>(device);
+	case 32:
+		return create<32>(device);
+	case 64:
+		return create<64>(device);
+	default:
+		return nullptr;
+	}
 }
 
 TerrainPatch::~TerrainPatch()
 {
+	glDeleteVertexArrays(1, &m_instanced_vao);
+	glDeleteBuffers(1, &m_instanced_vbo);
+	glDeleteBuffers(1, &m_instanced_ibo);
+
 	delete m_il;
 	m_device->destroy(m_vao);
 	m_device->destroy(m_vbo);
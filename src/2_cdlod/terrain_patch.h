@@ -1,11 +1,68 @@
 #pragma once
 
+#include <stdint.h>
+#include <stddef.h>
+
+// Width of the vertical stripes the patch triangles are emitted in. Two rows of a stripe (2 * (stripe + 1) vertices)
+// have to fit in the post-transform cache for every interior vertex to be transformed once, 16 entries for 7.
+#define TERRAIN_PATCH_STRIPE 7
+
 struct VertexArray;
 struct VertexBuffer;
 struct IndexBuffer;
 struct InputLayout;
 class RenderDevice;
 
+// Lattice of an N x N quad patch, generated at compile time. Vertices are 2D uint8 lattice coordinates (the y
+// coordinate is always zero) and indices are 16-bit, in vertical stripes of Stripe quads. Stripe = N is plain row order.
+template <int N, int Stripe = TERRAIN_PATCH_STRIPE>
+struct PatchGrid
+{
+	static_assert(N > 0 && N < 256, "Lattice coordinates are stored as uint8");
+	static_assert(Stripe > 0, "Stripe width must be positive");
+
+	typedef uint16_t index_type;
+
+	static const int vertex_count = (N + 1) * (N + 1);
+	static const int index_count = N * N * 6;
+
+	uint8_t	   vertices[vertex_count * 2];
+	index_type indices[index_count];
+
+	constexpr PatchGrid() : vertices(), indices()
+	{
+		for (int y = 0; y <= N; y++)
+		{
+			for (int x = 0; x <= N; x++)
+			{
+				vertices[2 * ((N + 1) * y + x) + 0] = uint8_t(x);
+				vertices[2 * ((N + 1) * y + x) + 1] = uint8_t(y);
+			}
+		}
+
+		int i = 0;
+
+		for (int x0 = 0; x0 < N; x0 += Stripe)
+		{
+			int x1 = x0 + Stripe < N ? x0 + Stripe : N;
+
+			for (int y = 0; y < N; y++)
+			{
+				for (int x = x0; x < x1; x++)
+				{
+					indices[i++] = uint16_t((x + 0) + (N + 1) * (y + 0));
+					indices[i++] = uint16_t((x + 1) + (N + 1) * (y + 0));
+					indices[i++] = uint16_t((x + 1) + (N + 1) * (y + 1));
+
+					indices[i++] = uint16_t((x + 1) + (N + 1) * (y + 1));
+					indices[i++] = uint16_t((x + 0) + (N + 1) * (y + 1));
+					indices[i++] = uint16_t((x + 0) + (N + 1) * (y + 0));
+				}
+			}
+		}
+	}
+};
+
 struct TerrainPatch
 {
 	VertexArray*  m_vao;
@@ -14,7 +71,30 @@ struct TerrainPatch
 	InputLayout*  m_il;
 	RenderDevice* m_device;
 	int			  m_index_count;
+	int			  m_index_size; // Bytes per index, 2 or 4. Both draw paths take the index type from here.
+	int			  m_grid_dim;
+
+	// The framework's input layouts have no per-instance attributes, so instanced draws use a VAO of their own over
+	// copies of the same lattice. Changing the divisors of m_vao would leak into the per-patch draws.
+	uint32_t	  m_instanced_vao;
+	uint32_t	  m_instanced_vbo;
+	uint32_t	  m_instanced_ibo;
+
+	// Draws count instances, reading TerrainInstance records (attribute 1 and 2) from buffer at offset. Leaves no VAO bound.
+	void draw_instanced(uint32_t buffer, size_t offset, uint32_t count);
+
+	// Grid dimensions other than 4, 8, 16, 32 and 64 return nullptr.
+	static TerrainPatch* create(int grid_dim, RenderDevice* device);
+
+	template <int N>
+	static TerrainPatch* create(RenderDevice* device)
+	{
+		static constexpr PatchGrid<N> grid = PatchGrid<N>();
+		return new TerrainPatch(N, grid.vertices, sizeof(grid.vertices), grid.indices, sizeof(typename PatchGrid<N>::index_type), PatchGrid<N>::index_count, device);
+	}
 
-	TerrainPatch(int width, int height, RenderDevice* device);
 	~TerrainPatch();
+
+private:
+	TerrainPatch(int grid_dim, const uint8_t* vertices, size_t vertices_size, const void* indices, int index_size, int index_count, RenderDevice* device);
 };
\ No newline at end of file
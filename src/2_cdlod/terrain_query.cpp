@@ -0,0 +1,283 @@
+#include "terrain_query.h"
+#include "terrain_culling.h"
+#include "heightmap.h"
+#include <math.h>
+#include <algorithm>
+
+#if DW_SIMD
+#include <emmintrin.h>
+#endif
+
+#define TERRAIN_QUERY_BATCH 64
+
+namespace dw
+{
+	TerrainQuery::TerrainQuery(HeightMap* height_map, float texel_scale, float height_scale) : m_height_map(height_map), m_texel_scale(texel_scale), m_height_scale(height_scale)
+	{
+		int extent = std::max(m_height_map->width(), m_height_map->height()) - 1;
+
+		m_root_size = 1;
+
+		while (m_root_size < extent)
+			m_root_size *= 2;
+	}
+
+	float TerrainQuery::height_at(float x, float z)
+	{
+		return m_height_map->sample_bilinear(x * m_texel_scale, z * m_texel_scale) * m_height_scale;
+	}
+
+	glm::vec3 TerrainQuery::normal_at(float x, float z)
+	{
+		// Central differences one texel apart.
+		float d = 1.0f / m_texel_scale;
+
+		float dx = height_at(x - d, z) - height_at(x + d, z);
+		float dz = height_at(x, z - d) - height_at(x, z + d);
+
+		return glm::normalize(glm::vec3(dx, 2.0f * d, dz));
+	}
+
+	void TerrainQuery::heights_at(const float* x, const float* z, float* heights, uint32_t count)
+	{
+		uint32_t i = 0;
+
+#if DW_SIMD
+		const uint16_t* data = m_height_map->data();
+
+		if (data)
+		{
+			int width = m_height_map->width();
+			int height = m_height_map->height();
+
+			__m128 zero = _mm_setzero_ps();
+			__m128 texel_scale = _mm_set1_ps(m_texel_scale);
+			__m128 max_x = _mm_set1_ps(float(width - 1));
+			__m128 max_z = _mm_set1_ps(float(height - 1));
+			__m128 unorm = _mm_set1_ps(float(UINT16_MAX));
+			__m128 height_scale = _mm_set1_ps(m_height_scale);
+
+			int x0[4], z0[4];
+			float h00[4], h10[4], h01[4], h11[4];
+
+			for (; i + 4 <= count; i += 4)
+			{
+				// Same operations in the same order as HeightMap::sample_bilinear.
+				__m128 tx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(x + i), texel_scale), zero), max_x);
+				__m128 tz = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(z + i), texel_scale), zero), max_z);
+
+				__m128i ix = _mm_cvttps_epi32(tx);
+				__m128i iz = _mm_cvttps_epi32(tz);
+
+				__m128 fx = _mm_sub_ps(tx, _mm_cvtepi32_ps(ix));
+				__m128 fz = _mm_sub_ps(tz, _mm_cvtepi32_ps(iz));
+
+				_mm_storeu_si128((__m128i*)x0, ix);
+				_mm_storeu_si128((__m128i*)z0, iz);
+
+				// SSE2 has no gather.
+				for (int j = 0; j < 4; j++)
+				{
+					int x1 = std::min(x0[j] + 1, width - 1);
+					int z1 = std::min(z0[j] + 1, height - 1);
+
+					size_t row0 = size_t(width) * z0[j];
+					size_t row1 = size_t(width) * z1;
+
+					h00[j] = float(data[row0 + x0[j]]);
+					h10[j] = float(data[row0 + x1]);
+					h01[j] = float(data[row1 + x0[j]]);
+					h11[j] = float(data[row1 + x1]);
+				}
+
+				__m128 v00 = _mm_div_ps(_mm_loadu_ps(h00), unorm);
+				__m128 v10 = _mm_div_ps(_mm_loadu_ps(h10), unorm);
+				__m128 v01 = _mm_div_ps(_mm_loadu_ps(h01), unorm);
+				__m128 v11 = _mm_div_ps(_mm_loadu_ps(h11), unorm);
+
+				__m128 h0 = _mm_add_ps(v00, _mm_mul_ps(_mm_sub_ps(v10, v00), fx));
+				__m128 h1 = _mm_add_ps(v01, _mm_mul_ps(_mm_sub_ps(v11, v01), fx));
+				__m128 h = _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(h1, h0), fz));
+
+				_mm_storeu_ps(heights + i, _mm_mul_ps(h, height_scale));
+			}
+		}
+#endif
+
+		for (; i < count; i++)
+			heights[i] = height_at(x[i], z[i]);
+	}
+
+	void TerrainQuery::normals_at(const float* x, const float* z, glm::vec3* normals, uint32_t count)
+	{
+		// The central differences of normal_at(), with the four neighbour heights of a batch fetched by heights_at().
+		float d = 1.0f / m_texel_scale;
+		float xs[4][TERRAIN_QUERY_BATCH];
+		float zs[4][TERRAIN_QUERY_BATCH];
+		float h[4][TERRAIN_QUERY_BATCH];
+
+		for (uint32_t first = 0; first < count; first += TERRAIN_QUERY_BATCH)
+		{
+			uint32_t n = std::min(count - first, uint32_t(TERRAIN_QUERY_BATCH));
+
+			for (uint32_t i = 0; i < n; i++)
+			{
+				xs[0][i] = x[first + i] - d;
+				zs[0][i] = z[first + i];
+				xs[1][i] = x[first + i] + d;
+				zs[1][i] = z[first + i];
+				xs[2][i] = x[first + i];
+				zs[2][i] = z[first + i] - d;
+				xs[3][i] = x[first + i];
+				zs[3][i] = z[first + i] + d;
+			}
+
+			for (int j = 0; j < 4; j++)
+				heights_at(xs[j], zs[j], h[j], n);
+
+			for (uint32_t i = 0; i < n; i++)
+				normals[first + i] = glm::normalize(glm::vec3(h[0][i] - h[1][i], 2.0f * d, h[2][i] - h[3][i]));
+		}
+	}
+
+	bool TerrainQuery::raycast(const glm::vec3& origin, const glm::vec3& dir, float max_distance, TerrainHit& hit)
+	{
+		float length = glm::length(dir);
+
+		if (length == 0.0f)
+			return false;
+
+		// Work in texel space with normalized heights. The scaling is linear, so the ray parameter is unchanged.
+		glm::vec3 scale = glm::vec3(m_texel_scale, 1.0f / m_height_scale, m_texel_scale);
+		glm::vec3 texel_origin = origin * scale;
+		glm::vec3 texel_dir = dir * scale;
+
+		// Avoid 0 * inf in the slab tests.
+		for (int i = 0; i < 3; i++)
+		{
+			if (fabs(texel_dir[i]) < 1e-12f)
+				texel_dir[i] = texel_dir[i] < 0.0f ? -1e-12f : 1e-12f;
+		}
+
+		glm::vec3 inv_dir = glm::vec3(1.0f / texel_dir.x, 1.0f / texel_dir.y, 1.0f / texel_dir.z);
+		float t_hit;
+
+		if (!raycast_node(0, 0, m_root_size, texel_origin, texel_dir, inv_dir, 0.0f, max_distance / length, t_hit))
+			return false;
+
+		hit.position = origin + dir * t_hit;
+		hit.normal = normal_at(hit.position.x, hit.position.z);
+		hit.distance = t_hit * length;
+
+		return true;
+	}
+
+	bool TerrainQuery::raycast_node(int x, int z, int size, const glm::vec3& origin, const glm::vec3& dir, const glm::vec3& inv_dir, float t_min, float t_max, float& t_hit)
+	{
+		// The surface only exists between the first and last texel.
+		if (x >= m_height_map->width() - 1 || z >= m_height_map->height() - 1)
+			return false;
+
+		float min_h, max_h;
+		m_height_map->min_max_height(x, z, size, size, min_h, max_h);
+
+		glm::vec3 box_min = glm::vec3(float(x), min_h, float(z));
+		glm::vec3 box_max = glm::vec3(float(x + size), max_h, float(z + size));
+
+		for (int i = 0; i < 3; i++)
+		{
+			float t0 = (box_min[i] - origin[i]) * inv_dir[i];
+			float t1 = (box_max[i] - origin[i]) * inv_dir[i];
+
+			t_min = std::max(t_min, std::min(t0, t1));
+			t_max = std::min(t_max, std::max(t0, t1));
+		}
+
+		if (t_min > t_max)
+			return false;
+
+		if (size == 1)
+			return intersect_cell(x, z, origin, dir, t_min, t_max, t_hit);
+
+		// Visit the child the ray enters first, then its neighbours, then the opposite one. A ray that is monotonic in
+		// x and z can only cross one of the two neighbours, so this is front to back.
+		int half = size / 2;
+		int first = (dir.x < 0.0f ? 1 : 0) | (dir.z < 0.0f ? 2 : 0);
+		int order[] = { first, first ^ 1, first ^ 2, first ^ 3 };
+
+		for (int i = 0; i < 4; i++)
+		{
+			int cx = x + (order[i] & 1) * half;
+			int cz = z + (order[i] >> 1) * half;
+
+			if (raycast_node(cx, cz, half, origin, dir, inv_dir, t_min, t_max, t_hit))
+				return true;
+		}
+
+		return false;
+	}
+
+	bool TerrainQuery::intersect_cell(int x, int z, const glm::vec3& origin, const glm::vec3& dir, float t_min, float t_max, float& t_hit)
+	{
+		float h00 = m_height_map->sample(x, z);
+		float h10 = m_height_map->sample(x + 1, z);
+		float h01 = m_height_map->sample(x, z + 1);
+		float h11 = m_height_map->sample(x + 1, z + 1);
+
+		// Bilinear patch h(u, v) = h00 + a * u + b * v + c * u * v along the ray gives a quadratic in t.
+		float a = h10 - h00;
+		float b = h01 - h00;
+		float c = h00 - h10 - h01 + h11;
+
+		float u0 = origin.x - float(x);
+		float v0 = origin.z - float(z);
+
+		float qa = -c * dir.x * dir.z;
+		float qb = dir.y - (a * dir.x + b * dir.z + c * (u0 * dir.z + v0 * dir.x));
+		float qc = origin.y - (h00 + a * u0 + b * v0 + c * u0 * v0);
+
+		// Starting below the surface counts as a hit where the ray enters the cell.
+		if ((qa * t_min + qb) * t_min + qc <= 0.0f)
+		{
+			t_hit = t_min;
+			return true;
+		}
+
+		float roots[2];
+		int root_count = 0;
+
+		if (fabs(qa) < 1e-12f)
+		{
+			if (qb != 0.0f)
+				roots[root_count++] = -qc / qb;
+		}
+		else
+		{
+			float disc = qb * qb - 4.0f * qa * qc;
+
+			if (disc < 0.0f)
+				return false;
+
+			// Numerically stable form of the quadratic formula.
+			float q = -0.5f * (qb + (qb < 0.0f ? -sqrt(disc) : sqrt(disc)));
+
+			roots[root_count++] = q / qa;
+
+			if (q != 0.0f)
+				roots[root_count++] = qc / q;
+		}
+
+		bool found = false;
+
+		for (int i = 0; i < root_count; i++)
+		{
+			if (roots[i] >= t_min && roots[i] <= t_max && (!found || roots[i] < t_hit))
+			{
+				t_hit = roots[i];
+				found = true;
+			}
+		}
+
+		return found;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <glm.hpp>
+
+class HeightMap;
+
+namespace dw
+{
+	struct TerrainHit
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		float	  distance;
+	};
+
+	// CPU queries against the same bilinear surface the terrain renders (before morphing). World positions map to
+	// texels through texel_scale, heights are scaled by height_scale. Queries only read the heightmap and are thread
+	// safe, tiled heightmaps are sampled straight from their mapping.
+	class TerrainQuery
+	{
+	public:
+		TerrainQuery(HeightMap* height_map, float texel_scale, float height_scale);
+		float height_at(float x, float z);
+		glm::vec3 normal_at(float x, float z);
+		// Four points at a time with SSE2 for raw heightmaps. Bit identical to height_at().
+		void heights_at(const float* x, const float* z, float* heights, uint32_t count);
+		// Batched on top of heights_at(). Bit identical to normal_at().
+		void normals_at(const float* x, const float* z, glm::vec3* normals, uint32_t count);
+		// First intersection of the ray with the terrain within max_distance. dir does not need to be normalized.
+		// Walks the min/max pyramid front to back and only intersects the bilinear quads of the cells it reaches.
+		bool raycast(const glm::vec3& origin, const glm::vec3& dir, float max_distance, TerrainHit& hit);
+
+	private:
+		bool raycast_node(int x, int z, int size, const glm::vec3& origin, const glm::vec3& dir, const glm::vec3& inv_dir, float t_min, float t_max, float& t_hit);
+		bool intersect_cell(int x, int z, const glm::vec3& origin, const glm::vec3& dir, float t_min, float t_max, float& t_hit);
+
+	private:
+		HeightMap* m_height_map;
+		float	   m_texel_scale;
+		float	   m_height_scale;
+		int		   m_root_size; // Smallest power of two covering the heightmap, in texels.
+	};
+}
\ No newline at end of file
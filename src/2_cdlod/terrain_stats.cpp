@@ -0,0 +1,162 @@
+#include "terrain_stats.h"
+#include "node.h"
+#include <logger.h>
+#include <stb_image_write.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+namespace dw
+{
+	void count_terrain_patches(const std::vector<Node>& patches, int lod_count, int patch_resolution, TerrainStats& stats)
+	{
+		stats.patches = uint32_t(patches.size());
+		stats.full_patches = 0;
+		stats.half_patches = 0;
+		stats.lod_count = uint32_t(std::min(lod_count, TERRAIN_STATS_MAX_LODS));
+		stats.triangles = 0;
+
+		memset(stats.patches_per_lod, 0, sizeof(stats.patches_per_lod));
+
+		uint32_t full_triangles = 2 * patch_resolution * patch_resolution;
+		uint32_t half_triangles = full_triangles / 4;
+
+		for (const Node& node : patches)
+		{
+			if (node.full_resolution)
+			{
+				stats.full_patches++;
+				stats.triangles += full_triangles;
+			}
+			else
+			{
+				stats.half_patches++;
+				stats.triangles += half_triangles;
+			}
+
+			if (node.lod_level < TERRAIN_STATS_MAX_LODS)
+				stats.patches_per_lod[node.lod_level]++;
+		}
+	}
+
+	TerrainStatsLog::TerrainStatsLog() : m_file(nullptr), m_json(false), m_interval(1), m_buffered_rows(0)
+	{
+
+	}
+
+	TerrainStatsLog::~TerrainStatsLog()
+	{
+		close();
+	}
+
+	bool TerrainStatsLog::open(const std::string& file, int interval)
+	{
+		close();
+
+		m_file = fopen(file.c_str(), "w");
+
+		if (!m_file)
+		{
+			LOG_ERROR("Failed to open terrain stats log");
+			return false;
+		}
+
+		m_json = file.size() >= 5 && file.compare(file.size() - 5, 5, ".json") == 0;
+		m_interval = std::max(interval, 1);
+		m_buffered_rows = 0;
+		m_buffer.clear();
+
+		if (!m_json)
+		{
+			m_buffer = "frame,patches,full_patches,half_patches,triangles,nodes_visited,sphere_culled,frustum_culled,reselected_roots,selection_ms,upload_ms";
+
+			for (int i = 0; i < TERRAIN_STATS_MAX_LODS; i++)
+				m_buffer += ",lod" + std::to_string(i);
+
+			m_buffer += "\n";
+		}
+
+		return true;
+	}
+
+	void TerrainStatsLog::close()
+	{
+		if (!m_file)
+			return;
+
+		flush();
+		fclose(m_file);
+		m_file = nullptr;
+	}
+
+	void TerrainStatsLog::record(const TerrainStats& stats)
+	{
+		if (!m_file || stats.frame % m_interval != 0)
+			return;
+
+		char row[1024];
+		int length = snprintf(row, sizeof(row), m_json ? "{\"frame\":%llu,\"patches\":%u,\"full_patches\":%u,\"half_patches\":%u,\"triangles\":%u,\"nodes_visited\":%u,\"sphere_culled\":%u,\"frustum_culled\":%u,\"reselected_roots\":%u,\"selection_ms\":%.4f,\"upload_ms\":%.4f,\"patches_per_lod\":[" : "%llu,%u,%u,%u,%u,%u,%u,%u,%u,%.4f,%.4f",
+							  (unsigned long long)stats.frame, stats.patches, stats.full_patches, stats.half_patches, stats.triangles, stats.nodes_visited, stats.sphere_culled, stats.frustum_culled, stats.reselected_roots, stats.selection_ms, stats.upload_ms);
+
+		// CSV rows always have every LOD column, JSON arrays only the levels the terrain has.
+		int lod_columns = m_json ? int(stats.lod_count) : TERRAIN_STATS_MAX_LODS;
+
+		for (int i = 0; i < lod_columns; i++)
+			length += snprintf(row + length, sizeof(row) - length, m_json && i == 0 ? "%u" : ",%u", stats.patches_per_lod[i]);
+
+		snprintf(row + length, sizeof(row) - length, m_json ? "]}\n" : "\n");
+
+		m_buffer += row;
+
+		if (++m_buffered_rows >= TERRAIN_STATS_FLUSH_FRAMES)
+			flush();
+	}
+
+	void TerrainStatsLog::flush()
+	{
+		if (m_buffer.size() > 0)
+			fwrite(m_buffer.c_str(), 1, m_buffer.size(), m_file);
+
+		fflush(m_file);
+		m_buffer.clear();
+		m_buffered_rows = 0;
+	}
+
+	bool write_lod_heatmap(const std::string& file, const std::vector<Node>& patches, int lod_count, float world_width, float world_depth, int image_width)
+	{
+		if (image_width <= 0 || world_width <= 0.0f || world_depth <= 0.0f)
+			return false;
+
+		float scale = float(image_width) / world_width;
+		int image_height = std::max(int(world_depth * scale + 0.5f), 1);
+
+		std::vector<uint8_t> pixels(size_t(image_width) * image_height * 3, 0);
+
+		for (const Node& node : patches)
+		{
+			float t = lod_count > 1 ? float(node.lod_level) / float(lod_count - 1) : 0.0f;
+			float brightness = node.full_resolution ? 255.0f : 127.0f;
+
+			uint8_t color[] = { uint8_t((1.0f - t) * brightness), uint8_t((1.0f - fabs(2.0f * t - 1.0f)) * brightness), uint8_t(t * brightness) };
+
+			int x0 = std::max(int(node.x_pos * scale), 0);
+			int y0 = std::max(int(node.z_pos * scale), 0);
+			int x1 = std::min(int((node.x_pos + node.size) * scale), image_width);
+			int y1 = std::min(int((node.z_pos + node.size) * scale), image_height);
+
+			for (int y = y0; y < y1; y++)
+			{
+				for (int x = x0; x < x1; x++)
+					memcpy(&pixels[3 * (size_t(image_width) * y + x)], color, 3);
+			}
+		}
+
+		if (!stbi_write_png(file.c_str(), image_width, image_height, 3, &pixels[0], image_width * 3))
+		{
+			LOG_ERROR("Failed to write LOD heatmap");
+			return false;
+		}
+
+		return true;
+	}
+}
\ No newline at end of file
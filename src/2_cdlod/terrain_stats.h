@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+
+#define TERRAIN_STATS_MAX_LODS 16
+#define TERRAIN_STATS_FLUSH_FRAMES 60
+
+namespace dw
+{
+	struct Node;
+
+	struct TerrainStats
+	{
+		uint64_t frame;
+		uint32_t patches;
+		uint32_t full_patches;
+		uint32_t half_patches;
+		uint32_t lod_count;
+		uint32_t patches_per_lod[TERRAIN_STATS_MAX_LODS];
+		uint32_t triangles;
+		uint32_t nodes_visited;	 // Only counts roots that were reselected this frame.
+		uint32_t sphere_culled;	 // Sphere and frustum culling describe the whole current selection.
+		uint32_t frustum_culled;
+		uint32_t reselected_roots;
+		float	 selection_ms;
+		float	 upload_ms;
+	};
+
+	// Fills in the patch counts of a selection. patch_resolution is the quads per side of a full resolution patch.
+	void count_terrain_patches(const std::vector<Node>& patches, int lod_count, int patch_resolution, TerrainStats& stats);
+
+	// Appends one row per recorded frame to a CSV file, or one JSON object per line if the file ends in ".json".
+	// Rows are buffered and only written every TERRAIN_STATS_FLUSH_FRAMES recorded frames, so recording stays off
+	// the file system most frames.
+	class TerrainStatsLog
+	{
+	public:
+		TerrainStatsLog();
+		~TerrainStatsLog();
+		// Records every interval-th frame.
+		bool open(const std::string& file, int interval = 1);
+		void close();
+		void record(const TerrainStats& stats);
+		inline bool is_open() { return m_file != nullptr; }
+
+	private:
+		void flush();
+
+	private:
+		FILE* m_file;
+		bool m_json;
+		int m_interval;
+		int m_buffered_rows;
+		std::string m_buffer;
+	};
+
+	// Top-down PNG of a selection, image_width pixels across the world width. Patches are colored from red (finest LOD)
+	// to blue (coarsest), half resolution patches at half brightness. Uncovered pixels stay black.
+	bool write_lod_heatmap(const std::string& file, const std::vector<Node>& patches, int lod_count, float world_width, float world_depth, int image_width);
+}
\ No newline at end of file
@@ -0,0 +1,394 @@
+#include "tiled_heightmap.h"
+#include <logger.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace dw
+{
+	MappedFile::MappedFile() : m_data(nullptr), m_size(0)
+	{
+#ifdef WIN32
+		m_file = INVALID_HANDLE_VALUE;
+		m_mapping = nullptr;
+#else
+		m_fd = -1;
+#endif
+	}
+
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+#ifdef WIN32
+		m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+		if (m_file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+
+		if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+
+		m_size = size_t(size.QuadPart);
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+		if (!m_mapping)
+		{
+			close();
+			return false;
+		}
+
+		m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		m_fd = ::open(path.c_str(), O_RDONLY);
+
+		if (m_fd < 0)
+			return false;
+
+		struct stat st;
+
+		if (fstat(m_fd, &st) != 0 || st.st_size == 0)
+		{
+			close();
+			return false;
+		}
+
+		m_size = size_t(st.st_size);
+
+		void* ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+		m_data = ptr == MAP_FAILED ? nullptr : (const uint8_t*)ptr;
+#endif
+
+		if (!m_data)
+		{
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+#ifdef WIN32
+		if (m_data)
+			UnmapViewOfFile(m_data);
+
+		if (m_mapping)
+			CloseHandle(m_mapping);
+
+		if (m_file != INVALID_HANDLE_VALUE)
+			CloseHandle(m_file);
+
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if (m_data)
+			munmap((void*)m_data, m_size);
+
+		if (m_fd >= 0)
+			::close(m_fd);
+
+		m_fd = -1;
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	bool TiledHeightMap::convert(const std::string& raw_file, int width, int height, int tile_size, const std::string& out_file)
+	{
+		// Tiles have to line up with the levels of the min/max pyramid.
+		if (width <= 0 || height <= 0 || tile_size <= 0 || (tile_size & (tile_size - 1)) != 0)
+			return false;
+
+		FILE* src = fopen(raw_file.c_str(), "rb");
+
+		if (!src)
+		{
+			LOG_ERROR("Failed to open source heightmap");
+			return false;
+		}
+
+		FILE* dst = fopen(out_file.c_str(), "wb");
+
+		if (!dst)
+		{
+			fclose(src);
+			LOG_ERROR("Failed to create tiled heightmap");
+			return false;
+		}
+
+		TiledHeightMapHeader header;
+
+		header.magic = TILED_HEIGHTMAP_MAGIC;
+		header.version = TILED_HEIGHTMAP_VERSION;
+		header.width = width;
+		header.height = height;
+		header.tile_size = tile_size;
+		header.tiles_x = (width + tile_size - 1) / tile_size;
+		header.tiles_y = (height + tile_size - 1) / tile_size;
+		header.border = TILED_HEIGHTMAP_BORDER;
+
+		int border = TILED_HEIGHTMAP_BORDER;
+		int stored_size = tile_size + 2 * border;
+
+		// A band holds the source rows of one row of tiles, including the border rows above and below. Consecutive
+		// bands overlap by 2 * border rows, which are carried over, so the source is read once and in order.
+		std::vector<uint16_t> min_max(header.tiles_x * header.tiles_y * 2);
+		std::vector<uint16_t> band(size_t(width) * stored_size);
+		std::vector<uint16_t> tile(size_t(stored_size) * stored_size);
+		int next_row = 0;
+
+		// The min/max table is written last, once every tile has been seen.
+		bool success = fwrite(&header, sizeof(header), 1, dst) == 1;
+		success = success && fwrite(&min_max[0], sizeof(uint16_t), min_max.size(), dst) == min_max.size();
+
+		for (uint32_t ty = 0; ty < header.tiles_y && success; ty++)
+		{
+			for (int r = 0; r < stored_size && success; r++)
+			{
+				uint16_t* row = &band[size_t(width) * r];
+				int sy = std::max(std::min(int(ty) * tile_size - border + r, height - 1), 0);
+
+				if (ty > 0 && r < 2 * border)
+					memcpy(row, &band[size_t(width) * (tile_size + r)], sizeof(uint16_t) * width);
+				else if (sy < next_row)
+					memcpy(row, row - width, sizeof(uint16_t) * width); // Clamped, same row as the one above.
+				else if (fread(row, sizeof(uint16_t), width, src) == size_t(width))
+					next_row++;
+				else
+				{
+					LOG_ERROR("Source heightmap is smaller than the given dimensions");
+					success = false;
+				}
+			}
+
+			for (uint32_t tx = 0; tx < header.tiles_x && success; tx++)
+			{
+				uint16_t min_val = UINT16_MAX;
+				uint16_t max_val = 0;
+
+				for (int y = 0; y < stored_size; y++)
+				{
+					for (int x = 0; x < stored_size; x++)
+					{
+						int sx = std::max(std::min(int(tx) * tile_size - border + x, width - 1), 0);
+						uint16_t value = band[size_t(width) * y + sx];
+
+						tile[stored_size * y + x] = value;
+
+						// The bounds only cover the tile itself, the border belongs to the neighbours.
+						if (x >= border && x < border + tile_size && y >= border && y < border + tile_size)
+						{
+							min_val = std::min(min_val, value);
+							max_val = std::max(max_val, value);
+						}
+					}
+				}
+
+				min_max[(header.tiles_x * ty + tx) * 2 + 0] = min_val;
+				min_max[(header.tiles_x * ty + tx) * 2 + 1] = max_val;
+
+				if (fwrite(&tile[0], sizeof(uint16_t), tile.size(), dst) != tile.size())
+					success = false;
+			}
+		}
+
+		if (success)
+		{
+			success = fseek(dst, sizeof(header), SEEK_SET) == 0;
+			success = success && fwrite(&min_max[0], sizeof(uint16_t), min_max.size(), dst) == min_max.size();
+		}
+
+		fclose(src);
+		fclose(dst);
+
+		if (!success)
+			LOG_ERROR("Failed to write tiled heightmap");
+
+		return success;
+	}
+
+	TiledHeightMap::TiledHeightMap() : m_min_max(nullptr), m_tiles(nullptr), m_max_resident_tiles(0), m_page_ins(0), m_evictions(0), m_dropped_requests(0), m_frame(0)
+	{
+		memset(&m_header, 0, sizeof(m_header));
+	}
+
+	TiledHeightMap::~TiledHeightMap()
+	{
+		close();
+	}
+
+	bool TiledHeightMap::open(const std::string& file, int max_resident_tiles)
+	{
+		close();
+
+		if (!m_file.open(file))
+		{
+			LOG_ERROR("Failed to map tiled heightmap");
+			return false;
+		}
+
+		if (m_file.size() < sizeof(TiledHeightMapHeader))
+		{
+			close();
+			return false;
+		}
+
+		memcpy(&m_header, m_file.data(), sizeof(TiledHeightMapHeader));
+
+		size_t tile_count = size_t(m_header.tiles_x) * m_header.tiles_y;
+		size_t table_size = tile_count * 2 * sizeof(uint16_t);
+		size_t tiles_size = tile_count * stored_tile_size() * stored_tile_size() * sizeof(uint16_t);
+
+		if (m_header.magic != TILED_HEIGHTMAP_MAGIC || m_header.version != TILED_HEIGHTMAP_VERSION || m_header.tile_size == 0 || (m_header.tile_size & (m_header.tile_size - 1)) != 0 ||
+			m_header.border != TILED_HEIGHTMAP_BORDER || m_file.size() < sizeof(TiledHeightMapHeader) + table_size + tiles_size)
+		{
+			LOG_ERROR("Invalid tiled heightmap");
+			close();
+			return false;
+		}
+
+		m_min_max = (const uint16_t*)(m_file.data() + sizeof(TiledHeightMapHeader));
+		m_tiles = (const uint16_t*)(m_file.data() + sizeof(TiledHeightMapHeader) + table_size);
+		m_max_resident_tiles = std::max(max_resident_tiles, 1);
+
+		m_slots.resize(m_max_resident_tiles);
+
+		for (int i = m_max_resident_tiles - 1; i >= 0; i--)
+			m_free_slots.push_back(i);
+
+		return true;
+	}
+
+	void TiledHeightMap::close()
+	{
+		m_file.close();
+		m_min_max = nullptr;
+		m_tiles = nullptr;
+		m_slots.clear();
+		m_free_slots.clear();
+		m_dirty_slots.clear();
+		m_lru.clear();
+		m_resident.clear();
+		m_frame = 0;
+	}
+
+	const uint16_t* TiledHeightMap::tile(int tx, int ty)
+	{
+		uint32_t id = m_header.tiles_x * ty + tx;
+		auto it = m_resident.find(id);
+
+		if (it != m_resident.end())
+		{
+			m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it);
+			it->second.frame = m_frame;
+			return &m_slots[it->second.slot][0];
+		}
+
+		if (m_free_slots.empty())
+		{
+			uint32_t victim = m_lru.back();
+			auto victim_it = m_resident.find(victim);
+
+			// The least recently used tile belongs to this frame, so all of them do.
+			if (victim_it->second.frame == m_frame)
+			{
+				m_dropped_requests++;
+				return nullptr;
+			}
+
+			m_free_slots.push_back(victim_it->second.slot);
+			m_lru.pop_back();
+			m_resident.erase(victim_it);
+			m_evictions++;
+		}
+
+		int slot = m_free_slots.back();
+		m_free_slots.pop_back();
+
+		size_t texels = size_t(stored_tile_size()) * stored_tile_size();
+		const uint16_t* src = m_tiles + texels * id;
+
+		m_slots[slot].assign(src, src + texels);
+		m_dirty_slots.push_back(slot);
+
+		m_lru.push_front(id);
+
+		ResidentTile resident;
+		resident.lru_it = m_lru.begin();
+		resident.slot = slot;
+		resident.frame = m_frame;
+
+		m_resident[id] = resident;
+		m_page_ins++;
+
+		return &m_slots[slot][0];
+	}
+
+	void TiledHeightMap::request_region(int x, int y, int width, int height)
+	{
+		int tile_size = m_header.tile_size;
+		int tx0 = std::max(x, 0) / tile_size;
+		int ty0 = std::max(y, 0) / tile_size;
+		int tx1 = std::min(std::max(x + width, 0) / tile_size, int(m_header.tiles_x) - 1);
+		int ty1 = std::min(std::max(y + height, 0) / tile_size, int(m_header.tiles_y) - 1);
+
+		for (int ty = ty0; ty <= ty1; ty++)
+		{
+			for (int tx = tx0; tx <= tx1; tx++)
+				tile(tx, ty);
+		}
+	}
+
+	void TiledHeightMap::end_frame()
+	{
+		m_frame++;
+	}
+
+	uint16_t TiledHeightMap::sample(int x, int y)
+	{
+		x = std::max(std::min(x, int(m_header.width) - 1), 0);
+		y = std::max(std::min(y, int(m_header.height) - 1), 0);
+
+		int tile_size = m_header.tile_size;
+		int stored_size = stored_tile_size();
+		size_t id = size_t(m_header.tiles_x) * (y / tile_size) + (x / tile_size);
+		const uint16_t* data = m_tiles + size_t(stored_size) * stored_size * id;
+
+		return data[stored_size * (y % tile_size + m_header.border) + (x % tile_size + m_header.border)];
+	}
+
+	void TiledHeightMap::tile_min_max(int tx, int ty, uint16_t& min_val, uint16_t& max_val)
+	{
+		size_t idx = (size_t(m_header.tiles_x) * ty + tx) * 2;
+
+		min_val = m_min_max[idx + 0];
+		max_val = m_min_max[idx + 1];
+	}
+
+	int TiledHeightMap::tile_slot(int tx, int ty)
+	{
+		auto it = m_resident.find(m_header.tiles_x * ty + tx);
+		return it != m_resident.end() ? it->second.slot : -1;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <stdint.h>
+
+#define TILED_HEIGHTMAP_MAGIC 0x36315254 // "TR16"
+#define TILED_HEIGHTMAP_VERSION 2
+// Texels each stored tile repeats from its neighbours on every side, so LINEAR filtering is seamless across tiles.
+#define TILED_HEIGHTMAP_BORDER 1
+
+namespace dw
+{
+	// Read-only memory mapping of a whole file.
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+		bool open(const std::string& path);
+		void close();
+		inline const uint8_t* data() { return m_data; }
+		inline size_t size() { return m_size; }
+
+	private:
+		const uint8_t* m_data;
+		size_t m_size;
+#ifdef WIN32
+		void* m_file;
+		void* m_mapping;
+#else
+		int m_fd;
+#endif
+	};
+
+	// Layout of a .tr16 file:
+	//   TiledHeightMapHeader
+	//   uint16_t min_max[tiles_y][tiles_x][2]
+	//   uint16_t tiles[tiles_y][tiles_x][tile_size + 2 * border][tile_size + 2 * border]
+	// Each stored tile is the tile_size x tile_size tile plus a border of neighbouring texels. Everything outside
+	// the heightmap is padded by clamping.
+	struct TiledHeightMapHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t tile_size;
+		uint32_t tiles_x;
+		uint32_t tiles_y;
+		uint32_t border;
+	};
+
+	// Heightmap that is paged in from a memory mapped .tr16 file one tile at a time. At most max_resident_tiles
+	// tiles are kept in memory; the least recently used one is evicted when a new tile is needed. Each resident
+	// tile owns a slot index, which is what a GPU tile array would use as its layer.
+	// Tiles requested in the current frame are pinned: once every slot holds one, further requests are dropped
+	// instead of evicting tiles the frame still needs.
+	class TiledHeightMap
+	{
+	public:
+		// Converts a raw 16-bit heightmap into a .tr16 file. Reads the source one row of tiles at a time.
+		static bool convert(const std::string& raw_file, int width, int height, int tile_size, const std::string& out_file);
+
+		TiledHeightMap();
+		~TiledHeightMap();
+		bool open(const std::string& file, int max_resident_tiles);
+		void close();
+		// Makes a tile resident and returns its stored texels, border included. Returns nullptr if every slot is
+		// pinned by the current frame.
+		const uint16_t* tile(int tx, int ty);
+		void request_region(int x, int y, int width, int height);
+		// Unpins the tiles of the current frame.
+		void end_frame();
+		// Reads straight from the mapping and leaves residency alone, so it is safe to call from any thread.
+		uint16_t sample(int x, int y);
+		void tile_min_max(int tx, int ty, uint16_t& min_val, uint16_t& max_val);
+		int tile_slot(int tx, int ty);
+		inline const uint16_t* slot_data(int slot) { return &m_slots[slot][0]; }
+		// Slots that were (re)filled since the last call to clear_dirty_slots().
+		inline const std::vector<int>& dirty_slots() { return m_dirty_slots; }
+		inline void clear_dirty_slots() { m_dirty_slots.clear(); }
+		inline int width() { return m_header.width; }
+		inline int height() { return m_header.height; }
+		inline int tile_size() { return m_header.tile_size; }
+		inline int border() { return m_header.border; }
+		// Width and height of a stored tile.
+		inline int stored_tile_size() { return m_header.tile_size + 2 * m_header.border; }
+		inline int tiles_x() { return m_header.tiles_x; }
+		inline int tiles_y() { return m_header.tiles_y; }
+		inline int resident_tiles() { return int(m_resident.size()); }
+		inline uint64_t page_ins() { return m_page_ins; }
+		inline uint64_t evictions() { return m_evictions; }
+		// Requests dropped because the frame needed more tiles than there are slots.
+		inline uint64_t dropped_requests() { return m_dropped_requests; }
+
+	private:
+		struct ResidentTile
+		{
+			std::list<uint32_t>::iterator lru_it;
+			int slot;
+			uint64_t frame;
+		};
+
+		MappedFile m_file;
+		TiledHeightMapHeader m_header;
+		const uint16_t* m_min_max;
+		const uint16_t* m_tiles;
+		int m_max_resident_tiles;
+		std::vector< std::vector<uint16_t> > m_slots;
+		std::vector<int> m_free_slots;
+		std::vector<int> m_dirty_slots;
+		std::list<uint32_t> m_lru; // Front is the most recently used tile.
+		std::unordered_map<uint32_t, ResidentTile> m_resident;
+		uint64_t m_page_ins;
+		uint64_t m_evictions;
+		uint64_t m_dropped_requests;
+		uint64_t m_frame;
+	};
+}
\ No newline at end of file
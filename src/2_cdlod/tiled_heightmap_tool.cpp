@@ -0,0 +1,40 @@
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+
+#include "tiled_heightmap.h"
+
+// Converts a raw 16-bit heightmap into a tiled .tr16 file, which the terrain streams instead of loading it whole.
+// Usage: 2_cdlod_tile_heightmap <heightmap.raw> <width> <height> <tile size> <output.tr16>
+int main(int argc, const char* argv[])
+{
+	if (argc < 6)
+	{
+		std::cout << "Usage: 2_cdlod_tile_heightmap <heightmap.raw> <width> <height> <tile size> <output.tr16>" << std::endl;
+		return 1;
+	}
+
+	int width = atoi(argv[2]);
+	int height = atoi(argv[3]);
+	int tile_size = atoi(argv[4]);
+
+	if (!dw::TiledHeightMap::convert(argv[1], width, height, tile_size, argv[5]))
+	{
+		std::cout << "Failed to convert heightmap, the tile size has to be a power of two" << std::endl;
+		return 1;
+	}
+
+	// Reopen the result, the same way the terrain does.
+	dw::TiledHeightMap tiled;
+
+	if (!tiled.open(argv[5], 1))
+	{
+		std::cout << "Failed to open " << argv[5] << std::endl;
+		return 1;
+	}
+
+	std::cout << "Heightmap : " << tiled.width() << " x " << tiled.height() << std::endl;
+	std::cout << "Tiles     : " << tiled.tiles_x() << " x " << tiled.tiles_y() << " of " << tiled.tile_size() << " x " << tiled.tile_size() << " (" << tiled.border() << " texel border)" << std::endl;
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "depth_reduction.h"
+#include <math.h>
+#include <algorithm>
+
+float linearize_depth(float depth, float near_plane, float far_plane)
+{
+	float z_ndc = 2.0f * depth - 1.0f;
+	return (2.0f * near_plane * far_plane) / (far_plane + near_plane - z_ndc * (far_plane - near_plane));
+}
+
+bool reduce_depth_buffer(const float* depth, int width, int height, float near_plane, float far_plane, DepthRange& range)
+{
+	// Depth is monotonic in distance, so reduce the raw values and only linearize the two results.
+	float min_depth = 1.0f;
+	float max_depth = 0.0f;
+	size_t count = size_t(width) * height;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		float d = depth[i];
+
+		if (d >= 1.0f)
+			continue;
+
+		min_depth = std::min(min_depth, d);
+		max_depth = std::max(max_depth, d);
+	}
+
+	if (min_depth > max_depth)
+		return false;
+
+	range.min = linearize_depth(min_depth, near_plane, far_plane);
+	range.max = linearize_depth(max_depth, near_plane, far_plane);
+
+	return true;
+}
+
+bool scene_depth_range(const glm::mat4& view, const glm::mat4& projection, const ShadowCaster* boxes, uint32_t count, float near_plane, float far_plane, DepthRange& range)
+{
+	// Frustum planes of the view projection matrix, pointing inward.
+	glm::mat4 view_proj = glm::transpose(projection * view);
+	glm::vec4 planes[6];
+
+	for (int i = 0; i < 3; i++)
+	{
+		planes[2 * i] = view_proj[3] + view_proj[i];
+		planes[2 * i + 1] = view_proj[3] - view_proj[i];
+	}
+
+	range.min = far_plane;
+	range.max = near_plane;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		glm::vec3 center = (boxes[i].min + boxes[i].max) * 0.5f;
+		glm::vec3 extents = (boxes[i].max - boxes[i].min) * 0.5f;
+		bool visible = true;
+
+		for (int j = 0; j < 6 && visible; j++)
+		{
+			glm::vec3 n = glm::vec3(planes[j]);
+			visible = glm::dot(n, center) + glm::dot(glm::abs(n), extents) + planes[j].w >= 0.0f;
+		}
+
+		if (!visible)
+			continue;
+
+		// The camera looks down -z, so the distance is the negated view space z.
+		float distance = -(view[0][2] * center.x + view[1][2] * center.y + view[2][2] * center.z + view[3][2]);
+		float radius = fabs(view[0][2]) * extents.x + fabs(view[1][2]) * extents.y + fabs(view[2][2]) * extents.z;
+
+		range.min = std::min(range.min, std::max(distance - radius, near_plane));
+		range.max = std::max(range.max, std::min(distance + radius, far_plane));
+	}
+
+	return range.min <= range.max;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <glm.hpp>
+#include "shadow_culling.h"
+
+// Linear view space distances along the camera's forward axis.
+struct DepthRange
+{
+	float min;
+	float max;
+};
+
+// Converts a [0, 1] window space depth of an OpenGL perspective projection to a linear view distance.
+float linearize_depth(float depth, float near_plane, float far_plane);
+
+// Reference reduction of a depth buffer to the range of visible geometry. Texels at the far plane are treated as
+// background and skipped. Returns false if the buffer only contains background.
+bool reduce_depth_buffer(const float* depth, int width, int height, float near_plane, float far_plane, DepthRange& range);
+
+// Range of the parts of the boxes inside the view frustum, clamped to [near_plane, far_plane]. A cheaper stand in for
+// reading back the depth buffer, but looser since occluded boxes still count. Returns false if no box is visible.
+bool scene_depth_range(const glm::mat4& view, const glm::mat4& projection, const ShadowCaster* boxes, uint32_t count, float near_plane, float far_plane, DepthRange& range);
\ No newline at end of file
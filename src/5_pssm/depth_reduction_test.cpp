@@ -0,0 +1,100 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <math.h>
+#include <gtc/matrix_transform.hpp>
+
+#include "depth_reduction.h"
+
+#define TEST_WIDTH 64
+#define TEST_HEIGHT 48
+#define TEST_NEAR 0.1f
+#define TEST_FAR 1000.0f
+
+// Window space depth of a view space point, as the rasterizer would write it.
+float window_depth(const glm::mat4& projection, const glm::vec3& view_pos)
+{
+	glm::vec4 clip = projection * glm::vec4(view_pos, 1.0f);
+	return (clip.z / clip.w) * 0.5f + 0.5f;
+}
+
+bool near_equal(float a, float b)
+{
+	return fabs(a - b) <= 1e-3f * std::max(1.0f, fabs(b));
+}
+
+int main()
+{
+	int failures = 0;
+	glm::mat4 projection = glm::perspective(glm::radians(60.0f), float(TEST_WIDTH) / float(TEST_HEIGHT), TEST_NEAR, TEST_FAR);
+	std::vector<float> depth(TEST_WIDTH * TEST_HEIGHT, 1.0f);
+	DepthRange range;
+
+	// Nothing but background.
+	if (reduce_depth_buffer(&depth[0], TEST_WIDTH, TEST_HEIGHT, TEST_NEAR, TEST_FAR, range))
+	{
+		std::cout << "Background only buffer reported a range" << std::endl;
+		failures++;
+	}
+
+	// A few texels at known distances, the rest background.
+	float distances[] = { 5.0f, 40.0f, 120.0f, 37.5f };
+
+	for (int i = 0; i < 4; i++)
+		depth[(TEST_WIDTH + 7) * (i + 1)] = window_depth(projection, glm::vec3(0.0f, 0.0f, -distances[i]));
+
+	if (!reduce_depth_buffer(&depth[0], TEST_WIDTH, TEST_HEIGHT, TEST_NEAR, TEST_FAR, range) || !near_equal(range.min, 5.0f) || !near_equal(range.max, 120.0f))
+	{
+		std::cout << "Wrong range for known distances" << std::endl;
+		failures++;
+	}
+
+	// scene_depth_range() is a stand in for the reduction, so for every box it has to cover what the depth buffer
+	// would hold for points inside the box.
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> pos_dist(-60.0f, 60.0f);
+	std::uniform_real_distribution<float> z_dist(-300.0f, -1.0f);
+	std::uniform_real_distribution<float> size_dist(0.5f, 20.0f);
+	glm::mat4 view = glm::mat4(1.0f);
+
+	for (int test = 0; test < 1000; test++)
+	{
+		ShadowCaster box;
+		glm::vec3 center = glm::vec3(pos_dist(rng), pos_dist(rng), z_dist(rng));
+		glm::vec3 extents = glm::vec3(size_dist(rng), size_dist(rng), size_dist(rng));
+
+		box.min = center - extents;
+		box.max = center + extents;
+		box.dynamic = false;
+
+		std::fill(depth.begin(), depth.end(), 1.0f);
+
+		for (int i = 0; i < 64; i++)
+		{
+			glm::vec3 t = glm::vec3(float(i & 3), float((i >> 2) & 3), float(i >> 4)) / 3.0f;
+			glm::vec3 p = box.min + (box.max - box.min) * t;
+			glm::vec4 clip = projection * glm::vec4(p, 1.0f);
+
+			// Only points the camera would actually rasterize.
+			if (clip.w <= 0.0f || fabs(clip.x) > clip.w || fabs(clip.y) > clip.w || fabs(clip.z) > clip.w)
+				continue;
+
+			depth[i] = window_depth(projection, p);
+		}
+
+		DepthRange reduced, scene;
+
+		if (!reduce_depth_buffer(&depth[0], TEST_WIDTH, TEST_HEIGHT, TEST_NEAR, TEST_FAR, reduced))
+			continue;
+
+		if (!scene_depth_range(view, projection, &box, 1, TEST_NEAR, TEST_FAR, scene) || scene.min > reduced.min * 1.001f || scene.max < reduced.max * 0.999f)
+		{
+			std::cout << "Scene range does not cover the depth buffer range" << std::endl;
+			failures++;
+		}
+	}
+
+	std::cout << "Failures : " << failures << std::endl;
+
+	return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
@@ -18,7 +18,7 @@
 
 #include <Macros.h>
 #include <debug_draw.h>
-#include <shadows.h>
+#include "shadows.h"
 
 #define CAMERA_SPEED 0.05f
 #define CAMERA_SENSITIVITY 0.02f
@@ -30,6 +30,9 @@
 #define NEAR_PLANE 0.1f
 #define FAR_PLANE 100.0f
 
+#define CASTER_GRID_SIZE 16
+#define CASTER_SPACING 8.0f
+
 struct DW_ALIGNED(16) DirectionalLight
 {
 	glm::vec4 color;
@@ -72,7 +75,9 @@ private:
 	bool  show_shadow_frustum;
 	bool  show_frustum_splits;
 	bool  debug_mode;
+	bool  show_casters;
 	glm::vec3 direction;
+	std::vector<ShadowCaster> m_casters;
 	glm::mat4 test_proj;
 	glm::mat4 test_view;
 
@@ -97,6 +102,7 @@ public:
 		visualize_cascades = false;
 		show_shadow_frustum = false;
 		show_frustum_splits = false;
+		show_casters = false;
 		glm::vec3 dir = glm::vec3(1.0f, -1.0f, 0.0f);
 		direction = glm::normalize(dir);
 
@@ -106,6 +112,7 @@ public:
 		m_shadow_settings.shadow_map_size = 1024;
 
 		m_shadows.initialize(&m_device, m_shadow_settings, m_camera, m_width, m_height, direction);
+		create_casters();
 		test_view = glm::lookAt(glm::vec3(0.0f), glm::vec3(10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		test_proj = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 0.1f, 100.0f);
 	
@@ -115,7 +122,16 @@ public:
     void update(double delta) override
     {
         updateCamera();
-		m_shadows.update(m_camera, direction);
+
+		DepthRange depth_range;
+
+		// Only SDSM uses the range, skip the frustum test over every caster otherwise.
+		if (m_shadows.m_sdsm && scene_depth_range(m_camera->m_view, m_camera->m_projection, &m_casters[0], uint32_t(m_casters.size()), m_camera->m_near, m_camera->m_far, depth_range))
+			m_shadows.set_depth_range(depth_range);
+		else
+			m_shadows.clear_depth_range();
+
+		m_shadows.update(m_camera, direction, &m_casters[0], uint32_t(m_casters.size()));
 
 		for (int i = 0; i < m_shadow_settings.split_count; i++)
 		{
@@ -143,6 +159,12 @@ public:
 				m_debug_renderer.frustum(m_shadows.split_view_proj(i), glm::vec3(1.0f, 0.0f, 0.0f));
 		}
 
+		if (show_casters)
+		{
+			for (auto& caster : m_casters)
+				m_debug_renderer.aabb(caster.min, caster.max, glm::vec3(0.0f, 0.0f, 1.0f));
+		}
+
         m_device.bind_framebuffer(nullptr);
         m_device.set_viewport(m_width, m_height, 0, 0);
         
@@ -154,9 +176,13 @@ public:
 			ImGui::Checkbox("Visualize Cascades", &visualize_cascades);
 			ImGui::Checkbox("Show Shadow Frustums", &show_shadow_frustum);
 			ImGui::Checkbox("Show Frustum Splits", &show_frustum_splits);
+			ImGui::Checkbox("Show Casters", &show_casters);
 			ImGui::Checkbox("Debug Camera", &debug_mode);
 			ImGui::Checkbox("Stable Shadows", &m_shadows.m_stable_pssm);
+			ImGui::Checkbox("SDSM", &m_shadows.m_sdsm);
+			ImGui::Checkbox("Cached Shadows", &m_shadows.m_cached_shadows);
 			ImGui::InputInt("Num Cascades", &m_shadow_settings.split_count);
+			m_shadow_settings.split_count = glm::clamp(m_shadow_settings.split_count, 1, MAX_FRUSTUM_SPLITS);
 			ImGui::InputInt("Shadow Map Size", &m_shadow_settings.shadow_map_size);
 			ImGui::InputFloat("Lambda", &m_shadow_settings.lambda);
 			ImGui::DragFloat3("Direction", &direction.x, 0.1f);
@@ -165,6 +191,24 @@ public:
 			{
 				m_shadows.initialize(&m_device, m_shadow_settings, m_camera, m_width, m_height, direction);
 			}
+
+			ImGui::Separator();
+			ImGui::Text("Shadow Maps: %i x %i x %i (%.1f MB)", m_shadows.shadow_map_size(), m_shadows.shadow_map_size(), m_shadows.shadow_map_slices(), m_shadows.shadow_map_memory() / (1024.0f * 1024.0f));
+
+			for (int i = 0; i < m_shadow_settings.split_count; i++)
+				ImGui::Text("Split %i: %.2f - %.2f", i, m_shadows.frustum_splits()[i].near_plane, m_shadows.frustum_splits()[i].far_plane);
+
+			for (int i = 0; i < m_shadow_settings.split_count; i++)
+			{
+				glm::vec2 range = m_shadows.split_depth_range(i);
+				ImGui::Text("Cascade %i: %i casters, depth %.1f", i, int(m_shadows.split_casters(i).size()), range.x - range.y);
+			}
+
+			if (m_shadows.m_cached_shadows)
+			{
+				ShadowCacheScheduler& cache = m_shadows.cache_scheduler();
+				ImGui::Text("Static Renders: %llu, Composites: %llu", (unsigned long long)cache.static_renders(), (unsigned long long)cache.composites());
+			}
 		}
 		ImGui::End();
 
@@ -174,9 +218,30 @@ public:
         m_debug_renderer.render(nullptr, m_width, m_height, debug_mode ? m_debug_camera->m_view_projection : m_camera->m_view_projection);
     }
     
+	// Grid of boxes standing in for scene geometry so the cascades have casters to cull.
+	void create_casters()
+	{
+		srand(0);
+		m_casters.resize(CASTER_GRID_SIZE * CASTER_GRID_SIZE);
+
+		for (int z = 0; z < CASTER_GRID_SIZE; z++)
+		{
+			for (int x = 0; x < CASTER_GRID_SIZE; x++)
+			{
+				float height = 1.0f + 9.0f * float(rand()) / float(RAND_MAX);
+				glm::vec3 center = glm::vec3(x - CASTER_GRID_SIZE / 2, 0.0f, -z) * CASTER_SPACING;
+
+				m_casters[z * CASTER_GRID_SIZE + x].min = center - glm::vec3(1.0f, 0.0f, 1.0f);
+				m_casters[z * CASTER_GRID_SIZE + x].max = center + glm::vec3(1.0f, height, 1.0f);
+				m_casters[z * CASTER_GRID_SIZE + x].dynamic = (x + z) % 8 == 0;
+			}
+		}
+	}
+
     void shutdown() override
     {
         m_debug_renderer.shutdown();
+		m_shadows.shutdown();
         delete m_debug_camera;
         delete m_camera;
     }
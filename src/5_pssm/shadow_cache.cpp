@@ -0,0 +1,67 @@
+#include "shadow_cache.h"
+#include <algorithm>
+#include <math.h>
+
+bool operator==(const ShadowCacheKey& a, const ShadowCacheKey& b)
+{
+	return a.light_dir == b.light_dir && a.origin_x == b.origin_x && a.origin_y == b.origin_y && a.radius == b.radius && a.near_step == b.near_step && a.far_step == b.far_step;
+}
+
+void snap_cache_depth(float origin_z, float& near_z, float& far_z, ShadowCacheKey& key)
+{
+	key.near_step = int32_t(ceilf((near_z - origin_z) / SHADOW_CACHE_DEPTH_STEP));
+	key.far_step = int32_t(floorf((far_z - origin_z) / SHADOW_CACHE_DEPTH_STEP));
+
+	near_z = float(key.near_step) * SHADOW_CACHE_DEPTH_STEP + origin_z;
+	far_z = float(key.far_step) * SHADOW_CACHE_DEPTH_STEP + origin_z;
+}
+
+ShadowCacheScheduler::ShadowCacheScheduler() : m_full_rate_cascades(0), m_next_cascade(0), m_static_renders(0), m_composites(0)
+{
+
+}
+
+void ShadowCacheScheduler::reset(int cascade_count, int full_rate_cascades)
+{
+	m_keys.resize(cascade_count);
+	m_valid.assign(cascade_count, 0);
+	m_full_rate_cascades = std::min(std::max(full_rate_cascades, 0), cascade_count);
+	m_next_cascade = m_full_rate_cascades;
+}
+
+void ShadowCacheScheduler::invalidate()
+{
+	std::fill(m_valid.begin(), m_valid.end(), 0);
+}
+
+void ShadowCacheScheduler::schedule(const ShadowCacheKey* keys, uint32_t* actions)
+{
+	int cascade_count = int(m_keys.size());
+
+	for (int i = 0; i < cascade_count; i++)
+	{
+		// A moved cascade has to be redrawn right away, its old contents no longer match its projection.
+		if (!m_valid[i] || keys[i] != m_keys[i])
+		{
+			actions[i] = SHADOW_CACHE_RENDER_STATIC | SHADOW_CACHE_COMPOSITE;
+			m_keys[i] = keys[i];
+			m_valid[i] = 1;
+			m_static_renders++;
+		}
+		else if (i < m_full_rate_cascades || i == m_next_cascade)
+			actions[i] = SHADOW_CACHE_COMPOSITE;
+		else
+			actions[i] = SHADOW_CACHE_SKIP;
+
+		if (actions[i] & SHADOW_CACHE_COMPOSITE)
+			m_composites++;
+	}
+
+	if (cascade_count > m_full_rate_cascades)
+	{
+		m_next_cascade++;
+
+		if (m_next_cascade >= cascade_count)
+			m_next_cascade = m_full_rate_cascades;
+	}
+}
\ No newline at end of file
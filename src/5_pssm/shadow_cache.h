@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <glm.hpp>
+
+// Cached depth ranges are widened to multiples of this, so small changes in the casters do not invalidate the cache.
+#define SHADOW_CACHE_DEPTH_STEP 16.0f
+#define SHADOW_CACHE_FULL_RATE_CASCADES 2
+
+// Everything that decides where static geometry lands in a cascade. While it does not change the cached depth stays
+// valid. Positions are in the light's rotation basis, which does not move with the camera.
+struct ShadowCacheKey
+{
+	glm::vec3 light_dir;
+	int32_t origin_x; // Snapped cascade center in texels.
+	int32_t origin_y;
+	float radius;
+	int32_t near_step; // Depth range in whole SHADOW_CACHE_DEPTH_STEPs.
+	int32_t far_step;
+};
+
+bool operator==(const ShadowCacheKey& a, const ShadowCacheKey& b);
+inline bool operator!=(const ShadowCacheKey& a, const ShadowCacheKey& b) { return !(a == b); }
+
+// Widens a light view depth range to whole steps from origin_z, the z of the light view origin, and stores the step
+// counts in the key. The key comes from the steps alone, so it does not change as origin_z moves with the camera.
+void snap_cache_depth(float origin_z, float& near_z, float& far_z, ShadowCacheKey& key);
+
+enum ShadowCacheAction
+{
+	SHADOW_CACHE_SKIP = 0,			// The shadow map still holds a usable result.
+	SHADOW_CACHE_RENDER_STATIC = 1, // Render the static casters into the cache.
+	SHADOW_CACHE_COMPOSITE = 2		// Copy the cache into the shadow map and render the dynamic casters on top.
+};
+
+// Decides which cascades have to be rendered each frame. Holds no GPU resources, so it can be driven headless.
+class ShadowCacheScheduler
+{
+public:
+	ShadowCacheScheduler();
+	// Cascades below full_rate_cascades are composited every frame, the rest take turns, one per frame.
+	void reset(int cascade_count, int full_rate_cascades = SHADOW_CACHE_FULL_RATE_CASCADES);
+	// Forces every cascade to rebuild its cache on the next schedule().
+	void invalidate();
+	// Writes a combination of ShadowCacheAction for every cascade.
+	void schedule(const ShadowCacheKey* keys, uint32_t* actions);
+	inline int cascade_count() { return int(m_keys.size()); }
+	inline uint64_t static_renders() { return m_static_renders; }
+	inline uint64_t composites() { return m_composites; }
+
+private:
+	std::vector<ShadowCacheKey> m_keys;
+	std::vector<uint8_t> m_valid;
+	int m_full_rate_cascades;
+	int m_next_cascade;
+	uint64_t m_static_renders;
+	uint64_t m_composites;
+};
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include <iostream>
+#include <vector>
+#include <random>
+
+#include "shadow_cache.h"
+
+#define TEST_CASCADES 4
+#define TEST_FULL_RATE 2
+#define TEST_FRAMES 12
+#define TEST_DRIFT_FRAMES 1000
+#define TEST_DRIFT_EXTENT 5000.0f
+
+ShadowCacheKey make_key(int cascade)
+{
+	ShadowCacheKey key;
+
+	key.light_dir = glm::vec3(0.0f, -1.0f, 0.0f);
+	key.origin_x = cascade * 10;
+	key.origin_y = -cascade;
+	key.radius = 50.0f * float(cascade + 1);
+	key.near_step = 0;
+	key.far_step = cascade + 1;
+
+	return key;
+}
+
+int main()
+{
+	int failures = 0;
+	ShadowCacheScheduler scheduler;
+	ShadowCacheKey keys[TEST_CASCADES];
+	uint32_t actions[TEST_CASCADES];
+
+	for (int i = 0; i < TEST_CASCADES; i++)
+		keys[i] = make_key(i);
+
+	scheduler.reset(TEST_CASCADES, TEST_FULL_RATE);
+
+	// Nothing is cached on the first frame.
+	scheduler.schedule(keys, actions);
+
+	for (int i = 0; i < TEST_CASCADES; i++)
+	{
+		if (actions[i] != (SHADOW_CACHE_RENDER_STATIC | SHADOW_CACHE_COMPOSITE))
+		{
+			std::cout << "Cascade " << i << " not rendered on the first frame" << std::endl;
+			failures++;
+		}
+	}
+
+	// With unchanged keys the full rate cascades composite every frame and the rest take turns, one per frame.
+	std::vector<int> composites(TEST_CASCADES, 0);
+
+	for (int frame = 0; frame < TEST_FRAMES; frame++)
+	{
+		scheduler.schedule(keys, actions);
+
+		int round_robin = 0;
+
+		for (int i = 0; i < TEST_CASCADES; i++)
+		{
+			if (actions[i] & SHADOW_CACHE_RENDER_STATIC)
+			{
+				std::cout << "Cascade " << i << " re-rendered with an unchanged key" << std::endl;
+				failures++;
+			}
+
+			if (actions[i] & SHADOW_CACHE_COMPOSITE)
+			{
+				composites[i]++;
+
+				if (i >= TEST_FULL_RATE)
+					round_robin++;
+			}
+		}
+
+		if (round_robin != 1)
+		{
+			std::cout << "Frame " << frame << " composited " << round_robin << " round robin cascades" << std::endl;
+			failures++;
+		}
+	}
+
+	for (int i = 0; i < TEST_CASCADES; i++)
+	{
+		int expected = i < TEST_FULL_RATE ? TEST_FRAMES : TEST_FRAMES / (TEST_CASCADES - TEST_FULL_RATE);
+
+		if (composites[i] != expected)
+		{
+			std::cout << "Cascade " << i << " composited " << composites[i] << " times, expected " << expected << std::endl;
+			failures++;
+		}
+	}
+
+	// A moved cascade is redrawn right away, even when it is not its turn.
+	for (int i = 0; i < TEST_CASCADES; i++)
+	{
+		ShadowCacheKey moved[TEST_CASCADES];
+
+		for (int j = 0; j < TEST_CASCADES; j++)
+			moved[j] = keys[j];
+
+		moved[i].origin_x++;
+
+		// Two frames, so the moved cascade is off its turn in at least one of them.
+		for (int frame = 0; frame < 2; frame++)
+		{
+			scheduler.schedule(frame == 0 ? keys : moved, actions);
+
+			if (frame == 1 && actions[i] != (SHADOW_CACHE_RENDER_STATIC | SHADOW_CACHE_COMPOSITE))
+			{
+				std::cout << "Moved cascade " << i << " was not re-rendered" << std::endl;
+				failures++;
+			}
+
+			for (int j = 0; j < TEST_CASCADES; j++)
+			{
+				if (j != i && (actions[j] & SHADOW_CACHE_RENDER_STATIC))
+				{
+					std::cout << "Cascade " << j << " re-rendered when cascade " << i << " moved" << std::endl;
+					failures++;
+				}
+			}
+		}
+
+		keys[i] = moved[i];
+	}
+
+	// Invalidating rebuilds everything once.
+	uint64_t static_renders = scheduler.static_renders();
+	uint64_t composites_before = scheduler.composites();
+
+	scheduler.invalidate();
+	scheduler.schedule(keys, actions);
+
+	for (int i = 0; i < TEST_CASCADES; i++)
+	{
+		if (actions[i] != (SHADOW_CACHE_RENDER_STATIC | SHADOW_CACHE_COMPOSITE))
+		{
+			std::cout << "Cascade " << i << " not rendered after invalidate" << std::endl;
+			failures++;
+		}
+	}
+
+	if (scheduler.static_renders() != static_renders + TEST_CASCADES || scheduler.composites() != composites_before + TEST_CASCADES)
+	{
+		std::cout << "Counters did not advance by one frame of full renders" << std::endl;
+		failures++;
+	}
+
+	// The first frame, one move per cascade and the invalidate.
+	uint64_t expected_static = TEST_CASCADES * 2 + TEST_CASCADES;
+
+	if (scheduler.static_renders() != expected_static)
+	{
+		std::cout << "Static renders: " << scheduler.static_renders() << ", expected " << expected_static << std::endl;
+		failures++;
+	}
+
+	// More full rate cascades than cascades clamps to all of them, nothing is skipped.
+	scheduler.reset(TEST_FULL_RATE, TEST_CASCADES);
+	scheduler.schedule(keys, actions);
+	scheduler.schedule(keys, actions);
+
+	for (int i = 0; i < TEST_FULL_RATE; i++)
+	{
+		if (actions[i] != SHADOW_CACHE_COMPOSITE)
+		{
+			std::cout << "Full rate cascade " << i << " skipped after reset" << std::endl;
+			failures++;
+		}
+	}
+
+	// The light view origin moves with the camera. The depth range of casters that stay put is the same in the light's
+	// rotation basis, so their key must not change however far the origin drifts.
+	std::mt19937 rng(1337);
+	std::uniform_real_distribution<float> drift(-TEST_DRIFT_EXTENT, TEST_DRIFT_EXTENT);
+	int drift_renders = 0;
+
+	scheduler.reset(TEST_CASCADES, TEST_FULL_RATE);
+
+	for (int frame = 0; frame < TEST_DRIFT_FRAMES; frame++)
+	{
+		float origin_z = drift(rng);
+
+		for (int i = 0; i < TEST_CASCADES; i++)
+		{
+			// Away from step boundaries, so only the origin can move the range across one.
+			float near_z = 3.3f + 37.1f * float(i) + origin_z;
+			float far_z = -180.7f - 93.1f * float(i) + origin_z;
+
+			keys[i] = make_key(i);
+			snap_cache_depth(origin_z, near_z, far_z, keys[i]);
+		}
+
+		scheduler.schedule(keys, actions);
+
+		for (int i = 0; i < TEST_CASCADES && frame > 0; i++)
+		{
+			if (actions[i] & SHADOW_CACHE_RENDER_STATIC)
+				drift_renders++;
+		}
+	}
+
+	if (drift_renders > 0)
+	{
+		std::cout << "Drifting origin re-rendered " << drift_renders << " cascades" << std::endl;
+		failures++;
+	}
+
+	std::cout << "Failures : " << failures << std::endl;
+
+	return failures == 0 ? 0 : 1;
+}
\ No newline at end of file
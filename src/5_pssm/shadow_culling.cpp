@@ -0,0 +1,119 @@
+#include "shadow_culling.h"
+#include <math.h>
+#include <algorithm>
+
+#if DW_SIMD
+#include <xmmintrin.h>
+
+static inline float horizontal_min(__m128 v)
+{
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(v);
+}
+
+static inline float horizontal_max(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(v);
+}
+#endif
+
+void light_space_split_bounds(const glm::mat4& light_view, const float* x, const float* y, const float* z, int split_count, CascadeBounds* bounds)
+{
+#if DW_SIMD
+	__m128 m[4][3];
+
+	for (int c = 0; c < 4; c++)
+	{
+		for (int r = 0; r < 3; r++)
+			m[c][r] = _mm_set1_ps(light_view[c][r]);
+	}
+
+	for (int i = 0; i < split_count; i++)
+	{
+		__m128 min[3];
+		__m128 max[3];
+
+		// Two groups of four corners per split.
+		for (int g = 0; g < 2; g++)
+		{
+			int offset = 8 * i + 4 * g;
+			__m128 px = _mm_loadu_ps(x + offset);
+			__m128 py = _mm_loadu_ps(y + offset);
+			__m128 pz = _mm_loadu_ps(z + offset);
+
+			for (int r = 0; r < 3; r++)
+			{
+				__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0][r], px), _mm_mul_ps(m[1][r], py)), _mm_add_ps(_mm_mul_ps(m[2][r], pz), m[3][r]));
+
+				min[r] = g == 0 ? t : _mm_min_ps(min[r], t);
+				max[r] = g == 0 ? t : _mm_max_ps(max[r], t);
+			}
+		}
+
+		for (int r = 0; r < 3; r++)
+		{
+			bounds[i].min[r] = horizontal_min(min[r]);
+			bounds[i].max[r] = horizontal_max(max[r]);
+		}
+	}
+#else
+	for (int i = 0; i < split_count; i++)
+	{
+		bounds[i].min = glm::vec3(INFINITY);
+		bounds[i].max = glm::vec3(-INFINITY);
+
+		for (int j = 8 * i; j < 8 * i + 8; j++)
+		{
+			glm::vec3 p = glm::vec3(light_view * glm::vec4(x[j], y[j], z[j], 1.0f));
+			bounds[i].min = glm::min(bounds[i].min, p);
+			bounds[i].max = glm::max(bounds[i].max, p);
+		}
+	}
+#endif
+}
+
+void light_space_bounds(const glm::mat4& light_view, const ShadowCaster& caster, glm::vec3& min, glm::vec3& max)
+{
+	// Transform the center and project the extents onto the light axes, instead of transforming all 8 corners.
+	glm::vec3 center = (caster.min + caster.max) * 0.5f;
+	glm::vec3 extents = (caster.max - caster.min) * 0.5f;
+
+	glm::vec3 light_center = glm::vec3(light_view * glm::vec4(center, 1.0f));
+	glm::vec3 light_extents;
+
+	for (int i = 0; i < 3; i++)
+		light_extents[i] = fabs(light_view[0][i]) * extents.x + fabs(light_view[1][i]) * extents.y + fabs(light_view[2][i]) * extents.z;
+
+	min = light_center - light_extents;
+	max = light_center + light_extents;
+}
+
+void cull_shadow_casters(const glm::mat4& light_view, const ShadowCaster* casters, uint32_t count, const CascadeBounds* cascades, int cascade_count, CascadeCasters* results)
+{
+	for (int i = 0; i < cascade_count; i++)
+	{
+		results[i].visible.clear();
+		results[i].near_z = cascades[i].max.z;
+		results[i].far_z = cascades[i].min.z;
+	}
+
+	for (uint32_t c = 0; c < count; c++)
+	{
+		glm::vec3 min, max;
+		light_space_bounds(light_view, casters[c], min, max);
+
+		for (int i = 0; i < cascade_count; i++)
+		{
+			const CascadeBounds& cascade = cascades[i];
+
+			if (max.x < cascade.min.x || min.x > cascade.max.x || max.y < cascade.min.y || min.y > cascade.max.y || max.z < cascade.min.z)
+				continue;
+
+			results[i].visible.push_back(c);
+			results[i].near_z = std::max(results[i].near_z, max.z);
+		}
+	}
+}
\ No newline at end of file
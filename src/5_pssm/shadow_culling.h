@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <glm.hpp>
+#include <common/simd.h>
+
+// World space bounding box of a shadow caster.
+struct ShadowCaster
+{
+	glm::vec3 min;
+	glm::vec3 max;
+	bool dynamic; // Redrawn every frame when shadows are cached, see Shadows::m_cached_shadows.
+};
+
+// Light view space box of a cascade's receivers. The light looks down -z, so a larger z is closer to the light.
+struct CascadeBounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+struct CascadeCasters
+{
+	std::vector<uint32_t> visible;
+	float near_z; // Light space z of the visible caster closest to the light, never below the receivers' max z.
+	float far_z;  // Light space z of the receiver furthest from the light.
+};
+
+// Light view space boxes of a batch of frustum splits. The 8 corners of each split are stored back to back in SoA
+// layout, so every array holds 8 * split_count floats.
+void light_space_split_bounds(const glm::mat4& light_view, const float* x, const float* y, const float* z, int split_count, CascadeBounds* bounds);
+
+// Light view space box of a caster.
+void light_space_bounds(const glm::mat4& light_view, const ShadowCaster& caster, glm::vec3& min, glm::vec3& max);
+
+// A caster can throw a shadow into a cascade if it overlaps the cascade in light space x and y and is not entirely
+// behind the receivers. The cascade volume is extruded toward the light without bound, so casters far outside the
+// view still shadow it.
+void cull_shadow_casters(const glm::mat4& light_view, const ShadowCaster* casters, uint32_t count, const CascadeBounds* cascades, int cascade_count, CascadeCasters* results);
\ No newline at end of file
@@ -3,23 +3,46 @@
 #include <render_device.h>
 #include <gtc/matrix_transform.hpp>
 #include <Macros.h>
+#include <logger.h>
+#include <utility.h>
+#include <algorithm>
 
-Shadows::Shadows()
+Shadows::Shadows() : m_shadow_maps(nullptr), m_static_maps(nullptr),
+	m_copy_vs(nullptr), m_copy_fs(nullptr), m_copy_program(nullptr), m_copy_vbo(nullptr), m_copy_il(nullptr), m_copy_vao(nullptr), m_copy_ds(nullptr), m_copy_rs(nullptr), m_copy_sampler(nullptr),
+	m_shadow_map_size(0), m_shadow_map_slices(0), m_device(nullptr), m_casters(nullptr), m_caster_count(0), m_depth_range_valid(false)
 {
-	for (int i = 0; i < 8; i++)
+	m_sdsm_steps[0] = INT32_MIN;
+	m_sdsm_steps[1] = INT32_MAX;
+
+	for (int i = 0; i < MAX_FRUSTUM_SPLITS; i++)
 	{
-		m_shadow_maps[i] = nullptr;
 		m_shadow_fbos[i] = nullptr;
+		m_static_fbos[i] = nullptr;
+		m_cascade_actions[i] = SHADOW_CACHE_SKIP;
+		m_split_radius[i] = 0.0f;
+		m_split_radius_key[i] = glm::vec4(-1.0f);
 	}
 }
 
 Shadows::~Shadows()
 {
-	for (int i = 0; i < 8; i++)
-	{
-		m_device->destroy(m_shadow_maps[i]);
-		m_device->destroy(m_shadow_fbos[i]);
-	}
+	shutdown();
+}
+
+void Shadows::shutdown()
+{
+	destroy_shadow_maps();
+}
+
+void Shadows::set_depth_range(const DepthRange& range)
+{
+	m_depth_range = range;
+	m_depth_range_valid = true;
+}
+
+void Shadows::clear_depth_range()
+{
+	m_depth_range_valid = false;
 }
 
 FrustumSplit* Shadows::frustum_splits()
@@ -32,87 +55,349 @@ glm::mat4 Shadows::split_view_proj(int i)
 	return m_crop_matrices[i];
 }
 
+const std::vector<uint32_t>& Shadows::split_casters(int i)
+{
+	return m_cascade_casters[i].visible;
+}
+
+glm::vec2 Shadows::split_depth_range(int i)
+{
+	return glm::vec2(m_cascade_casters[i].near_z, m_cascade_casters[i].far_z);
+}
+
 void Shadows::initialize(RenderDevice* device, ShadowSettings settings, Camera* camera, int _width, int _height, glm::vec3 dir)
 {
 	m_device = device;
 	m_settings = settings;
 
-	if (m_shadow_maps)
+	m_settings.split_count = glm::clamp(m_settings.split_count, 1, MAX_FRUSTUM_SPLITS);
+
+	if (!create_shadow_maps())
+		LOG_ERROR("Failed to create shadow maps");
+
+	m_cache_scheduler.reset(m_settings.split_count);
+
+	float camera_fov = camera->m_fov;
+	float width = _width;
+	float height = _height;
+	float ratio = width / height;
+
+	// note that fov is in radians here and in OpenGL it is in degrees.
+	// the 0.2f factor is important because we might get artifacts at
+	// the screen borders.
+	for (int i = 0; i < m_settings.split_count; i++) 
 	{
-		for (int i = 0; i < 8; i++)
-		{
-			device->destroy(m_shadow_maps[i]);
-			device->destroy(m_shadow_fbos[i]);
-		}
+		m_splits[i].fov = camera_fov / 57.2957795 + 0.2f;
+		m_splits[i].ratio = ratio;
 	}
 
-	/*Texture2DArrayCreateDesc desc;
-	DW_ZERO_MEMORY(desc);
+	update(camera, dir);
+}
 
-	desc.array_slices = m_settings.split_count;
-	desc.format = TextureFormat::D32_FLOAT_S8_UINT;
-	desc.height = m_settings.shadow_map_size;
-	desc.width = m_settings.shadow_map_size;
-	desc.mipmap_levels = 1;
-	
-	m_shadow_maps = device->create_texture_2d_array(desc);*/
+bool Shadows::create_shadow_maps()
+{
+	// Settings that fit into the current array only need a new set of splits.
+	if (m_shadow_maps && m_shadow_map_size == m_settings.shadow_map_size && m_shadow_map_slices >= m_settings.split_count)
+		return true;
+
+	destroy_shadow_maps();
+
+	if (m_settings.shadow_map_size <= 0)
+		return false;
+
+	if (!create_depth_array(m_settings.split_count, &m_shadow_maps, m_shadow_fbos))
+		return false;
+
+	m_shadow_map_size = m_settings.shadow_map_size;
+	m_shadow_map_slices = m_settings.split_count;
+
+	return true;
+}
+
+void Shadows::destroy_shadow_maps()
+{
+	destroy_static_maps();
+	destroy_depth_array(&m_shadow_maps, m_shadow_fbos);
 
-	for (int i = 0; i < 8; i++)
+	m_shadow_map_size = 0;
+	m_shadow_map_slices = 0;
+}
+
+bool Shadows::create_static_maps()
+{
+	if (!m_shadow_maps)
+		return false;
+
+	// Whatever was cached before belongs to another array.
+	m_cache_scheduler.invalidate();
+
+	if (!create_depth_array(m_shadow_map_slices, &m_static_maps, m_static_fbos))
+		return false;
+
+	if (!create_copy_pass())
 	{
-		Texture2DCreateDesc desc;
-		DW_ZERO_MEMORY(desc);
+		destroy_static_maps();
+		return false;
+	}
 
-		desc.format = TextureFormat::D32_FLOAT_S8_UINT;
-		desc.height = m_settings.shadow_map_size;
-		desc.width = m_settings.shadow_map_size;
-		desc.mipmap_levels = 1;
+	return true;
+}
+
+void Shadows::destroy_static_maps()
+{
+	destroy_copy_pass();
+	destroy_depth_array(&m_static_maps, m_static_fbos);
+}
+
+bool Shadows::create_copy_pass()
+{
+	std::string vs_str;
+	Utility::ReadText("shader/shadow_copy_vs.glsl", vs_str);
+
+	std::string fs_str;
+	Utility::ReadText("shader/shadow_copy_fs.glsl", fs_str);
+
+	m_copy_vs = m_device->create_shader(vs_str.c_str(), ShaderType::VERTEX);
+	m_copy_fs = m_device->create_shader(fs_str.c_str(), ShaderType::FRAGMENT);
+
+	if (!m_copy_vs || !m_copy_fs)
+	{
+		LOG_ERROR("Failed to create shadow copy shaders");
+		return false;
 	}
 
-	for (int i = 0; i < 8; i++)
+	Shader* shaders[] = { m_copy_vs, m_copy_fs };
+	m_copy_program = m_device->create_shader_program(shaders, 2);
+
+	if (!m_copy_program)
 	{
-		if (m_shadow_fbos[i])
-		{
-			device->destroy(m_shadow_fbos[i]);
-			m_shadow_fbos[i] = nullptr;
-		}
+		LOG_ERROR("Failed to create shadow copy program");
+		return false;
 	}
 
-	for (int i = 0; i < m_settings.split_count; i++)
+	// A triangle covering the viewport for every slice, the slice index rides along in z.
+	std::vector<glm::vec3> vertices;
+
+	for (int i = 0; i < m_shadow_map_slices; i++)
+	{
+		vertices.push_back(glm::vec3(-1.0f, -1.0f, float(i)));
+		vertices.push_back(glm::vec3(3.0f, -1.0f, float(i)));
+		vertices.push_back(glm::vec3(-1.0f, 3.0f, float(i)));
+	}
+
+	BufferCreateDesc bc;
+	DW_ZERO_MEMORY(bc);
+
+	bc.data = &vertices[0];
+	bc.data_type = DataType::FLOAT;
+	bc.size = sizeof(glm::vec3) * vertices.size();
+	bc.usage_type = BufferUsageType::STATIC;
+
+	m_copy_vbo = m_device->create_vertex_buffer(bc);
+
+	InputElement elements[] =
+	{
+		{ 3, DataType::FLOAT, false, 0, "POSITION" }
+	};
+
+	InputLayoutCreateDesc il_desc;
+	DW_ZERO_MEMORY(il_desc);
+
+	il_desc.elements = elements;
+	il_desc.num_elements = 1;
+	il_desc.vertex_size = sizeof(glm::vec3);
+
+	m_copy_il = m_device->create_input_layout(il_desc);
+
+	VertexArrayCreateDesc vao_desc;
+	DW_ZERO_MEMORY(vao_desc);
+
+	vao_desc.index_buffer = nullptr;
+	vao_desc.vertex_buffer = m_copy_vbo;
+	vao_desc.layout = m_copy_il;
+
+	m_copy_vao = m_device->create_vertex_array(vao_desc);
+
+	if (!m_copy_vbo || !m_copy_vao)
+	{
+		LOG_ERROR("Failed to create shadow copy vertex array");
+		return false;
+	}
+
+	// The slice is cleared to the far plane first, so LESS_EQUAL lets every copied texel through.
+	DepthStencilStateCreateDesc ds_desc;
+	DW_ZERO_MEMORY(ds_desc);
+	ds_desc.depth_mask = true;
+	ds_desc.enable_depth_test = true;
+	ds_desc.enable_stencil_test = false;
+	ds_desc.depth_cmp_func = ComparisonFunction::LESS_EQUAL;
+
+	m_copy_ds = m_device->create_depth_stencil_state(ds_desc);
+
+	RasterizerStateCreateDesc rs_desc;
+	DW_ZERO_MEMORY(rs_desc);
+	rs_desc.cull_mode = CullMode::NONE;
+	rs_desc.fill_mode = FillMode::SOLID;
+	rs_desc.front_winding_ccw = true;
+	rs_desc.multisample = false;
+	rs_desc.scissor = false;
+
+	m_copy_rs = m_device->create_rasterizer_state(rs_desc);
+
+	SamplerStateCreateDesc ss_desc;
+	DW_ZERO_MEMORY(ss_desc);
+	ss_desc.min_filter = TextureFilteringMode::NEAREST;
+	ss_desc.mag_filter = TextureFilteringMode::NEAREST;
+	ss_desc.wrap_mode_u = TextureWrapMode::CLAMP_TO_EDGE;
+	ss_desc.wrap_mode_v = TextureWrapMode::CLAMP_TO_EDGE;
+	ss_desc.wrap_mode_w = TextureWrapMode::CLAMP_TO_EDGE;
+
+	m_copy_sampler = m_device->create_sampler_state(ss_desc);
+
+	return true;
+}
+
+void Shadows::destroy_copy_pass()
+{
+	if (!m_device)
+		return;
+
+	if (m_copy_sampler)
+		m_device->destroy(m_copy_sampler);
+
+	if (m_copy_rs)
+		m_device->destroy(m_copy_rs);
+
+	if (m_copy_ds)
+		m_device->destroy(m_copy_ds);
+
+	if (m_copy_vao)
+		m_device->destroy(m_copy_vao);
+
+	if (m_copy_il)
+		m_device->destroy(m_copy_il);
+
+	if (m_copy_vbo)
+		m_device->destroy(m_copy_vbo);
+
+	if (m_copy_program)
+		m_device->destroy(m_copy_program);
+
+	if (m_copy_vs)
+		m_device->destroy(m_copy_vs);
+
+	if (m_copy_fs)
+		m_device->destroy(m_copy_fs);
+
+	m_copy_sampler = nullptr;
+	m_copy_rs = nullptr;
+	m_copy_ds = nullptr;
+	m_copy_vao = nullptr;
+	m_copy_il = nullptr;
+	m_copy_vbo = nullptr;
+	m_copy_program = nullptr;
+	m_copy_vs = nullptr;
+	m_copy_fs = nullptr;
+}
+
+bool Shadows::create_depth_array(int slices, Texture2DArray** array, Framebuffer** fbos)
+{
+	Texture2DArrayCreateDesc desc;
+	DW_ZERO_MEMORY(desc);
+
+	desc.array_slices = slices;
+	desc.format = TextureFormat::D32_FLOAT_S8_UINT;
+	desc.height = m_settings.shadow_map_size;
+	desc.width = m_settings.shadow_map_size;
+	desc.mipmap_levels = 1;
+
+	*array = m_device->create_texture_2d_array(desc);
+
+	if (!*array)
+		return false;
+
+	for (int i = 0; i < slices; i++)
 	{
 		DepthStencilTargetDesc ds_desc;
 
 		ds_desc.arraySlice = i;
 		ds_desc.mipSlice = 0;
-		ds_desc.texture = m_shadow_maps[i];
-		
+		ds_desc.texture = *array;
+
 		FramebufferCreateDesc fbo_desc;
 
 		fbo_desc.renderTargetCount = 0;
 		fbo_desc.depthStencilTarget = ds_desc;
 
-		m_shadow_fbos[i] = device->create_framebuffer(fbo_desc);
+		fbos[i] = m_device->create_framebuffer(fbo_desc);
+
+		if (!fbos[i])
+		{
+			destroy_depth_array(array, fbos);
+			return false;
+		}
 	}
 
-	float camera_fov = camera->m_fov;
-	float width = _width;
-	float height = _height;
-	float ratio = width / height;
+	return true;
+}
 
-	// note that fov is in radians here and in OpenGL it is in degrees.
-	// the 0.2f factor is important because we might get artifacts at
-	// the screen borders.
-	for (int i = 0; i < m_settings.split_count; i++) 
+void Shadows::destroy_depth_array(Texture2DArray** array, Framebuffer** fbos)
+{
+	if (!m_device)
+		return;
+
+	for (int i = 0; i < MAX_FRUSTUM_SPLITS; i++)
 	{
-		m_splits[i].fov = camera_fov / 57.2957795 + 0.2f;
-		m_splits[i].ratio = ratio;
+		if (fbos[i])
+		{
+			m_device->destroy(fbos[i]);
+			fbos[i] = nullptr;
+		}
 	}
 
-	update(camera, dir);
+	if (*array)
+	{
+		m_device->destroy(*array);
+		*array = nullptr;
+	}
+}
+
+void Shadows::restore_static(int i)
+{
+	if (!m_static_maps)
+		return;
+
+	float clear[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+	m_device->bind_framebuffer(m_shadow_fbos[i]);
+	m_device->set_viewport(m_shadow_map_size, m_shadow_map_size, 0, 0);
+	m_device->clear_framebuffer(ClearTarget::ALL, clear);
+
+	m_device->bind_rasterizer_state(m_copy_rs);
+	m_device->bind_depth_stencil_state(m_copy_ds);
+	m_device->bind_shader_program(m_copy_program);
+	m_device->bind_texture(m_static_maps, ShaderType::FRAGMENT, 0);
+	m_device->bind_sampler_state(m_copy_sampler, ShaderType::FRAGMENT, 0);
+	m_device->bind_vertex_array(m_copy_vao);
+	m_device->set_primitive_type(PrimitiveType::TRIANGLES);
+	m_device->draw(i * 3, 3);
 }
 
-void Shadows::update(Camera* camera, glm::vec3 dir)
+void Shadows::update(Camera* camera, glm::vec3 dir, const ShadowCaster* casters, uint32_t caster_count)
 {
 	dir = glm::normalize(dir);
+	m_light_dir = dir;
+	m_casters = casters;
+	m_caster_count = caster_count;
+
+	// The cache is only allocated while it is used.
+	if (m_cached_shadows && !m_static_maps)
+	{
+		if (!create_static_maps())
+			LOG_ERROR("Failed to create static shadow maps");
+	}
+	else if (!m_cached_shadows && m_static_maps)
+		destroy_static_maps();
 
 	glm::vec3 center = camera->m_position + camera->m_forward * 50.0f;
 	glm::vec3 light_pos = center - dir * ((camera->m_far - camera->m_near) / 2.0f);
@@ -133,6 +418,32 @@ void Shadows::update_splits(Camera* camera)
 	float nd = camera->m_near;
 	float fd = camera->m_far;
 
+	// Fit the splits to the visible geometry. Keep a minimum extent so the scheme does not collapse on flat ranges.
+	if (m_sdsm && m_depth_range_valid)
+	{
+		nd = glm::clamp(m_depth_range.min, camera->m_near, camera->m_far);
+		fd = glm::clamp(m_depth_range.max, nd + SDSM_MIN_DEPTH_EXTENT, camera->m_far);
+
+		if (m_stable_pssm || m_cached_shadows)
+		{
+			// Keep the last snapped range while it covers the new one with less than a step to spare on either side.
+			int32_t near_step = int32_t(floorf(log2f(nd) * SDSM_DEPTH_STEPS));
+			int32_t far_step = int32_t(ceilf(log2f(fd) * SDSM_DEPTH_STEPS));
+
+			if (m_sdsm_steps[0] > near_step || m_sdsm_steps[0] < near_step - 1 || m_sdsm_steps[1] < far_step || m_sdsm_steps[1] > far_step + 1)
+			{
+				m_sdsm_steps[0] = near_step;
+				m_sdsm_steps[1] = far_step;
+			}
+
+			nd = glm::clamp(exp2f(float(m_sdsm_steps[0]) / SDSM_DEPTH_STEPS), camera->m_near, camera->m_far);
+			fd = glm::clamp(exp2f(float(m_sdsm_steps[1]) / SDSM_DEPTH_STEPS), nd + SDSM_MIN_DEPTH_EXTENT, camera->m_far);
+		}
+
+		nd = std::min(nd, fd - SDSM_MIN_DEPTH_EXTENT);
+		nd = std::max(nd, camera->m_near);
+	}
+
 	float lambda = m_settings.lambda;
 	float ratio = fd / nd;
 	m_splits[0].near_plane = nd;
@@ -190,39 +501,55 @@ void Shadows::update_frustum_corners(Camera* camera)
 
 void Shadows::update_crop_matrices(glm::mat4 t_modelview)
 {
-	glm::mat4 t_projection;
-	for (int i = 0; i < m_settings.split_count; i++) 
-	{
-		FrustumSplit& t_frustum = m_splits[i];
-
-		glm::vec3 tmax(-INFINITY, -INFINITY, -INFINITY);
-		glm::vec3 tmin(INFINITY, INFINITY, INFINITY);
+	// Gather the corners of all splits so they are transformed as one batch.
+	float corners_x[8 * MAX_FRUSTUM_SPLITS];
+	float corners_y[8 * MAX_FRUSTUM_SPLITS];
+	float corners_z[8 * MAX_FRUSTUM_SPLITS];
 
-		// find the z-range of the current frustum as seen from the light
-		// in order to increase precision
+	for (int i = 0; i < m_settings.split_count; i++)
+	{
+		for (int j = 0; j < 8; j++)
+		{
+			corners_x[8 * i + j] = m_splits[i].corners[j].x;
+			corners_y[8 * i + j] = m_splits[i].corners[j].y;
+			corners_z[8 * i + j] = m_splits[i].corners[j].z;
+		}
+	}
 
-		// note that only the z-component is need and thus
-		// the multiplication can be simplified
-		// transf.z = shad_modelview[2] * f.point[0].x + shad_modelview[6] * f.point[0].y + shad_modelview[10] * f.point[0].z + shad_modelview[14];
-		glm::vec4 t_transf = t_modelview * glm::vec4(t_frustum.corners[0], 1.0f);
+	// Light space box of every split's receivers.
+	CascadeBounds bounds[MAX_FRUSTUM_SPLITS];
+	light_space_split_bounds(t_modelview, corners_x, corners_y, corners_z, m_settings.split_count, bounds);
 
-		tmin.z = t_transf.z;
-		tmax.z = t_transf.z;
-		for (int j = 1; j < 8; j++) 
+	// The depth range of each split runs from the furthest receiver to the closest caster that can shadow it.
+	if (m_casters)
+		cull_shadow_casters(t_modelview, m_casters, m_caster_count, bounds, m_settings.split_count, m_cascade_casters);
+	else
+	{
+		for (int i = 0; i < m_settings.split_count; i++)
 		{
-			t_transf = t_modelview * glm::vec4(t_frustum.corners[j], 1.0f);
-			if (t_transf.z > tmax.z) { tmax.z = t_transf.z; }
-			if (t_transf.z < tmin.z) { tmin.z = t_transf.z; }
+			m_cascade_casters[i].visible.clear();
+			m_cascade_casters[i].near_z = bounds[i].max.z + m_settings.near_offset;
+			m_cascade_casters[i].far_z = bounds[i].min.z;
 		}
+	}
+
+	ShadowCacheKey cache_keys[MAX_FRUSTUM_SPLITS];
+
+	// The light view follows the camera, positions that have to stay put are measured in its rotation basis instead.
+	glm::vec3 origin = glm::vec3(t_modelview[3]);
 
-		tmax.z += 50; // TODO: This solves the dissapearing shadow problem. but how to fix?
+	for (int i = 0; i < m_settings.split_count; i++) 
+	{
+		FrustumSplit& t_frustum = m_splits[i];
+		CascadeCasters& cascade = m_cascade_casters[i];
 
-		glm::mat4 t_ortho = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -m_settings.near_offset, -tmin.z);
-		glm::mat4 t_shad_mvp = t_ortho * t_modelview;
+		// The ortho projection leaves x and y untouched, so light view space and projected bounds are the same.
+		glm::vec2 tmin = glm::vec2(bounds[i].min);
+		glm::vec2 tmax = glm::vec2(bounds[i].max);
 
-		if (m_stable_pssm)
+		if (m_stable_pssm || m_cached_shadows)
 		{
-			// Calculate frustum split center
+			// Frustum split center
 			glm::vec3 center(0.0f, 0.0f, 0.0f);
 
 			for (int j = 0; j < 8; j++)
@@ -230,49 +557,31 @@ void Shadows::update_crop_matrices(glm::mat4 t_modelview)
 			
 			center /= 8.0f;
 
-			// Calculate bounding sphere radius
-			float radius = 0.0f;
+			// Fit a box around the bounding sphere, so the size of the projection does not change when the camera
+			// rotates, and move it in whole texels, so it does not shimmer when the camera moves.
+			float radius = split_radius(i);
+			float texel_size = 2.0f * radius / float(glm::max(m_settings.shadow_map_size, 1));
 
-			for (int j = 0; j < 8; j++)
-			{
-				float length = glm::length(t_frustum.corners[j] - center);
-				radius = glm::max(radius, length);
-			}
+			glm::vec2 texel = glm::floor((glm::vec2(t_modelview * glm::vec4(center, 1.0f)) - glm::vec2(origin)) / texel_size);
+			glm::vec2 light_center = texel * texel_size + glm::vec2(origin);
 
-			radius = floor(radius);
+			tmin = light_center - glm::vec2(radius);
+			tmax = light_center + glm::vec2(radius);
 
-			// Find bounding box that fits the sphere
-			glm::vec3 radius3(radius, radius, radius);
-
-			glm::vec4 max = glm::vec4(center + radius3, 1.0f);
-			glm::vec4 min = glm::vec4(center - radius3, 1.0f);
-
-			max = t_shad_mvp * max;
-			max /= max.w;
-
-			tmax = glm::vec3(max);
-
-			min = t_shad_mvp * min;
-			min /= min.w;
-
-			tmin = glm::vec3(min);
-		}
-		else
-		{
-			// find the extends of the frustum slice as projected in light's homogeneous coordinates
-			for (int j = 0; j < 8; j++)
+			if (m_cached_shadows)
 			{
-				t_transf = t_shad_mvp * glm::vec4(t_frustum.corners[j], 1.0f);
-
-				t_transf.x /= t_transf.w;
-				t_transf.y /= t_transf.w;
-
-				if (t_transf.x > tmax.x) { tmax.x = t_transf.x; }
-				if (t_transf.x < tmin.x) { tmin.x = t_transf.x; }
-				if (t_transf.y > tmax.y) { tmax.y = t_transf.y; }
-				if (t_transf.y < tmin.y) { tmin.y = t_transf.y; }
+				ShadowCacheKey& key = cache_keys[i];
+				key.light_dir = m_light_dir;
+				key.origin_x = int32_t(texel.x);
+				key.origin_y = int32_t(texel.y);
+				key.radius = radius;
+
+				// Widen the depth range to whole steps, so casters moving a little do not throw away the cache.
+				snap_cache_depth(origin.z, cascade.near_z, cascade.far_z, key);
 			}
 		}
+
+		glm::mat4 t_ortho = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -cascade.near_z, -cascade.far_z);
 		
 		glm::vec2 tscale(2.0f / (tmax.x - tmin.x), 2.0f / (tmax.y - tmin.y));
 		glm::vec2 toffset(-0.5f * (tmax.x + tmin.x) * tscale.x, -0.5f * (tmax.y + tmin.y) * tscale.y);
@@ -284,10 +593,41 @@ void Shadows::update_crop_matrices(glm::mat4 t_modelview)
 		t_shad_crop[1][3] = toffset.y;
 		t_shad_crop = glm::transpose(t_shad_crop);
 
-		t_projection = t_shad_crop * t_ortho;
+		glm::mat4 t_projection = t_shad_crop * t_ortho;
 
 		// Store the projection matrix
 		m_proj_matrices[i] = t_projection;
 		m_crop_matrices[i] = t_projection * t_modelview;
 	}
+
+	if (m_cached_shadows)
+		m_cache_scheduler.schedule(cache_keys, m_cascade_actions);
+}
+
+float Shadows::split_radius(int i)
+{
+	// The bounding sphere only depends on the shape of the split, not on where the camera is or looks.
+	FrustumSplit& split = m_splits[i];
+	glm::vec4 key = glm::vec4(split.near_plane, split.far_plane, split.fov, split.ratio);
+
+	if (key != m_split_radius_key[i])
+	{
+		glm::vec3 center(0.0f, 0.0f, 0.0f);
+
+		for (int j = 0; j < 8; j++)
+			center += split.corners[j];
+
+		center /= 8.0f;
+
+		float radius = 0.0f;
+
+		for (int j = 0; j < 8; j++)
+			radius = glm::max(radius, glm::length(split.corners[j] - center));
+
+		// Round up so float noise in the corners does not change the size between recomputations.
+		m_split_radius[i] = ceilf(radius * 16.0f) / 16.0f;
+		m_split_radius_key[i] = key;
+	}
+
+	return m_split_radius[i];
 }
\ No newline at end of file
@@ -1,13 +1,29 @@
 #pragma once
 
 #include <glm.hpp>
+#include "shadow_culling.h"
+#include "depth_reduction.h"
+#include "shadow_cache.h"
 
 #define MAX_FRUSTUM_SPLITS 8
+// D32_FLOAT_S8_UINT is stored as 64 bits per texel.
+#define SHADOW_MAP_TEXEL_SIZE 8
+#define SDSM_MIN_DEPTH_EXTENT 1.0f
+// Stable and cached cascades snap the SDSM depth range outward to steps of 2^(1 / SDSM_DEPTH_STEPS).
+#define SDSM_DEPTH_STEPS 8
 
 class Camera;
 class RenderDevice;
-struct Texture2D;
+struct Texture2DArray;
 struct Framebuffer;
+struct Shader;
+struct ShaderProgram;
+struct VertexBuffer;
+struct InputLayout;
+struct VertexArray;
+struct DepthStencilState;
+struct RasterizerState;
+struct SamplerState;
 
 struct FrustumSplit
 {
@@ -29,26 +45,98 @@ struct ShadowSettings
 class Shadows
 {
 private:
-	//Texture2D* m_shadow_maps;
-	Texture2D * m_shadow_maps[MAX_FRUSTUM_SPLITS];
-	Framebuffer* m_shadow_fbos[MAX_FRUSTUM_SPLITS];
+	Texture2DArray* m_shadow_maps;
+	Framebuffer* m_shadow_fbos[MAX_FRUSTUM_SPLITS]; // One per array slice.
+	Texture2DArray* m_static_maps; // Static casters only, see m_cached_shadows.
+	Framebuffer* m_static_fbos[MAX_FRUSTUM_SPLITS];
+	// Fullscreen depth copy used by restore_static(), one triangle per slice.
+	Shader* m_copy_vs;
+	Shader* m_copy_fs;
+	ShaderProgram* m_copy_program;
+	VertexBuffer* m_copy_vbo;
+	InputLayout* m_copy_il;
+	VertexArray* m_copy_vao;
+	DepthStencilState* m_copy_ds;
+	RasterizerState* m_copy_rs;
+	SamplerState* m_copy_sampler;
+	int m_shadow_map_size;
+	int m_shadow_map_slices;
 	ShadowSettings m_settings;
 	FrustumSplit m_splits[MAX_FRUSTUM_SPLITS];
 	RenderDevice* m_device;
 	glm::mat4 m_light_view;
+	glm::vec3 m_light_dir;
 	glm::mat4 m_crop_matrices[MAX_FRUSTUM_SPLITS]; // crop * proj * view
 	glm::mat4 m_proj_matrices[MAX_FRUSTUM_SPLITS]; // crop * proj * light_view * inv_view
+	const ShadowCaster* m_casters;
+	uint32_t m_caster_count;
+	CascadeCasters m_cascade_casters[MAX_FRUSTUM_SPLITS];
+	DepthRange m_depth_range;
+	bool m_depth_range_valid;
+	int32_t m_sdsm_steps[2]; // Snapped near and far of the SDSM range in log2 steps.
+	float m_split_radius[MAX_FRUSTUM_SPLITS];
+	glm::vec4 m_split_radius_key[MAX_FRUSTUM_SPLITS]; // near, far, fov and ratio the radius was computed for.
+	ShadowCacheScheduler m_cache_scheduler;
+	uint32_t m_cascade_actions[MAX_FRUSTUM_SPLITS];
 
 public:
 	bool m_stable_pssm = true;
+	// Sample distribution shadow maps: split the depth range of the visible geometry instead of the whole camera range.
+	// With stable or cached cascades the range is snapped to log steps and only moves once the geometry leaves it or
+	// it has become a step too wide, otherwise the cascades would change size every frame.
+	bool m_sdsm = false;
+	// Keep the static casters of every cascade in a second array and only redraw them when the cascade moves. Forces
+	// stable cascades. Each frame, for every cascade:
+	//   if (cascade_actions(i) & SHADOW_CACHE_RENDER_STATIC) draw the static casters into static_framebuffer(i)
+	//   if (cascade_actions(i) & SHADOW_CACHE_COMPOSITE) restore_static(i), then draw the dynamic casters into split_framebuffer(i)
+	bool m_cached_shadows = false;
 
 	Shadows();
 	~Shadows();
+	// Can be called again to change the settings. The shadow maps are only reallocated if their size changes or more
+	// splits are requested than the array has slices.
 	void initialize(RenderDevice* device, ShadowSettings settings, Camera* camera, int _width, int _height, glm::vec3 dir);
-	void update(Camera* camera, glm::vec3 dir);
+	void shutdown();
+	// Depth range of the visible geometry used by SDSM, see depth_reduction.h. Stays in use until it is replaced or
+	// cleared. Without one the splits cover the whole camera range.
+	void set_depth_range(const DepthRange& range);
+	void clear_depth_range();
+	// Without casters each cascade's depth range reaches near_offset past its receivers toward the light, and every
+	// caster list is empty. The casters have to stay alive until the next update.
+	void update(Camera* camera, glm::vec3 dir, const ShadowCaster* casters = nullptr, uint32_t caster_count = 0);
 	void update_splits(Camera* camera);
 	void update_frustum_corners(Camera* camera);
 	void update_crop_matrices(glm::mat4 t_modelview);
+
+private:
+	bool create_shadow_maps();
+	void destroy_shadow_maps();
+	bool create_static_maps();
+	void destroy_static_maps();
+	bool create_copy_pass();
+	void destroy_copy_pass();
+	bool create_depth_array(int slices, Texture2DArray** array, Framebuffer** fbos);
+	void destroy_depth_array(Texture2DArray** array, Framebuffer** fbos);
+	float split_radius(int i);
+
+public:
 	FrustumSplit* frustum_splits();
 	glm::mat4 split_view_proj(int i);
+	inline Texture2DArray* shadow_maps() { return m_shadow_maps; }
+	inline Framebuffer* split_framebuffer(int i) { return m_shadow_fbos[i]; }
+	inline Framebuffer* static_framebuffer(int i) { return m_static_fbos[i]; }
+	// Only valid with m_cached_shadows, a combination of ShadowCacheAction.
+	inline uint32_t cascade_actions(int i) { return m_cascade_actions[i]; }
+	inline ShadowCacheScheduler& cache_scheduler() { return m_cache_scheduler; }
+	// Copies the cached static depth of a cascade into its shadow map slice. Leaves the slice's framebuffer bound and
+	// changes the bound program, vertex array, sampler and render states.
+	void restore_static(int i);
+	inline int shadow_map_size() { return m_shadow_map_size; }
+	inline int shadow_map_slices() { return m_shadow_map_slices; }
+	// GPU memory held by the shadow map and static cache arrays in bytes.
+	inline size_t shadow_map_memory() { return size_t(m_shadow_map_size) * m_shadow_map_size * m_shadow_map_slices * SHADOW_MAP_TEXEL_SIZE * (m_static_maps ? 2 : 1); }
+	// Indices of the casters that have to be drawn into a split.
+	const std::vector<uint32_t>& split_casters(int i);
+	// Light view space z range covered by a split's projection, nearest to the light first.
+	glm::vec2 split_depth_range(int i);
 };
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+namespace dw
+{
+	// 64 bit FNV-1a. Start with FNV_OFFSET_BASIS and pass the previous result to hash several blocks.
+	inline uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+	{
+		const uint8_t* bytes = (const uint8_t*)data;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= FNV_PRIME;
+		}
+
+		return hash;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#pragma once
+
+// SSE2 is always there on x64, 32 bit MSVC reports it through /arch:SSE2. Kernels fall back to scalar code otherwise.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DW_SIMD 1
+#else
+#define DW_SIMD 0
+#endif
\ No newline at end of file
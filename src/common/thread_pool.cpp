@@ -0,0 +1,100 @@
+#include "thread_pool.h"
+
+namespace dw
+{
+	ThreadPool::ThreadPool(int num_workers) : m_func(nullptr), m_next_index(0), m_remaining(0), m_count(0), m_active_workers(0), m_generation(0), m_shutdown(false)
+	{
+		if (num_workers < 0)
+		{
+			int hardware_threads = int(std::thread::hardware_concurrency());
+			num_workers = hardware_threads > 1 ? hardware_threads - 1 : 0;
+		}
+
+		for (int i = 0; i < num_workers; i++)
+			m_workers.push_back(std::thread(&ThreadPool::worker_main, this));
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_shutdown = true;
+		}
+
+		m_wake_cv.notify_all();
+
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	void ThreadPool::parallel_for(int count, const std::function<void(int)>& func)
+	{
+		if (count <= 0)
+			return;
+
+		if (m_workers.size() == 0 || count == 1)
+		{
+			for (int i = 0; i < count; i++)
+				func(i);
+
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_func = &func;
+			m_count = count;
+			m_next_index = 0;
+			m_remaining = count;
+			m_active_workers = int(m_workers.size());
+			m_generation++;
+		}
+
+		m_wake_cv.notify_all();
+
+		run_jobs();
+
+		// Wait for both the jobs and the workers, so m_func is not reused while a worker still holds it.
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done_cv.wait(lock, [this]() { return m_remaining == 0 && m_active_workers == 0; });
+		m_func = nullptr;
+	}
+
+	void ThreadPool::run_jobs()
+	{
+		int index;
+
+		while ((index = m_next_index.fetch_add(1)) < m_count)
+		{
+			(*m_func)(index);
+			m_remaining.fetch_sub(1);
+		}
+	}
+
+	void ThreadPool::worker_main()
+	{
+		uint64_t last_generation = 0;
+
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake_cv.wait(lock, [&]() { return m_shutdown || m_generation != last_generation; });
+
+				if (m_shutdown)
+					return;
+
+				last_generation = m_generation;
+			}
+
+			run_jobs();
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_active_workers--;
+			}
+
+			m_done_cv.notify_one();
+		}
+	}
+}
\ No newline at end of file
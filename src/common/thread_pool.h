@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <stdint.h>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace dw
+{
+	// Minimal fork-join pool. parallel_for hands out indices dynamically and blocks until all of them are done;
+	// the calling thread takes part in the work.
+	class ThreadPool
+	{
+	public:
+		ThreadPool(int num_workers = -1);
+		~ThreadPool();
+		void parallel_for(int count, const std::function<void(int)>& func);
+		inline int worker_count() { return int(m_workers.size()); }
+
+	private:
+		void worker_main();
+		void run_jobs();
+
+	private:
+		std::vector<std::thread> m_workers;
+		std::mutex m_mutex;
+		std::condition_variable m_wake_cv;
+		std::condition_variable m_done_cv;
+		const std::function<void(int)>* m_func;
+		std::atomic<int> m_next_index;
+		std::atomic<int> m_remaining;
+		int m_count;
+		int m_active_workers;
+		uint64_t m_generation;
+		bool m_shutdown;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <deque>
+#include <stdint.h>
+#include <stddef.h>
+
+#define UNIFORM_RING_INVALID_OFFSET SIZE_MAX
+
+namespace dw
+{
+	// Sub-allocator for per-frame data written into one persistently mapped buffer. Allocations are made linearly and
+	// wrap around at the end. end_frame() fences everything allocated since the last call, and that region is only
+	// reused once its fence has signaled, so the CPU never writes memory the GPU may still be reading.
+	//
+	// The fence is a policy so the ring logic can run without a GPU:
+	//   struct Fence
+	//   {
+	//       typedef ... Handle;
+	//       Handle insert();			// Signals once all commands submitted so far have completed.
+	//       bool signaled(Handle h);	// Does not block.
+	//       void wait(Handle h);		// Blocks until signaled.
+	//       void release(Handle h);
+	//   };
+	template <typename Fence>
+	class UniformRing
+	{
+	public:
+		UniformRing() : m_memory(nullptr), m_capacity(0), m_alignment(1), m_head(0), m_used(0), m_frame_bytes(0), m_waits(0)
+		{
+
+		}
+
+		~UniformRing()
+		{
+			shutdown();
+		}
+
+		// alignment has to be a power of two.
+		void initialize(uint8_t* memory, size_t capacity, size_t alignment, const Fence& fence = Fence())
+		{
+			shutdown();
+
+			m_memory = memory;
+			m_capacity = capacity;
+			m_alignment = alignment;
+			m_fence = fence;
+		}
+
+		void shutdown()
+		{
+			for (auto& frame : m_frames)
+				m_fence.release(frame.fence);
+
+			m_frames.clear();
+			m_head = 0;
+			m_used = 0;
+			m_frame_bytes = 0;
+		}
+
+		// Returns the offset of the allocation and writes its address to ptr. Waits for the oldest frames if the ring
+		// is full. Returns UNIFORM_RING_INVALID_OFFSET if the allocation does not fit even with nothing in flight.
+		size_t allocate(size_t size, void** ptr)
+		{
+			size_t offset;
+			size_t padding;
+
+			while (!fit(size, offset, padding))
+			{
+				if (m_frames.size() == 0)
+					return UNIFORM_RING_INVALID_OFFSET;
+
+				// Retire whatever already finished before blocking on the oldest frame.
+				if (!retire_signaled())
+				{
+					m_fence.wait(m_frames.front().fence);
+					m_waits++;
+					retire_front();
+				}
+			}
+
+			m_head = offset + size;
+			m_used += padding + size;
+			m_frame_bytes += padding + size;
+
+			if (ptr)
+				*ptr = m_memory + offset;
+
+			return offset;
+		}
+
+		// Fences the allocations of the current frame. Call after the commands reading them have been submitted.
+		void end_frame()
+		{
+			if (m_frame_bytes > 0)
+			{
+				FrameRegion frame;
+				frame.fence = m_fence.insert();
+				frame.size = m_frame_bytes;
+				m_frames.push_back(frame);
+			}
+
+			m_frame_bytes = 0;
+			retire_signaled();
+		}
+
+		inline size_t aligned_size(size_t size) { return (size + m_alignment - 1) & ~(m_alignment - 1); }
+		inline size_t capacity() { return m_capacity; }
+		inline size_t alignment() { return m_alignment; }
+		// Bytes written by the current frame or still read by frames in flight, including alignment padding.
+		inline size_t used() { return m_used; }
+		inline size_t frames_in_flight() { return m_frames.size(); }
+		// Number of times an allocation had to block on a fence.
+		inline uint64_t waits() { return m_waits; }
+
+	private:
+		struct FrameRegion
+		{
+			typename Fence::Handle fence;
+			size_t size;
+		};
+
+		bool fit(size_t size, size_t& offset, size_t& padding)
+		{
+			offset = aligned_size(m_head);
+			padding = offset - m_head;
+
+			// Skip the tail end of the buffer if the allocation does not fit before it.
+			if (offset + size > m_capacity)
+			{
+				offset = 0;
+				padding = m_capacity - m_head;
+			}
+
+			// Nothing is in use, so the allocation can start anywhere.
+			if (m_used == 0)
+			{
+				padding = 0;
+				offset = 0;
+				m_head = 0;
+			}
+
+			return size <= m_capacity && m_used + padding + size <= m_capacity;
+		}
+
+		bool retire_signaled()
+		{
+			bool retired = false;
+
+			while (m_frames.size() > 0 && m_fence.signaled(m_frames.front().fence))
+			{
+				retire_front();
+				retired = true;
+			}
+
+			return retired;
+		}
+
+		void retire_front()
+		{
+			m_used -= m_frames.front().size;
+			m_fence.release(m_frames.front().fence);
+			m_frames.pop_front();
+		}
+
+	private:
+		Fence m_fence;
+		uint8_t* m_memory;
+		size_t m_capacity;
+		size_t m_alignment;
+		size_t m_head;
+		size_t m_used;
+		size_t m_frame_bytes;
+		uint64_t m_waits;
+		std::deque<FrameRegion> m_frames;
+	};
+}
\ No newline at end of file
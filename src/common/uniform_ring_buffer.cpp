@@ -0,0 +1,103 @@
+#include "uniform_ring_buffer.h"
+#include <logger.h>
+#include <algorithm>
+
+#define GL_FENCE_WAIT_TIMEOUT 1000000 // 1 ms
+
+namespace dw
+{
+	GLFence::Handle GLFence::insert()
+	{
+		return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	bool GLFence::signaled(Handle fence)
+	{
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+	}
+
+	void GLFence::wait(Handle fence)
+	{
+		// Flush once so the fence is guaranteed to reach the GPU, then keep waiting.
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+
+		while (true)
+		{
+			GLenum result = glClientWaitSync(fence, flags, GL_FENCE_WAIT_TIMEOUT);
+
+			if (result != GL_TIMEOUT_EXPIRED)
+				return;
+
+			flags = 0;
+		}
+	}
+
+	void GLFence::release(Handle fence)
+	{
+		glDeleteSync(fence);
+	}
+
+	UniformRingBuffer::UniformRingBuffer() : m_buffer(0)
+	{
+
+	}
+
+	UniformRingBuffer::~UniformRingBuffer()
+	{
+		shutdown();
+	}
+
+	bool UniformRingBuffer::initialize(size_t capacity)
+	{
+		shutdown();
+
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+		// Allocations can also back texture buffer ranges.
+		GLint texture_alignment = 256;
+		glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &texture_alignment);
+		alignment = std::max(alignment, texture_alignment);
+
+		// Immutable storage that stays mapped for the lifetime of the buffer. Coherent, so no explicit flushes are needed.
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glGenBuffers(1, &m_buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+		glBufferStorage(GL_UNIFORM_BUFFER, capacity, nullptr, flags);
+
+		uint8_t* memory = (uint8_t*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, capacity, flags);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		if (!memory)
+		{
+			LOG_ERROR("Failed to map uniform ring buffer");
+			shutdown();
+			return false;
+		}
+
+		m_ring.initialize(memory, capacity, size_t(alignment));
+
+		return true;
+	}
+
+	void UniformRingBuffer::shutdown()
+	{
+		m_ring.shutdown();
+
+		if (m_buffer)
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+			glDeleteBuffers(1, &m_buffer);
+			m_buffer = 0;
+		}
+	}
+
+	void UniformRingBuffer::bind_uniform(GLuint binding, size_t offset, size_t size)
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_buffer, offset, size);
+	}
+}
\ No newline at end of file
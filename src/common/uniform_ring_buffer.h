@@ -0,0 +1,38 @@
+#pragma once
+
+#include <render_device.h>
+#include "uniform_ring.h"
+
+namespace dw
+{
+	struct GLFence
+	{
+		typedef GLsync Handle;
+
+		Handle insert();
+		bool signaled(Handle fence);
+		void wait(Handle fence);
+		void release(Handle fence);
+	};
+
+	// UniformRing over a persistently mapped, coherent GL buffer. The buffer object can be bound to any target, so
+	// it also carries vertex streams such as the terrain instances, and allocations are aligned for texture buffers.
+	class UniformRingBuffer
+	{
+	public:
+		UniformRingBuffer();
+		~UniformRingBuffer();
+		// The capacity should hold a few frames of data, allocations block once the GPU is that far behind.
+		bool initialize(size_t capacity);
+		void shutdown();
+		inline size_t allocate(size_t size, void** ptr) { return m_ring.allocate(size, ptr); }
+		void bind_uniform(GLuint binding, size_t offset, size_t size);
+		inline void end_frame() { m_ring.end_frame(); }
+		inline GLuint buffer() { return m_buffer; }
+		inline UniformRing<GLFence>& ring() { return m_ring; }
+
+	private:
+		GLuint m_buffer;
+		UniformRing<GLFence> m_ring;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <common/uniform_ring.h>
+
+#define TEST_FRAMES 20000
+#define TEST_CAPACITY (192 * 1024) // Holds the largest frame, but not TEST_GPU_LATENCY average ones.
+#define TEST_ALIGNMENT 256
+#define TEST_GPU_LATENCY 3
+#define NO_FRAME UINT64_MAX
+
+// Stands in for the GPU. Frame f is submitted at the end of frame f and completes TEST_GPU_LATENCY frames later,
+// or as soon as the CPU waits for it.
+struct FakeGpu
+{
+	uint64_t submitted = 0;
+	uint64_t completed = 0; // Frames below this one have completed.
+};
+
+struct FakeFence
+{
+	typedef uint64_t Handle;
+
+	FakeGpu* gpu = nullptr;
+
+	Handle insert() { return gpu->submitted; }
+	bool signaled(Handle fence) { return fence < gpu->completed; }
+	void wait(Handle fence) { gpu->completed = std::max(gpu->completed, fence + 1); }
+	void release(Handle) {}
+};
+
+// Runs the ring against the fake fence with random allocations and records, for every byte, the frame that last
+// wrote it. Writing a byte that a frame still in flight owns is a failure.
+int main()
+{
+	FakeGpu gpu;
+	FakeFence fence;
+	fence.gpu = &gpu;
+
+	std::vector<uint8_t> memory(TEST_CAPACITY);
+	std::vector<uint64_t> owner(TEST_CAPACITY, NO_FRAME);
+
+	dw::UniformRing<FakeFence> ring;
+	ring.initialize(&memory[0], TEST_CAPACITY, TEST_ALIGNMENT, fence);
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> count_dist(1, 24);
+	std::uniform_int_distribution<int> size_dist(1, 4096);
+
+	uint64_t allocations = 0;
+	uint64_t failures = 0;
+
+	for (uint64_t frame = 0; frame < TEST_FRAMES; frame++)
+	{
+		int count = count_dist(rng);
+
+		for (int i = 0; i < count; i++)
+		{
+			size_t size = size_t(size_dist(rng));
+			void* ptr;
+			size_t offset = ring.allocate(size, &ptr);
+
+			if (offset == UNIFORM_RING_INVALID_OFFSET || offset % TEST_ALIGNMENT != 0 || offset + size > TEST_CAPACITY || ptr != &memory[offset])
+			{
+				failures++;
+				continue;
+			}
+
+			for (size_t j = offset; j < offset + size; j++)
+			{
+				// Same frame overlaps are as wrong as overlaps with frames in flight.
+				if (owner[j] != NO_FRAME && owner[j] >= gpu.completed)
+					failures++;
+
+				owner[j] = frame;
+			}
+
+			allocations++;
+		}
+
+		gpu.submitted = frame;
+		ring.end_frame();
+
+		if (frame + 1 >= TEST_GPU_LATENCY)
+			gpu.completed = std::max(gpu.completed, frame + 1 - TEST_GPU_LATENCY);
+	}
+
+	// Oversized allocations fail instead of blocking forever.
+	if (ring.allocate(TEST_CAPACITY + 1, nullptr) != UNIFORM_RING_INVALID_OFFSET)
+		failures++;
+
+	std::cout << "Frames      : " << TEST_FRAMES << std::endl;
+	std::cout << "Allocations : " << allocations << std::endl;
+	std::cout << "Fence waits : " << ring.waits() << std::endl;
+	std::cout << "Failures    : " << failures << std::endl;
+
+	return failures == 0 && ring.waits() > 0 ? 0 : 1;
+}
\ No newline at end of file